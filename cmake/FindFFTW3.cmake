@@ -4,6 +4,9 @@
 # FFTW3_INCLUDE_DIRS, where to find fftw3.h, etc.
 # FFTW3_LIBRARIES, the libraries to link against to use FFTW3.
 # FFTW3_FOUND, If false, do not try to use FFTW3.
+# FFTW3_THREADS_LIBRARIES, the multi-threaded FFTW3 libraries, if found.
+# FFTW3F_LIBRARIES, FFTW3F_THREADS_LIBRARIES, the single precision libraries.
+# FFTW3L_LIBRARIES, FFTW3L_THREADS_LIBRARIES, the long double libraries.
 
 find_package (PkgConfig)
 pkg_check_modules (PC_FFTW3 "fftw3" QUIET)
@@ -24,6 +27,32 @@ find_library (FFTW3_LIBRARIES
   /usr/local/lib
   /usr/lib)
 
+find_library (FFTW3_THREADS_LIBRARIES
+  NAMES fftw3_threads fftw3_omp
+  HINTS ${PC_FFTW3_LIBDIR}
+  ${PC_FFTW3_LIBRARY_DIRS}
+  ${FFTW3_INCLUDE_DIRS}/../lib
+  /usr/local/lib
+  /usr/lib)
+
+foreach (prec f l)
+  string (TOUPPER ${prec} PREC)
+  find_library (FFTW3${PREC}_LIBRARIES
+    NAMES fftw3${prec}
+    HINTS ${PC_FFTW3_LIBDIR}
+    ${PC_FFTW3_LIBRARY_DIRS}
+    ${FFTW3_INCLUDE_DIRS}/../lib
+    /usr/local/lib
+    /usr/lib)
+  find_library (FFTW3${PREC}_THREADS_LIBRARIES
+    NAMES fftw3${prec}_threads fftw3${prec}_omp
+    HINTS ${PC_FFTW3_LIBDIR}
+    ${PC_FFTW3_LIBRARY_DIRS}
+    ${FFTW3_INCLUDE_DIRS}/../lib
+    /usr/local/lib
+    /usr/lib)
+endforeach ()
+
 if (FFTW3_INCLUDE_DIRS)
   if (FFTW3_LIBRARIES)
     set (FFTW3_FOUND "YES")
@@ -0,0 +1,306 @@
+// necomi/algorithms/labels.h – Connected component labeling
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+#include "../core/strides.h"
+
+namespace necomi
+{
+
+/**
+ * Neighbors of an element in connected components.
+ */
+enum class Connectivity
+{
+  /// Neighbors sharing a face: 4 in 2D, 6 in 3D.
+  FACE,
+  /// Neighbors sharing a face, an edge or a corner: 8 in 2D, 26 in 3D.
+  FULL,
+};
+
+/**
+ * Size and bounding box of a connected component.
+ */
+template <std::size_t N>
+struct Component
+{
+  /// Number of elements.
+  std::size_t size;
+  /// Lowest coordinates of the elements.
+  std::array<std::size_t,N> lower;
+  /// Highest coordinates of the elements, plus one.
+  std::array<std::size_t,N> upper;
+};
+
+/**
+ * Offsets of the neighbors preceding an element in row-major order.
+ */
+template <std::size_t N>
+std::vector<std::array<std::ptrdiff_t,N>> preceding_neighbors(Connectivity connectivity)
+{
+  std::vector<std::array<std::ptrdiff_t,N>> res;
+  std::array<std::ptrdiff_t,N> o;
+  std::size_t count = 1;
+  for (std::size_t d = 0; d < N; d++)
+    count *= 3;
+  for (std::size_t k = 0; k < count; k++) {
+    auto rem = k;
+    std::size_t nonzero = 0;
+    for (std::size_t d = N; d-- > 0; ) {
+      o[d] = static_cast<std::ptrdiff_t>(rem % 3) - 1;
+      rem /= 3;
+      nonzero += o[d] != 0;
+    }
+    // The first non-null offset must be negative
+    auto first = std::find_if(o.cbegin(), o.cend(), [](auto x) { return x != 0; });
+    if (first == o.cend() || *first > 0)
+      continue;
+    if (connectivity == Connectivity::FACE && nonzero != 1)
+      continue;
+    res.push_back(o);
+  }
+  return res;
+}
+
+/**
+ * Root of an element in a union-find forest, halving the path.
+ */
+inline std::size_t union_find_root(std::vector<std::size_t>& parent, std::size_t x)
+{
+  while (parent[x] != x) {
+    parent[x] = parent[parent[x]];
+    x = parent[x];
+  }
+  return x;
+}
+
+/**
+ * Merge the trees of two elements, the root with the lowest index
+ * becoming the root of the merged tree.
+ */
+inline void union_find_merge(std::vector<std::size_t>& parent,
+			     std::size_t a, std::size_t b)
+{
+  a = union_find_root(parent, a);
+  b = union_find_root(parent, b);
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+
+/**
+ * Label the connected components of an array, made of adjacent
+ * non-null elements with equal values, so that boolean masks and
+ * label arrays can both be used.
+ *
+ * Components are labeled from 1 in the order of their first element,
+ * background elements being labeled 0, and their sizes and bounding
+ * boxes are stored in \c components, the component of label i at
+ * index i-1.
+ *
+ * The array is cut in strips along its first dimension, each strip
+ * being labeled concurrently with a union-find forest. The trees of
+ * the adjacent elements of consecutive strips are then merged, and
+ * the final labels and component statistics computed concurrently.
+ * Labels do not depend on the number of threads.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<std::size_t,Array::ndim()>
+label_components(const Array& a, std::vector<Component<Array::ndim()>>& components,
+		 Connectivity connectivity = Connectivity::FACE)
+{
+  constexpr auto N = Array::ndim();
+  static_assert(N > 0, "cannot label scalar values");
+  typedef typename Array::dtype T;
+
+  auto values = strided_array(a);
+  const auto& dims = values.dims();
+  const auto strides = default_strides(dims);
+  StridedArray<std::size_t,N> labels(dims);
+  components.clear();
+
+  std::size_t total = 1;
+  for (auto d : dims)
+    total *= d;
+  if (total == 0)
+    return labels;
+  const T* v = values.data();
+  std::size_t* lab = labels.data();
+
+  const auto neighbors = preceding_neighbors<N>(connectivity);
+  std::vector<std::ptrdiff_t> offsets;
+  for (const auto& o : neighbors) {
+    std::ptrdiff_t off = 0;
+    for (std::size_t d = 0; d < N; d++)
+      off += o[d] * static_cast<std::ptrdiff_t>(strides[d]);
+    offsets.push_back(off);
+  }
+
+  // Link each element to its preceding neighbors inside [from,end)
+  std::vector<std::size_t> parent(total);
+  auto link = [&](std::size_t begin, std::size_t end, std::size_t from) {
+    std::array<std::size_t,N> c;
+    for (auto i = begin; i < end; i++) {
+      parent[i] = i;
+      if (v[i] == T(0))
+	continue;
+      auto rem = i;
+      for (std::size_t d = 0; d < N; d++) {
+	c[d] = rem / strides[d];
+	rem %= strides[d];
+      }
+      for (std::size_t k = 0; k < neighbors.size(); k++) {
+	bool inside = true;
+	for (std::size_t d = 0; d < N; d++) {
+	  const auto x = static_cast<std::ptrdiff_t>(c[d]) + neighbors[k][d];
+	  inside = inside && x >= 0 && x < static_cast<std::ptrdiff_t>(dims[d]);
+	}
+	const auto j = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(i) + offsets[k]);
+	if (inside && j >= from && v[j] == v[i])
+	  union_find_merge(parent, i, j);
+      }
+    }
+  };
+
+  // Strips of slices along the first dimension, noting where they
+  // end rather than relying on the number of threads staying the same
+  const auto slice = strides[0];
+  std::vector<std::size_t> strip_end(dims[0], 0);
+  parallel_for_blocks(dims[0], [&](std::size_t b, std::size_t begin, std::size_t end) {
+      link(begin*slice, end*slice, begin*slice);
+      strip_end[b] = end;
+    });
+
+  // Merge the trees across the strip borders
+  for (std::size_t s = 0; s < dims[0] && strip_end[s] < dims[0]; s++) {
+    const auto row = strip_end[s];
+    std::array<std::size_t,N> c;
+    for (auto i = row*slice; i < (row+1)*slice; i++) {
+      if (v[i] == T(0))
+	continue;
+      auto rem = i;
+      for (std::size_t d = 0; d < N; d++) {
+	c[d] = rem / strides[d];
+	rem %= strides[d];
+      }
+      for (std::size_t k = 0; k < neighbors.size(); k++) {
+	if (neighbors[k][0] != -1)
+	  continue;
+	bool inside = true;
+	for (std::size_t d = 1; d < N; d++) {
+	  const auto x = static_cast<std::ptrdiff_t>(c[d]) + neighbors[k][d];
+	  inside = inside && x >= 0 && x < static_cast<std::ptrdiff_t>(dims[d]);
+	}
+	const auto j = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(i) + offsets[k]);
+	if (inside && v[j] == v[i])
+	  union_find_merge(parent, i, j);
+      }
+    }
+  }
+
+  // Roots, without modifying the shared forest, in blocks reused by
+  // the final pass
+  std::vector<std::size_t> block_end(std::max<std::size_t>(total / 4096, 1), 0);
+  parallel_for_blocks(total, [&](std::size_t b, std::size_t begin, std::size_t end) {
+      for (auto i = begin; i < end; i++) {
+	auto x = i;
+	while (parent[x] != x)
+	  x = parent[x];
+	lab[i] = x;
+      }
+      block_end[b] = end;
+    }, 4096);
+  const auto nblocks = static_cast<std::size_t>
+    (std::find(block_end.begin(), block_end.end(), 0) - block_end.begin());
+
+  // Number the roots in order, noting the first label of each block
+  std::vector<std::size_t> first_label(nblocks + 1);
+  std::size_t count = 0;
+  for (std::size_t b = 0, i = 0; b < nblocks; b++) {
+    first_label[b] = count + 1;
+    for (; i < block_end[b]; i++)
+      if (v[i] != T(0) && lab[i] == i)
+	parent[i] = ++count;
+  }
+  first_label[nblocks] = count + 1;
+
+  // Final labels and component statistics, each block storing those
+  // of the components starting in it, and of the ones it continues
+  Component<N> empty;
+  empty.size = 0;
+  empty.lower = dims;
+  empty.upper.fill(0);
+  std::vector<std::vector<Component<N>>> own(nblocks);
+  std::vector<std::unordered_map<std::size_t,Component<N>>> continued(nblocks);
+  parallel_for(nblocks, [&](std::size_t first, std::size_t last) {
+      for (auto b = first; b < last; b++) {
+	const auto begin = b > 0 ? block_end[b-1] : 0;
+	own[b].assign(first_label[b+1] - first_label[b], empty);
+	for (auto i = begin; i < block_end[b]; i++) {
+	  if (v[i] == T(0)) {
+	    lab[i] = 0;
+	    continue;
+	  }
+	  const auto l = lab[i] = parent[lab[i]];
+	  auto& comp = l >= first_label[b]
+	    ? own[b][l - first_label[b]]
+	    : continued[b].emplace(l, empty).first->second;
+	  comp.size++;
+	  auto rem = i;
+	  for (std::size_t d = 0; d < N; d++) {
+	    const auto c = rem / strides[d];
+	    rem %= strides[d];
+	    comp.lower[d] = std::min(comp.lower[d], c);
+	    comp.upper[d] = std::max(comp.upper[d], c + 1);
+	  }
+	}
+      }
+    });
+
+  components.reserve(count);
+  for (const auto& o : own)
+    components.insert(components.end(), o.cbegin(), o.cend());
+  for (const auto& m : continued)
+    for (const auto& entry : m) {
+      auto& comp = components[entry.first - 1];
+      comp.size += entry.second.size;
+      for (std::size_t d = 0; d < N; d++) {
+	comp.lower[d] = std::min(comp.lower[d], entry.second.lower[d]);
+	comp.upper[d] = std::max(comp.upper[d], entry.second.upper[d]);
+      }
+    }
+
+  return labels;
+}
+
+/**
+ * Label the connected components of an array.
+ * \see label_components
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<std::size_t,Array::ndim()>
+label_components(const Array& a, Connectivity connectivity = Connectivity::FACE)
+{
+  std::vector<Component<Array::ndim()>> components;
+  return label_components(a, components, connectivity);
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
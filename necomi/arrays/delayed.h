@@ -79,6 +79,18 @@ public:
     return static_cast<elem_type>(static_cast<const Self*>(this)->operator()(coords));
   }
 
+  /**
+   * Evaluate the whole array at once.
+   *
+   * Only available when the wrapped expression knows how to compute
+   * all of its elements faster than one coordinate at a time.
+   */
+  template <typename E = Expr>
+  auto materialize() const -> decltype(std::declval<const E&>().materialize())
+  {
+    return m_e.materialize();
+  }
+
 protected:
   Expr m_e;
 };
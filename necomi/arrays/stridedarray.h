@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <sstream>
+#include <utility>
 
 #include "../core/iterators.h"
 #include "../core/loops.h"
@@ -27,6 +28,22 @@
 
 namespace necomi {
 
+template <typename T, std::size_t N> class StridedArray;
+
+/**
+ * Test whether an array can be materialized at once into a
+ * StridedArray<T,N>, avoiding an element by element evaluation.
+ */
+template <typename Array, typename T, std::size_t N, typename = void>
+struct is_materializable_into : std::false_type {};
+
+template <typename Array, typename T, std::size_t N>
+struct is_materializable_into<Array, T, N,
+			      std::enable_if_t<is_materializable<Array>::value>>
+  : std::is_same<std::decay_t<decltype(std::declval<const Array&>().materialize())>,
+		 StridedArray<T,N>>
+{};
+
 /**
  * Multi-dimensional arrays supporting non-contiguous shared data.
  */
@@ -123,10 +140,8 @@ public:
 			     && Array::ndim() == N
 			     && is_promotable<typename Array::dtype,T>::value>* = nullptr>
   StridedArray(const Array& a)
-    : StridedArray(a.dims())
-  {
-    this->operator=(a);
-  }
+    : StridedArray(a, is_materializable_into<Array,T,N>())
+  {}
 
   /*
   template <typename Array,
@@ -323,9 +338,7 @@ public:
       throw std::length_error(msg.str());
     }
 #endif
-    this->map([&a](auto& path, auto& val) {
-	val = a(path);
-      });
+    assign(a, is_materializable_into<Array,T,N>());
   }
 
   template <typename Array,
@@ -359,6 +372,17 @@ public:
     this->map([&value](const auto&, auto& val){ val = value; });
   }
 
+  /**
+   * Exchange the views of two arrays, without copying their elements.
+   */
+  void swap(StridedArray<T,N>& other) noexcept
+  {
+    std::swap(this->m_dims, other.m_dims);
+    std::swap(m_strides, other.m_strides);
+    m_shared_data.swap(other.m_shared_data);
+    std::swap(m_data, other.m_data);
+  }
+
   /**
    * Fill an entire array with a single value.
    */
@@ -399,6 +423,39 @@ public:
   }
   
 protected:
+  /// Construct from an array able to evaluate itself at once.
+  template <typename Array>
+  StridedArray(const Array& a, std::true_type)
+    : StridedArray(a.materialize())
+  {}
+
+  /// Construct from an array evaluated element by element.
+  template <typename Array>
+  StridedArray(const Array& a, std::false_type)
+    : StridedArray(a.dims())
+  {
+    assign(a, std::false_type());
+  }
+
+  /// Copy the elements of an array able to evaluate itself at once.
+  template <typename Array>
+  void assign(const Array& a, std::true_type)
+  {
+    const StridedArray<T,N> m = a.materialize();
+    this->map([&m](auto& path, auto& val) {
+	val = m(path);
+      });
+  }
+
+  /// Copy the elements of an array one by one.
+  template <typename Array>
+  void assign(const Array& a, std::false_type)
+  {
+    this->map([&a](auto& path, auto& val) {
+	val = a(path);
+      });
+  }
+
   dims_type m_strides;
   std::shared_ptr<T> m_shared_data;
   T* m_data;
@@ -412,7 +469,8 @@ protected:
  * element type.
  */
 template <typename U, typename From, typename T=typename From::dtype,
-	  typename std::enable_if_t<std::is_convertible<T,U>::value>* = nullptr>
+	  typename std::enable_if_t<std::is_convertible<T,U>::value
+				    && ! is_materializable_into<From,U,From::ndim()>::value>* = nullptr>
 StridedArray<U, From::ndim()> strided_array(const From& a)
 {
   StridedArray<U, From::ndim()> res(a.dims());
@@ -422,6 +480,17 @@ StridedArray<U, From::ndim()> strided_array(const From& a)
   return res;
 }
 
+/**
+ * Convert an abstract array able to evaluate itself at once to an
+ * immediate one.
+ */
+template <typename U, typename From,
+	  typename std::enable_if_t<is_materializable_into<From,U,From::ndim()>::value>* = nullptr>
+StridedArray<U, From::ndim()> strided_array(const From& a)
+{
+  return a.materialize();
+}
+
 /**
  * Convert an abstract array to an immediate one with same element type.
  *
@@ -439,6 +508,22 @@ StridedArray<T, From::ndim()> strided(const From& a)
   return strided_array<T,From>(a);
 }
 
+/**
+ * Contiguous version of an array, sharing its data when possible.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> contiguous_array(const StridedArray<T,N>& a)
+{
+  return a.contiguous() ? a : a.copy();
+}
+
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto contiguous_array(const Array& a)
+{
+  return strided_array(a);
+}
+
 template <typename T>
 StridedArray<T,1> litarray(const std::initializer_list<T>& lst)
 {
@@ -0,0 +1,94 @@
+// necomi/core/boundaries.h – Extension of arrays beyond their bounds
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+namespace necomi
+{
+
+/**
+ * Values taken by an array outside of its bounds, as in filters
+ * and convolutions.
+ */
+enum class Boundary
+{
+  /// A constant value (k k k | a b c d | k k k).
+  CONSTANT,
+  /// The nearest element (a a a | a b c d | d d d).
+  CLAMP,
+  /// Mirrored elements, including the edge ones (c b a | a b c d | d c b).
+  REFLECT,
+  /// Periodic elements (b c d | a b c d | a b c).
+  WRAP,
+};
+
+/**
+ * Index of the element used at a possibly outside position of an
+ * array dimension of size n, or n if the constant value must be used.
+ */
+inline std::size_t boundary_index(std::ptrdiff_t i, std::size_t n, Boundary boundary)
+{
+  const auto sn = static_cast<std::ptrdiff_t>(n);
+  if (i >= 0 && i < sn)
+    return static_cast<std::size_t>(i);
+
+  switch (boundary) {
+  case Boundary::CLAMP:
+    return i < 0 ? 0 : n - 1;
+  case Boundary::REFLECT: {
+    auto m = i % (2*sn);
+    if (m < 0)
+      m += 2*sn;
+    return static_cast<std::size_t>(m < sn ? m : 2*sn - 1 - m);
+  }
+  case Boundary::WRAP: {
+    auto m = i % sn;
+    return static_cast<std::size_t>(m < 0 ? m + sn : m);
+  }
+  default:
+    return n;
+  }
+}
+
+/**
+ * Copy elements of a strided line, extended beyond its bounds.
+ *
+ * \param first  Position of the first copied element, possibly negative.
+ * \param count  Number of copied elements.
+ */
+template <typename T>
+void extend_line(const T* src, std::size_t stride, std::size_t len,
+		 std::ptrdiff_t first, std::size_t count, T* dst,
+		 Boundary boundary, T value = T(0))
+{
+  const auto slen = static_cast<std::ptrdiff_t>(len);
+  const auto last = first + static_cast<std::ptrdiff_t>(count);
+  std::ptrdiff_t i = first;
+  // Before, inside and after the line, without tests on the interior
+  for (; i < std::min<std::ptrdiff_t>(0, last); i++) {
+    auto idx = boundary_index(i, len, boundary);
+    *dst++ = idx < len ? src[idx*stride] : value;
+  }
+  const auto end = std::min(last, slen);
+  if (stride == 1)
+    for (; i < end; i++)
+      *dst++ = src[i];
+  else
+    for (; i < end; i++)
+      *dst++ = src[i*stride];
+  for (; i < last; i++) {
+    auto idx = boundary_index(i, len, boundary);
+    *dst++ = idx < len ? src[idx*stride] : value;
+  }
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -0,0 +1,127 @@
+// necomi/core/parallel.h – Multi-threaded loops
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+/**
+ * \file parallel.h Split loops across several threads
+ *
+ * Parallel algorithms use std::thread. Defining NECOMI_NO_THREADS
+ * makes all of them run on the calling thread.
+ */
+
+namespace necomi
+{
+
+/// Storage for the number of threads, 0 meaning the hardware default.
+inline std::atomic<std::size_t>& num_threads_setting()
+{
+  static std::atomic<std::size_t> n{0};
+  return n;
+}
+
+/**
+ * Number of threads used by parallel algorithms.
+ * Defaults to the number of hardware threads.
+ */
+inline std::size_t num_threads()
+{
+#ifdef NECOMI_NO_THREADS
+  return 1;
+#else
+  std::size_t n = num_threads_setting();
+  if (n == 0)
+    n = std::thread::hardware_concurrency();
+  return std::max<std::size_t>(n, 1);
+#endif
+}
+
+/**
+ * Set the number of threads used by parallel algorithms.
+ * A value of 0 restores the hardware default. The setting may be
+ * changed from any thread, including while parallel loops run.
+ */
+inline void set_num_threads(std::size_t n)
+{
+  num_threads_setting() = n;
+}
+
+/**
+ * Number of blocks a parallel loop over \c n iterations is split
+ * into, each block containing at least \c grain iterations.
+ */
+inline std::size_t parallel_blocks(std::size_t n, std::size_t grain = 1)
+{
+  grain = std::max<std::size_t>(grain, 1);
+  return std::max<std::size_t>(std::min(num_threads(), n / grain), 1);
+}
+
+/**
+ * Split the iterations [0,n) in contiguous blocks run concurrently.
+ *
+ * \c f is called once per block with the block index and the
+ * iteration range [begin,end) of the block. The split only depends
+ * on \c n, \c grain and num_threads(), which may change between two
+ * loops: algorithms reusing a split record it from \c f rather than
+ * calling parallel_blocks() again. The first exception thrown
+ * by a block, if any, is rethrown once all blocks are finished.
+ * \see parallel_blocks for the number of blocks.
+ */
+template <typename Function>
+void parallel_for_blocks(std::size_t n, Function f, std::size_t grain = 1)
+{
+  const auto nblocks = parallel_blocks(n, grain);
+  if (nblocks == 1) {
+    f(0UL, 0UL, n);
+    return;
+  }
+
+  std::vector<std::exception_ptr> errors(nblocks);
+  auto run = [&f,&errors,n,nblocks](std::size_t b) {
+    try {
+      f(b, b * n / nblocks, (b + 1) * n / nblocks);
+    }
+    catch (...) {
+      errors[b] = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(nblocks - 1);
+  for (std::size_t b = 1; b < nblocks; b++)
+    threads.emplace_back(run, b);
+  run(0);
+  for (auto& t : threads)
+    t.join();
+
+  for (auto& e : errors)
+    if (e)
+      std::rethrow_exception(e);
+}
+
+/**
+ * Split the iterations [0,n) in contiguous blocks run concurrently.
+ * \c f is called with the iteration range [begin,end) of each block.
+ */
+template <typename Function>
+void parallel_for(std::size_t n, Function f, std::size_t grain = 1)
+{
+  parallel_for_blocks(n, [&f](std::size_t, std::size_t begin, std::size_t end) {
+      f(begin, end);
+    }, grain);
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -6,8 +6,14 @@
 #pragma once
 
 // Filters
+#include "filters/box.h"
 #include "filters/deriche.h"
+#include "filters/distance.h"
 #include "filters/exponential.h"
+#include "filters/median.h"
+#include "filters/morphology.h"
+#include "filters/sos.h"
+#include "filters/stencil.h"
 
 // Local Variables:
 // mode: c++
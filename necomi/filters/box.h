@@ -0,0 +1,360 @@
+// necomi/filters/box.h – Box filters using integral images
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+#include "../core/shape.h"
+#include "../numerics/scans.h"
+
+/**
+ * \file box.h Integral images and constant-time box filters
+ * \ingroup filters
+ */
+
+namespace necomi
+{
+
+/**
+ * Type accumulating the elements of type T in integral images: 64
+ * bits integers for integers, and at least double precision for
+ * floating point numbers.
+ *
+ * \ingroup filters
+ */
+template <typename T>
+using integral_accumulator_t =
+  std::conditional_t<std::is_integral<T>::value,
+		     std::conditional_t<std::is_signed<T>::value,
+					std::int64_t, std::uint64_t>,
+		     std::conditional_t<(sizeof(T) < sizeof(double)), double, T>>;
+
+/**
+ * Type of box means and variances of elements of type T.
+ */
+template <typename T>
+using box_mean_t = std::conditional_t<std::is_floating_point<T>::value, T, double>;
+
+/**
+ * Integral image of the values of a function of the array elements.
+ * \see integral_image
+ */
+template <typename Acc, typename Array, typename Function>
+StridedArray<Acc,Array::ndim()> integral_image_map(const Array& a, Function f)
+{
+  constexpr auto N = Array::ndim();
+  static_assert(N > 0, "integral images require at least one dimension");
+
+  auto dims = a.dims();
+  for (auto& d : dims)
+    d++;
+  StridedArray<Acc,N> table(dims);
+  table.fill(0);
+
+  std::array<std::size_t,N> start, steps;
+  start.fill(1);
+  steps.fill(1);
+  auto interior = table.slice(Slice<std::size_t,N>(start, a.dims(), steps));
+  interior.map([&a,&f](const auto& coords, auto& val) {
+      val = f(static_cast<Acc>(a(coords)));
+    });
+
+  for (std::size_t d = 0; d < N; d++)
+    scan_inplace(table, d, static_cast<Acc>(0), std::plus<Acc>(),
+		 ScanType::INCLUSIVE);
+  return table;
+}
+
+/**
+ * Integral image, or summed-area table, of an array.
+ *
+ * The table has one more element than the array along each
+ * dimension, the element at coordinates (i,j,…) being the sum of the
+ * array elements at coordinates lower than (i,j,…), so that its
+ * first elements along each dimension are null. The cumulative sums
+ * are computed with parallel scans, successively along each
+ * dimension.
+ *
+ * \ingroup filters
+ */
+template <typename Array,
+	  typename Acc=integral_accumulator_t<typename Array::dtype>,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<Acc,Array::ndim()> integral_image(const Array& a)
+{
+  return integral_image_map<Acc>(a, [](Acc x) { return x; });
+}
+
+/**
+ * Sum of the array elements in boxes, computed from its integral
+ * image for each element of \c res, whose dimensions are those of
+ * the array.
+ *
+ * The box around each element extends \c radius[d] elements on both
+ * sides along each dimension d, and is clipped to the array bounds.
+ * Each sum costs 2^N reads of the table, whatever the box size. If
+ * \c mean is set, the sums are divided by the clipped box sizes.
+ */
+template <typename Acc, typename U, std::size_t N>
+void integral_box(const StridedArray<Acc,N>& table,
+		  const std::array<std::size_t,N>& radius,
+		  StridedArray<U,N>& res, bool mean)
+{
+  static_assert(N > 0, "box filters require at least one dimension");
+  const auto& dims = res.dims();
+#ifndef NECOMI_NO_BOUND_CHECKS
+  for (std::size_t d = 0; d < N; d++)
+    if (table.dim(d) != dims[d] + 1)
+      throw std::length_error("integral image dimensions incompatible with the result");
+#endif
+  const auto len = dims[N-1];
+  const auto lines = size(res) / std::max<std::size_t>(len, 1);
+  if (len == 0 || lines == 0)
+    return;
+
+  const auto& tstrides = table.strides();
+  const auto& rstrides = res.strides();
+  const Acc* tdata = table.data();
+  U* rdata = res.data();
+  constexpr std::size_t ncorners = 1UL << (N-1);
+  const auto r = radius[N-1];
+  typedef std::conditional_t<std::is_floating_point<Acc>::value, Acc, double> Q;
+
+  parallel_for(lines, [&](std::size_t begin, std::size_t end) {
+      std::array<std::ptrdiff_t,ncorners> offsets;
+      std::array<bool,ncorners> positive;
+      for (auto l = begin; l < end; l++) {
+	// Corners of the box along the outer dimensions
+	std::size_t count = 1;
+	std::ptrdiff_t roff = 0;
+	std::array<std::size_t,N> lo, hi;
+	auto rem = l;
+	for (std::size_t d = N-1; d-- > 0; ) {
+	  const auto c = rem % dims[d];
+	  rem /= dims[d];
+	  lo[d] = c > radius[d] ? c - radius[d] : 0;
+	  hi[d] = std::min(c + radius[d] + 1, dims[d]);
+	  count *= hi[d] - lo[d];
+	  roff += c * rstrides[d];
+	}
+	for (std::size_t k = 0; k < ncorners; k++) {
+	  std::ptrdiff_t off = 0;
+	  bool pos = true;
+	  for (std::size_t d = 0; d < N-1; d++) {
+	    const bool upper = (k >> d) & 1;
+	    off += (upper ? hi[d] : lo[d]) * tstrides[d];
+	    pos = pos == upper;
+	  }
+	  offsets[k] = off;
+	  positive[k] = pos;
+	}
+
+	// Sweep along the innermost dimension
+	U* out = rdata + roff;
+	for (std::size_t j = 0; j < len; j++) {
+	  const auto jlo = j > r ? j - r : 0;
+	  const auto jhi = std::min(j + r + 1, len);
+	  Acc sum = 0;
+	  for (std::size_t k = 0; k < ncorners; k++) {
+	    const Acc* base = tdata + offsets[k];
+	    const Acc v = base[jhi*tstrides[N-1]] - base[jlo*tstrides[N-1]];
+	    sum = positive[k] ? sum + v : sum - v;
+	  }
+	  out[j*rstrides[N-1]] = mean
+	    ? static_cast<U>(static_cast<Q>(sum) / static_cast<Q>(count * (jhi - jlo)))
+	    : static_cast<U>(sum);
+	}
+      }
+    }, std::max<std::size_t>(4096 / len, 1));
+}
+
+/**
+ * Integral images of an array and of its squares, from which box
+ * sums, means and variances are computed at several scales.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+class IntegralImage
+{
+public:
+  /// Type of the sums.
+  typedef integral_accumulator_t<T> sum_type;
+  /// Type of the means and variances.
+  typedef box_mean_t<T> mean_type;
+  /// Type of the sums of squares.
+  typedef integral_accumulator_t<mean_type> square_type;
+
+  /**
+   * Build the integral image of an array, and of its squares if
+   * variances are to be computed.
+   */
+  template <typename Array,
+	    std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+  IntegralImage(const Array& a, bool squares = false)
+    : m_dims(a.dims())
+    , m_has_squares(squares)
+    , m_table(integral_image<Array,sum_type>(a))
+    , m_squares(squares
+		? integral_image_map<square_type>(a, [](square_type x) { return x*x; })
+		: StridedArray<square_type,N>(zero_dims()))
+  {
+    static_assert(Array::ndim() == N, "invalid array dimensionality");
+  }
+
+  /// Dimensions of the original array.
+  const std::array<std::size_t,N>& dims() const
+  { return m_dims; }
+
+  /// Integral image of the array.
+  const StridedArray<sum_type,N>& table() const
+  { return m_table; }
+
+  /// Sums of the elements in boxes of the given radius.
+  StridedArray<sum_type,N> sum(const std::array<std::size_t,N>& radius) const
+  {
+    StridedArray<sum_type,N> res(m_dims);
+    integral_box(m_table, radius, res, false);
+    return res;
+  }
+
+  /// Means of the elements in boxes of the given radius.
+  StridedArray<mean_type,N> mean(const std::array<std::size_t,N>& radius) const
+  {
+    StridedArray<mean_type,N> res(m_dims);
+    integral_box(m_table, radius, res, true);
+    return res;
+  }
+
+  /**
+   * Variances of the elements in boxes of the given radius.
+   * Requires the integral image of the squares.
+   */
+  StridedArray<mean_type,N> variance(const std::array<std::size_t,N>& radius) const
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (! m_has_squares)
+      throw std::logic_error("box variances require the integral image of the squares");
+#endif
+    // Means and means of squares with the precision of the squares
+    StridedArray<square_type,N> means(m_dims), squares(m_dims);
+    integral_box(m_table, radius, means, true);
+    integral_box(m_squares, radius, squares, true);
+    StridedArray<mean_type,N> res(m_dims);
+    res.map([&means,&squares](const auto& coords, auto& val) {
+	const auto m = means(coords);
+	val = static_cast<mean_type>(std::max<square_type>(squares(coords) - m*m, 0));
+      });
+    return res;
+  }
+
+private:
+  static std::array<std::size_t,N> zero_dims()
+  {
+    std::array<std::size_t,N> dims;
+    dims.fill(0);
+    return dims;
+  }
+
+  std::array<std::size_t,N> m_dims;
+  bool m_has_squares;
+  StridedArray<sum_type,N> m_table;
+  StridedArray<square_type,N> m_squares;
+};
+
+/**
+ * Create an integral image of an array.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+IntegralImage<typename Array::dtype,Array::ndim()>
+make_integral_image(const Array& a, bool squares = false)
+{
+  return IntegralImage<typename Array::dtype,Array::ndim()>(a, squares);
+}
+
+/**
+ * Radius repeated along all the dimensions.
+ */
+template <std::size_t N>
+std::array<std::size_t,N> box_radius(std::size_t r)
+{
+  std::array<std::size_t,N> radius;
+  radius.fill(r);
+  return radius;
+}
+
+/**
+ * Sums of the array elements in boxes extending \c radius elements on
+ * both sides of each element, clipped to the array bounds, computed
+ * in constant time per element from an integral image.
+ *
+ * \ingroup filters
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto box_sum(const Array& a, const std::array<std::size_t,Array::ndim()>& radius)
+{
+  return make_integral_image(a).sum(radius);
+}
+
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto box_sum(const Array& a, std::size_t radius)
+{
+  return box_sum(a, box_radius<Array::ndim()>(radius));
+}
+
+/**
+ * Means of the array elements in boxes clipped to the array bounds.
+ * \see box_sum
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto box_mean(const Array& a, const std::array<std::size_t,Array::ndim()>& radius)
+{
+  return make_integral_image(a).mean(radius);
+}
+
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto box_mean(const Array& a, std::size_t radius)
+{
+  return box_mean(a, box_radius<Array::ndim()>(radius));
+}
+
+/**
+ * Variances of the array elements in boxes clipped to the array
+ * bounds. \see box_sum
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto box_variance(const Array& a, const std::array<std::size_t,Array::ndim()>& radius)
+{
+  return make_integral_image(a, true).variance(radius);
+}
+
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto box_variance(const Array& a, std::size_t radius)
+{
+  return box_variance(a, box_radius<Array::ndim()>(radius));
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -6,11 +6,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cmath>
-#include <iostream>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 #include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+#include "../core/strides.h"
 
 /**
  * \file deriche.h Canny-Deriche recursive filtering
@@ -25,154 +30,290 @@ namespace necomi
  *
  * \ingroup filters
  */
-  enum class DericheOrder
-  {
-    BLUR,
-    FIRST_DERIVATIVE,
-    SECOND_DERIVATIVE,
-  };
-  
-template <typename T, std::size_t N, std::size_t K>
-std::enable_if_t<K<N && 0<N && std::is_floating_point<T>::value,void>
-inner_loop(std::array<std::size_t,N>& path,
-           std::size_t dim,
-           bool cond,
-           StridedArray<T,N>& a, T* y,
-           T a0, T a1, T a2, T a3,
-           T b1, T b2)
+enum class DericheOrder
 {
-  auto& dims = a.dims();
+  BLUR,
+  FIRST_DERIVATIVE,
+  SECOND_DERIVATIVE,
+};
 
-  if (K == dim) {
-    path[K] = 0;
-    inner_loop<T,N,K+1>(path, dim, cond,
-                        a, y, a0, a1, a2, a3, b1, b2);
-  }
-  else {
-    for (std::size_t i = 0; i < dims[K]; i++) {
-      path[K] = i;
-      inner_loop<T,N,K+1>(path, dim, cond,
-                          a, y, a0, a1, a2, a3, b1, b2);
-    }
-  }
-}
-
-template <typename T, std::size_t N, std::size_t K>
-std::enable_if_t<K==N && 0<N && std::is_floating_point<T>::value,void>
-inner_loop(std::array<std::size_t,N>& path,
-           std::size_t dim,
-           bool cond,
-           StridedArray<T,N>& a, T* y,
-           T a0, T a1, T a2, T a3,
-           T b1, T b2)
+/**
+ * Coefficients of the causal and anti-causal recursions of a
+ * Canny-Deriche filter.
+ */
+template <typename T>
+struct DericheCoefficients
 {
-  auto& dims = a.dims();
-  auto ddim = dims[dim];
-  auto stride = a.strides()[dim];
-  
-  // Compute the index corresponding to the path
-  T* ima = &a(path);
-
-  // First pass
-  double xp = 0, yp = 0, yb = 0;
-  if (cond) {
-    xp = *ima;
-    double coefp = (a0+a1)/(1+b1+b2);
-    yb = yp = coefp * xp;
-  }
-  for (std::size_t i = 0; i < ddim; i++) {
-    T xc = *ima;
-    ima += stride;
-    T yc = *(y++) = a0*xc + a1*xp - b1*yp - b2*yb;
-    xp = xc; yb = yp; yp = yc;
-  }
-
-  // Second pass
-  T xn = 0, xa = 0, yn = 0, ya = 0;
-  if (cond) {
-    xn = xa = *(ima-stride);
-    T coefn = (a2+a3)/(1+b1+b2);
-    yn = ya = coefn * xn;
-  }
-  for (int i = ddim-1; i >= 0; i--) {
-    T xc = *(ima-=stride);
-    T yc = a2*xn + a3*xa - b1*yn - b2*ya;
-    xa = xn; xn = xc; ya = yn; yn = yc;
-    *ima = *(--y)+yc;
-  }
-}
-
-  /**
-   * Filter an array using Canny-Deriche along a single dimension.
-   * This function is recursive, hence always takes a linear time depending
-   * on the size of the dimensions to be filtered, irrespective of the
-   * given parameter `sigma`.
-   *
-   * \param a     Array to be filtered in-place. Its type `T` must be a
-   *              floating point number and its dimensionality `>0`.
-   * \param dim	Dimension along which to filter, must be less than `N`.
-   * \param sigma	Deviation of the approximated Gaussian.
-   * \param cond  Whether borders values are taken into account or ignored.
-   * \ingroup filters
-   */
-  template <typename T, std::size_t N,
-	    typename std::enable_if_t< 0<N
-                && std::is_floating_point<T>::value>* = nullptr>
-  StridedArray<T,N>&
-  deriche(StridedArray<T,N>& a, std::size_t dim, T sigma,
-	  DericheOrder order=DericheOrder::BLUR,
-	  bool cond=true)
-  {
-  // σ=0 is a nop
-  if (sigma == 0)
-    return a;
-  // σ must be >0
-  sigma = std::abs(sigma);
+  T a0, a1, a2, a3;
+  T b1, b2;
+};
 
-  T alpha = 1.695 / sigma;
-  T ena = std::exp(-alpha);
-  T ens = ena * ena;
-  T b1 = -2 * ena;
-  T b2 = ens;
-  
-  const auto& dims = a.dims();
+/**
+ * Compute the coefficients of a Canny-Deriche filter.
+ * \param sigma  Deviation of the approximated Gaussian, must be >0.
+ */
+template <typename T>
+DericheCoefficients<T> deriche_coefficients(T sigma, DericheOrder order)
+{
+  const T alpha = 1.695 / sigma;
+  const T ena = std::exp(-alpha);
+  const T ens = ena * ena;
 
-  T a0, a1, a2, a3;
+  DericheCoefficients<T> c;
+  c.b1 = -2 * ena;
+  c.b2 = ens;
 
-  T k;
   switch (order) {
-  case DericheOrder::BLUR:
-    k = (1-ena) * (1-ena) / (1 + 2*alpha*ena - ens);
-    a0 =  k;
-    a1 =  k * ena * (alpha - 1);
-    a2 =  k * ena * (alpha + 1);
-    a3 = -k * ens;
+  case DericheOrder::BLUR: {
+    const T k = (1-ena) * (1-ena) / (1 + 2*alpha*ena - ens);
+    c.a0 =  k;
+    c.a1 =  k * ena * (alpha - 1);
+    c.a2 =  k * ena * (alpha + 1);
+    c.a3 = -k * ens;
+    }
     break;
-  case DericheOrder::FIRST_DERIVATIVE:
-    k = -(1-ena) * (1-ena) * (1-ena) / (2*(ena+1)*ena);
-    a0 = a3 = 0;
-    a1 = k*ena;
-    a2 = -a1;
+  case DericheOrder::FIRST_DERIVATIVE: {
+    const T k = -(1-ena) * (1-ena) * (1-ena) / (2*(ena+1)*ena);
+    c.a0 = c.a3 = 0;
+    c.a1 = k*ena;
+    c.a2 = -c.a1;
+    }
     break;
   case DericheOrder::SECOND_DERIVATIVE: {
     const T ea = std::exp(-alpha);
     const T k = -(ens-1)/(2*alpha*ena);
     const T kn = -2*(-1 + 3*ea - 3*ea*ea + ea*ea*ea)
-        / (3*ea + 1 + 3*ea*ea + ea*ea*ea);
-
-    a0 = kn;
-    a1 = -kn*(1+k*alpha)*ena;
-    a2 = kn*(1-k*alpha)*ena;
-    a3 = -kn*ens;
+      / (3*ea + 1 + 3*ea*ea + ea*ea*ea);
+    c.a0 = kn;
+    c.a1 = -kn*(1+k*alpha)*ena;
+    c.a2 = kn*(1-k*alpha)*ena;
+    c.a3 = -kn*ens;
     }
     break;
   }
+  return c;
+}
+
+/// Maximal number of adjacent lines filtered together.
+constexpr std::size_t deriche_lanes = 16;
+
+/// State of the causal recursions, kept at least in double precision.
+template <typename T>
+using deriche_accumulator_t = std::conditional_t<(sizeof(T) < sizeof(double)), double, T>;
+
+/// Maximal number of filters computed in a single pass.
+constexpr std::size_t deriche_branches = 8;
+
+/**
+ * Filter adjacent lines with several Canny-Deriche filters at once.
+ *
+ * The recursions of all the lines are run together, one lane per
+ * line, so that the innermost loops are vectorizable and access
+ * contiguous memory when the lines are adjacent. Each filter, or
+ * branch, reads one of the sources and writes its own destination,
+ * which may be its source for in-place filtering when no other branch
+ * reads it.
+ *
+ * \param src        First elements of the lines in each source.
+ * \param dst        First elements of the lines in each destination.
+ * \param sources    Source of each branch.
+ * \param coefs      Coefficients of each branch.
+ * \param len        Number of elements in each line.
+ * \param lanes      Number of lines, at most deriche_lanes.
+ * \param cond       Whether borders values are taken into account.
+ * \param y          Scratch space for branches*len*lanes elements.
+ * \param final      Called with the offset of each destination
+ *                   element, once all the branches computed it.
+ *
+ * The state of the causal recursions is kept in double precision for
+ * single precision lines.
+ */
+template <typename T, typename Final>
+void deriche_bank_lines(const T* const* src, std::size_t src_stride, std::size_t src_ls,
+			T* const* dst, std::size_t dst_stride, std::size_t dst_ls,
+			const std::size_t* sources, const DericheCoefficients<T>* coefs,
+			std::size_t branches, std::size_t len, std::size_t lanes,
+			bool cond, T* y, Final& final)
+{
+  typedef deriche_accumulator_t<T> A;
+  T s1[deriche_branches][deriche_lanes], s2[deriche_branches][deriche_lanes];
+  T s3[deriche_branches][deriche_lanes], s4[deriche_branches][deriche_lanes];
+
+  // Causal passes
+  A xp[deriche_lanes], yp[deriche_lanes], yq[deriche_lanes];
+  for (std::size_t b = 0; b < branches; b++) {
+    const auto& c = coefs[b];
+    const T* x = src[sources[b]];
+    T* yb = y + b*len*lanes;
+    const A coefp = (c.a0+c.a1)/(1+c.b1+c.b2);
+    for (std::size_t l = 0; l < lanes; l++) {
+      xp[l] = cond ? x[l*src_ls] : 0;
+      yp[l] = yq[l] = coefp * xp[l];
+    }
+    for (std::size_t i = 0; i < len; i++) {
+      const T* xi = x + i*src_stride;
+      T* yi = yb + i*lanes;
+      for (std::size_t l = 0; l < lanes; l++) {
+	const T xc = xi[l*src_ls];
+	const T yc = c.a0*xc + c.a1*xp[l] - c.b1*yp[l] - c.b2*yq[l];
+	yi[l] = yc;
+	xp[l] = xc; yq[l] = yp[l]; yp[l] = yc;
+      }
+    }
+  }
+
+  // Anti-causal passes of all the branches together, summed with the
+  // causal ones
+  for (std::size_t b = 0; b < branches; b++) {
+    const auto& c = coefs[b];
+    const T* x = src[sources[b]] + (len-1)*src_stride;
+    const T coefn = (c.a2+c.a3)/(1+c.b1+c.b2);
+    for (std::size_t l = 0; l < lanes; l++) {
+      s1[b][l] = s2[b][l] = cond ? x[l*src_ls] : 0;
+      s3[b][l] = s4[b][l] = coefn * s1[b][l];
+    }
+  }
+  for (std::size_t i = len; i-- > 0; ) {
+    for (std::size_t b = 0; b < branches; b++) {
+      const auto& c = coefs[b];
+      const T* xi = src[sources[b]] + i*src_stride;
+      T* di = dst[b] + i*dst_stride;
+      const T* yi = y + b*len*lanes + i*lanes;
+      T* xn = s1[b];
+      T* xa = s2[b];
+      T* yn = s3[b];
+      T* ya = s4[b];
+      for (std::size_t l = 0; l < lanes; l++) {
+	const T xc = xi[l*src_ls];
+	const T yc = c.a2*xn[l] + c.a3*xa[l] - c.b1*yn[l] - c.b2*ya[l];
+	xa[l] = xn[l]; xn[l] = xc; ya[l] = yn[l]; yn[l] = yc;
+	di[l*dst_ls] = yi[l] + yc;
+      }
+    }
+    for (std::size_t l = 0; l < lanes; l++)
+      final(i*dst_stride + l*dst_ls);
+  }
+}
+
+/**
+ * Filter arrays along a dimension with several Canny-Deriche filters.
+ *
+ * Lines are distributed among threads. When filtering along a
+ * dimension that is not the innermost one, adjacent lines are
+ * filtered together to keep memory accesses contiguous.
+ *
+ * \param dims     Dimensions of all the sources and destinations.
+ * \param src      Data of the sources, sharing the same strides.
+ * \param dst      Data of the destinations, one per branch, sharing
+ *                 the same strides.
+ * \param final    Called with the offset of each destination
+ *                 element, relative to the destination data, once
+ *                 all the branches computed it.
+ * \see deriche_bank_lines
+ */
+template <typename T, std::size_t N, typename Final>
+void deriche_bank(const std::array<std::size_t,N>& dims, std::size_t dim,
+		  const std::vector<const T*>& src, const std::array<std::size_t,N>& src_strides,
+		  const std::vector<T*>& dst, const std::array<std::size_t,N>& dst_strides,
+		  const std::vector<std::size_t>& sources,
+		  const std::vector<DericheCoefficients<T>>& coefs,
+		  bool cond, Final final)
+{
+  const auto branches = dst.size();
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dim >= N)
+    throw std::out_of_range("invalid dimension for the Deriche filter");
+  if (branches > deriche_branches)
+    throw std::length_error("too many Deriche filters in a single pass");
+#endif
+  const auto len = dims[dim];
+  for (auto d : dims)
+    if (d == 0)
+      return;
+
+  // Lanes along the other dimension with the smallest stride, if it is
+  // smaller than the one of the filtered dimension
+  std::size_t lane_dim = N;
+  for (std::size_t d = 0; d < N; d++)
+    if (d != dim && dims[d] > 1 && src_strides[d] < src_strides[dim]
+	&& (lane_dim == N || src_strides[d] < src_strides[lane_dim]))
+      lane_dim = d;
+  const auto lanes = lane_dim == N ? 1 : std::min(deriche_lanes, dims[lane_dim]);
+  const auto chunks = lane_dim == N ? 1 : (dims[lane_dim] + lanes - 1) / lanes;
+  const auto src_ls = lane_dim == N ? 0 : src_strides[lane_dim];
+  const auto dst_ls = lane_dim == N ? 0 : dst_strides[lane_dim];
 
-  std::array<std::size_t,N> path;
-  T y[dims[dim]];
+  // Groups of lanes, indexed by their position along the other dimensions
+  auto gdims = dims;
+  gdims[dim] = 1;
+  if (lane_dim != N)
+    gdims[lane_dim] = 1;
+  const auto gstrides = default_strides(gdims);
+  const auto outer = gstrides[0] * gdims[0];
 
-  inner_loop<T,N,0>(path, dim, cond, a, y, a0, a1, a2, a3, b1, b2);
+  parallel_for(outer * chunks, [&](std::size_t begin, std::size_t end) {
+      std::vector<T> y(branches * len * lanes);
+      std::vector<const T*> gsrc(src.size());
+      std::vector<T*> gdst(branches);
+      for (std::size_t g = begin; g < end; g++) {
+	const auto coords = strided_index_to_coords(g / chunks, gstrides);
+	std::size_t soff = 0, doff = 0;
+	for (std::size_t d = 0; d < N; d++) {
+	  soff += coords[d] * src_strides[d];
+	  doff += coords[d] * dst_strides[d];
+	}
+	std::size_t n = 1;
+	if (lane_dim != N) {
+	  const auto first = (g % chunks) * lanes;
+	  soff += first * src_ls;
+	  doff += first * dst_ls;
+	  n = std::min(lanes, dims[lane_dim] - first);
+	}
+	for (std::size_t s = 0; s < src.size(); s++)
+	  gsrc[s] = src[s] + soff;
+	for (std::size_t b = 0; b < branches; b++)
+	  gdst[b] = dst[b] + doff;
+	auto gfinal = [&final,doff](std::size_t off) { final(doff + off); };
+	deriche_bank_lines(gsrc.data(), src_strides[dim], src_ls,
+			   gdst.data(), dst_strides[dim], dst_ls,
+			   sources.data(), coefs.data(), branches, len, n,
+			   cond, y.data(), gfinal);
+      }
+    }, std::max<std::size_t>(1, 32768 / (branches * len * lanes)));
+}
+
+/**
+ * Filter an array using Canny-Deriche along a single dimension.
+ * This function is recursive, hence always takes a linear time depending
+ * on the size of the dimensions to be filtered, irrespective of the
+ * given parameter `sigma`.
+ *
+ * Lines are distributed among threads, adjacent ones being filtered
+ * together along dimensions other than the innermost one.
+ *
+ * \param a     Array to be filtered in-place. Its type `T` must be a
+ *              floating point number and its dimensionality `>0`.
+ * \param dim	Dimension along which to filter, must be less than `N`.
+ * \param sigma	Deviation of the approximated Gaussian.
+ * \param cond  Whether borders values are taken into account or ignored.
+ * \ingroup filters
+ */
+template <typename T, std::size_t N,
+	  typename std::enable_if_t< 0<N
+	    && std::is_floating_point<T>::value>* = nullptr>
+StridedArray<T,N>&
+deriche(StridedArray<T,N>& a, std::size_t dim, T sigma,
+	DericheOrder order=DericheOrder::BLUR,
+	bool cond=true)
+{
+  // σ=0 is a nop
+  if (sigma == 0)
+    return a;
+  // σ must be >0
+  const auto coefs = deriche_coefficients(std::abs(sigma), order);
 
+  deriche_bank<T,N>(a.dims(), dim, {a.data()}, a.strides(), {a.data()}, a.strides(),
+		    {0}, {coefs}, cond, [](std::size_t) {});
   return a;
 }
 
@@ -187,30 +328,124 @@ deriche(StridedArray<T,N>&& a, std::size_t dim, T sigma,
   deriche(a, dim, sigma, order, cond);
   return std::move(a);
 }
- 
-  
-  /**
-   * Filter an array using Canny-Deriche along all its dimensions.
-   * \ingroup filters
-   */
-  template <typename T, std::size_t N,
-	    std::enable_if_t<0<N && std::is_floating_point<T>::value>* = nullptr>
-	    StridedArray<T,N>& deriche(StridedArray<T,N>& a, double sigma, DericheOrder order=DericheOrder::BLUR)
-  {
-    for (std::size_t i = 0; i < N; i++)
-      deriche<T,N>(a, i, sigma,order);
-    return a;
+
+/**
+ * Filter an array using Canny-Deriche along all its dimensions.
+ * \ingroup filters
+ */
+template <typename T, std::size_t N,
+	  std::enable_if_t<0<N && std::is_floating_point<T>::value>* = nullptr>
+StridedArray<T,N>& deriche(StridedArray<T,N>& a, double sigma, DericheOrder order=DericheOrder::BLUR)
+{
+  for (std::size_t i = 0; i < N; i++)
+    deriche<T,N>(a, i, sigma,order);
+  return a;
+}
+
+template <typename A,
+	  std::enable_if_t<0<A::ndim() && std::is_floating_point<typename A::dtype>::value>* = nullptr>
+StridedArray<typename A::dtype,A::ndim()> deriche(const A& a, double sigma,
+						  DericheOrder order=DericheOrder::BLUR)
+{
+  auto x = strided_array(a);
+  return deriche(x, sigma, order);
+}
+
+/**
+ * Smoothed image and derivatives computed by deriche_gradient().
+ * Arrays that were not requested are empty.
+ *
+ * \ingroup filters
+ */
+template <typename T>
+struct DericheGradient
+{
+  StridedArray<T,2> smoothed;
+  /// First derivatives along the second and first dimensions.
+  StridedArray<T,2> gx, gy;
+  /// Second derivatives.
+  StridedArray<T,2> gxx, gyy, gxy;
+  /// Gradient magnitude, and orientation in radians.
+  StridedArray<T,2> magnitude, orientation;
+};
+
+/**
+ * Compute the derivatives of a smoothed image with Canny-Deriche
+ * filters in two passes.
+ *
+ * The first pass filters the rows once, sharing their reading among
+ * the smoothing and derivative recursions. The second pass filters
+ * the columns of these results, and optionally computes the gradient
+ * magnitude and orientation as soon as both derivatives are known.
+ *
+ * \param sigma    Deviation of the approximated Gaussian, must be >0.
+ * \param hessian  Whether to compute the second derivatives.
+ * \param polar    Whether to compute the gradient magnitude and orientation.
+ * \param cond     Whether borders values are taken into account.
+ * \ingroup filters
+ */
+template <typename T,
+	  std::enable_if_t<std::is_floating_point<T>::value>* = nullptr>
+DericheGradient<T> deriche_gradient(const StridedArray<T,2>& image, T sigma,
+				    bool hessian = false, bool polar = false,
+				    bool cond = true)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (! (sigma > 0))
+    throw std::out_of_range("Deriche gradients require a positive deviation");
+#endif
+  const auto& dims = image.dims();
+  const std::array<std::size_t,2> none{{0, 0}};
+  DericheGradient<T> res{StridedArray<T,2>(dims),
+      StridedArray<T,2>(dims), StridedArray<T,2>(dims),
+      StridedArray<T,2>(hessian ? dims : none),
+      StridedArray<T,2>(hessian ? dims : none),
+      StridedArray<T,2>(hessian ? dims : none),
+      StridedArray<T,2>(polar ? dims : none),
+      StridedArray<T,2>(polar ? dims : none)};
+
+  const auto blur = deriche_coefficients(sigma, DericheOrder::BLUR);
+  const auto first = deriche_coefficients(sigma, DericheOrder::FIRST_DERIVATIVE);
+  const auto second = deriche_coefficients(sigma, DericheOrder::SECOND_DERIVATIVE);
+
+  // Rows: smoothed, first and second derivatives
+  StridedArray<T,2> bx(dims), dx(dims), d2x(hessian ? dims : none);
+  std::vector<T*> rows{bx.data(), dx.data()};
+  std::vector<DericheCoefficients<T>> row_coefs{blur, first};
+  if (hessian) {
+    rows.push_back(d2x.data());
+    row_coefs.push_back(second);
   }
-    
-    template <typename A,
-	      std::enable_if_t<0<A::ndim() && std::is_floating_point<typename A::dtype>::value>* = nullptr>
-      StridedArray<typename A::dtype,A::ndim()> deriche(const A& a, double sigma,
-							DericheOrder order=DericheOrder::BLUR)
-  {
-    auto x = strided_array(a);
-    return deriche(x, sigma, order);
+  deriche_bank<T,2>(dims, 1, {image.data()}, image.strides(),
+		    rows, bx.strides(), std::vector<std::size_t>(rows.size(), 0),
+		    row_coefs, cond, [](std::size_t) {});
+
+  // Columns of the row results
+  std::vector<const T*> cols_src{bx.data(), dx.data()};
+  std::vector<T*> cols{res.smoothed.data(), res.gy.data(), res.gx.data()};
+  std::vector<std::size_t> sources{0, 0, 1};
+  std::vector<DericheCoefficients<T>> col_coefs{blur, first, blur};
+  if (hessian) {
+    cols_src.push_back(d2x.data());
+    cols.insert(cols.end(), {res.gyy.data(), res.gxy.data(), res.gxx.data()});
+    sources.insert(sources.end(), {0, 1, 2});
+    col_coefs.insert(col_coefs.end(), {second, first, blur});
   }
+  const T* gx = res.gx.data();
+  const T* gy = res.gy.data();
+  T* mag = res.magnitude.data();
+  T* ori = res.orientation.data();
+  auto final = [polar,gx,gy,mag,ori](std::size_t off) {
+    if (polar) {
+      mag[off] = std::sqrt(gx[off]*gx[off] + gy[off]*gy[off]);
+      ori[off] = std::atan2(gy[off], gx[off]);
+    }
+  };
+  deriche_bank<T,2>(dims, 0, cols_src, bx.strides(), cols, res.smoothed.strides(),
+		    sources, col_coefs, cond, final);
 
+  return res;
+}
 
 } // namespace necomi
 
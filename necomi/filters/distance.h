@@ -0,0 +1,244 @@
+// necomi/filters/distance.h – Distance transforms
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+
+/**
+ * \file distance.h Euclidean distance transforms
+ * \ingroup filters
+ */
+
+namespace necomi
+{
+
+/// Number of adjacent lines processed together by distance transforms.
+constexpr std::size_t distance_lanes = 16;
+
+/**
+ * Lower envelope of the parabolas of a strided line of squared
+ * distances, after Felzenszwalb and Huttenlocher.
+ *
+ * The squared distance at each position q becomes the minimum over p
+ * of (spacing·(q-p))² + f[p], and \c arg[q] the minimizing position.
+ * Infinite values, for lines without features, are ignored.
+ *
+ * \param v  Scratch space of n positions.
+ * \param z  Scratch space of n+1 values.
+ * \return   Whether the line has any finite value.
+ */
+template <typename T>
+bool distance_envelope(const T* f, std::size_t stride, std::size_t n, T spacing,
+		       T* d, std::size_t* arg, std::size_t* v, T* z)
+{
+  const auto inf = std::numeric_limits<T>::infinity();
+  const auto s2 = spacing * spacing;
+
+  // Parabolas of the lower envelope and their intersections
+  std::ptrdiff_t k = -1;
+  for (std::size_t q = 0; q < n; q++) {
+    const T fq = f[q*stride];
+    if (fq == inf)
+      continue;
+    const T hq = fq / s2 + static_cast<T>(q)*q;
+    T s = -inf;
+    while (k >= 0) {
+      const auto p = v[k];
+      const T hp = f[p*stride] / s2 + static_cast<T>(p)*p;
+      s = (hq - hp) / (2 * static_cast<T>(q - p));
+      if (s > z[k])
+	break;
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = k == 0 ? -inf : s;
+    z[k+1] = inf;
+  }
+  if (k < 0)
+    return false;
+
+  std::size_t j = 0;
+  for (std::size_t q = 0; q < n; q++) {
+    while (z[j+1] < static_cast<T>(q))
+      j++;
+    const auto p = v[j];
+    const T dq = static_cast<T>(q) - static_cast<T>(p);
+    d[q] = s2 * dq * dq + f[p*stride];
+    arg[q] = p;
+  }
+  return true;
+}
+
+/**
+ * Replace in place the squared distances in a contiguous array by
+ * their lower envelope along each dimension, which gives the exact
+ * squared Euclidean distances to the features, and propagate the
+ * index of the nearest features if \c nearest is not null.
+ *
+ * Groups of adjacent lines are gathered together and processed
+ * concurrently.
+ */
+template <typename T, std::size_t N>
+void distance_transform_inplace(StridedArray<T,N>& f,
+				const std::array<T,N>& spacing,
+				StridedArray<std::size_t,N>* nearest)
+{
+  const auto& dims = f.dims();
+  for (std::size_t dim = 0; dim < N; dim++) {
+    std::size_t outer = 1, inner = 1;
+    for (std::size_t i = 0; i < dim; i++)
+      outer *= dims[i];
+    for (std::size_t i = dim + 1; i < N; i++)
+      inner *= dims[i];
+    const auto len = dims[dim];
+    if (outer * inner == 0 || len == 0)
+      return;
+
+    T* data = f.data();
+    std::size_t* idx = nearest ? nearest->data() : nullptr;
+    const auto nchunks = (inner + distance_lanes - 1) / distance_lanes;
+    const auto sp = spacing[dim];
+
+    parallel_for(outer * nchunks, [=](std::size_t begin, std::size_t end) {
+	const auto lanes = std::min(inner, distance_lanes);
+	std::vector<T> buf(len * lanes), d(len), z(len + 1);
+	std::vector<std::size_t> ibuf(idx ? len * lanes : 0), arg(len), v(len);
+	for (auto task = begin; task < end; task++) {
+	  const auto o = task / nchunks;
+	  const auto i0 = (task % nchunks) * distance_lanes;
+	  const auto m = std::min(distance_lanes, inner - i0);
+	  const auto base = o*len*inner + i0;
+
+	  for (std::size_t k = 0; k < len; k++) {
+	    std::copy_n(data + base + k*inner, m, buf.data() + k*m);
+	    if (idx)
+	      std::copy_n(idx + base + k*inner, m, ibuf.data() + k*m);
+	  }
+
+	  for (std::size_t l = 0; l < m; l++) {
+	    if (! distance_envelope(buf.data() + l, m, len, sp,
+				    d.data(), arg.data(), v.data(), z.data()))
+	      continue;
+	    for (std::size_t k = 0; k < len; k++) {
+	      data[base + k*inner + l] = d[k];
+	      if (idx)
+		idx[base + k*inner + l] = ibuf[arg[k]*m + l];
+	    }
+	  }
+	}
+      }, std::max<std::size_t>(4096 / (len * distance_lanes), 1));
+  }
+}
+
+/**
+ * Squared distances of an array elements to the nearest feature,
+ * features being the non-null elements, initialized for the
+ * separable lower envelopes, along with the flat index of each
+ * element if \c nearest is not null.
+ */
+template <typename T, typename Array>
+StridedArray<T,Array::ndim()> distance_transform_init(const Array& mask,
+						      StridedArray<std::size_t,Array::ndim()>* nearest)
+{
+  constexpr auto N = Array::ndim();
+  StridedArray<T,N> f(mask.dims());
+  const auto inf = std::numeric_limits<T>::infinity();
+  f.map([&mask,inf](const auto& coords, auto& val) {
+      val = mask(coords) ? T(0) : inf;
+    });
+  if (nearest) {
+    const auto strides = nearest->strides();
+    nearest->map([&strides](const auto& coords, auto& val) {
+	val = 0;
+	for (std::size_t d = 0; d < N; d++)
+	  val += coords[d] * strides[d];
+      });
+  }
+  return f;
+}
+
+/**
+ * Exact Euclidean distance of each array element to the nearest
+ * feature, features being the non-null elements of a boolean or label
+ * array, in linear time.
+ *
+ * The Felzenszwalb-Huttenlocher algorithm is applied successively
+ * along each dimension, with \c spacing the distance between adjacent
+ * elements along each dimension. Lines are processed concurrently.
+ * Elements are at an infinite distance when there is no feature.
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> distance_transform(const Array& mask,
+						 const std::array<T,Array::ndim()>& spacing)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"distance transforms require floating point distances");
+  auto f = distance_transform_init<T>(mask, nullptr);
+  distance_transform_inplace<T,Array::ndim()>(f, spacing, nullptr);
+  f.map([](const auto&, auto& val) { val = std::sqrt(val); });
+  return f;
+}
+
+/**
+ * Distance transform also returning in \c nearest the flat index, in
+ * row-major order, of the nearest feature of each element, or an
+ * element index when there is no feature.
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> distance_transform(const Array& mask,
+						 const std::array<T,Array::ndim()>& spacing,
+						 StridedArray<std::size_t,Array::ndim()>& nearest)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"distance transforms require floating point distances");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (nearest.dims() != mask.dims())
+    throw std::length_error("nearest feature indices must have the mask dimensions");
+#endif
+  StridedArray<std::size_t,Array::ndim()> idx(mask.dims());
+  auto f = distance_transform_init<T>(mask, &idx);
+  distance_transform_inplace<T,Array::ndim()>(f, spacing, &idx);
+  f.map([](const auto&, auto& val) { val = std::sqrt(val); });
+  nearest = idx;
+  return f;
+}
+
+/**
+ * Distance transform with unit spacing.
+ *
+ * \ingroup filters
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<double,Array::ndim()> distance_transform(const Array& mask)
+{
+  std::array<double,Array::ndim()> spacing;
+  spacing.fill(1);
+  return distance_transform(mask, spacing);
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
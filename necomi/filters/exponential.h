@@ -6,9 +6,12 @@
 
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstdlib>
+#include <functional>
 #include <numeric>
+#include <stdexcept>
 #include <type_traits>
 #include <vector>
 
@@ -16,12 +19,23 @@
 #include <boost/math/special_functions/binomial.hpp>
 #endif
 
+#include "../arrays/stridedarray.h"
 #include "../core/coordinates.h"
-#include "../convert/stl.h"
+#include "../core/parallel.h"
+#include "../core/strides.h"
 
 namespace necomi
 {
 
+/**
+ * Infinite impulse response filter applied independently to each
+ * element of a sequence of arrays:
+ *
+ *   a[0]·y[n] = Σ b[i]·x[n-i] - Σ_{i≥1} a[i]·y[n-i]
+ *
+ * The last inputs and outputs are kept in circular buffers allocated
+ * at construction, so that feeding the filter does not allocate.
+ */
 template <typename T, std::size_t N>
 class RecursiveFilter
 {
@@ -32,11 +46,17 @@ public:
   RecursiveFilter(const std::vector<T>& a,
 		  const std::vector<T>& b,
 		  const std::array<std::size_t,N>& dims)
-    : m_a(a), m_b(from_vector(b))
-    , m_last_inputs(prepend_coordinate(dims, b.size()))
-    , m_last_outputs(prepend_coordinate(dims, a.size()-1))
+    : m_a(a), m_b(b), m_dims(dims)
+    , m_size(std::accumulate(dims.cbegin(), dims.cend(), 1UL,
+			     std::multiplies<std::size_t>()))
+    , m_last_inputs(prepend_coordinate(dims, std::max<std::size_t>(b.size(), 1)))
+    , m_last_outputs(prepend_coordinate(dims, std::max<std::size_t>(a.size(), 2) - 1))
     , m_in_pos(0), m_out_pos(0)
   {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (a.empty() || b.empty())
+      throw std::invalid_argument("recursive filters require coefficients");
+#endif
     m_last_inputs = 0;
     m_last_outputs = 0;
   };
@@ -45,8 +65,15 @@ public:
   { return m_a; }
   
   const std::vector<T> b() const
-  { return to_vector(m_b); }
+  { return m_b; }
+
+  const std::array<std::size_t,N>& dims() const
+  { return m_dims; }
 
+  /**
+   * Filter the next input, returning the output, which is a view
+   * valid until the output memory of the filter is overwritten.
+   */
   template <typename Input,
 	    std::enable_if_t<is_indexable<Input>::value>* = nullptr>
   const necomi::StridedArray<T,N> feed(const Input& input)
@@ -54,26 +81,17 @@ public:
     static_assert(Input::ndim() == N, "invalid input array dimensionality");
     
 #ifndef NECOMI_NO_BOUND_CHECKS
-    if (input.dims() != remove_coordinate(m_last_inputs.dims(), 0))
+    if (input.dims() != m_dims)
       throw std::length_error("input array dimensions incompatible with declared ones");
 #endif
   
     // Save the input
-    m_in_pos = (m_in_pos + m_last_inputs.dim(0) - 1) % m_last_inputs.dim(0);
+    m_in_pos = previous(m_in_pos, m_last_inputs.dim(0));
     m_last_inputs[m_in_pos] = input;
-    
-    // Compute A·Y
-    auto a_y = strided_array(zeros_like(input));
-    for (auto i = 0UL; i < m_last_outputs.dim(0); i++)
-      a_y += m_a[i+1]
-	* m_last_outputs[(i + m_out_pos) % m_last_outputs.dim(0)];
-    // Compute B·X
-    auto b_x = sum(widen_right(m_last_inputs.dims(), m_b)
-		   * roll(m_last_inputs, m_in_pos, 0UL), 0);
-
-    // Compute and save the output
-    m_out_pos = (m_out_pos + m_last_outputs.dim(0) - 1) % m_last_outputs.dim(0);
-    m_last_outputs[m_out_pos] = (b_x - a_y) / m_a[0];
+
+    auto out_pos = previous(m_out_pos, m_last_outputs.dim(0));
+    step(0, m_size, m_in_pos, m_out_pos, out_pos);
+    m_out_pos = out_pos;
 
     return m_last_outputs[m_out_pos];
   }
@@ -86,27 +104,178 @@ public:
 			     && N == 0>* = nullptr>
   T feed(const U& input)
   {
-    necomi::StridedArray<T,0> in;
-    in = input;
-    return feed(in)();
+    m_in_pos = previous(m_in_pos, m_last_inputs.dim(0));
+    m_last_inputs.data()[m_in_pos] = static_cast<T>(input);
+
+    auto out_pos = previous(m_out_pos, m_last_outputs.dim(0));
+    step(0, 1, m_in_pos, m_out_pos, out_pos);
+    m_out_pos = out_pos;
+
+    return m_last_outputs.data()[m_out_pos];
+  }
+
+  /**
+   * Filter a sequence of inputs stored along the first dimension of
+   * an array, writing the outputs in an array of the same dimensions.
+   * This is equivalent to feeding the inputs one after the other, but
+   * the array elements are filtered concurrently, in chunks, so that
+   * each chunk goes through all the time steps while in cache.
+   */
+  void feed_block(const StridedArray<T,N+1>& inputs,
+		  StridedArray<T,N+1>& outputs)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (remove_coordinate(inputs.dims(), 0) != m_dims)
+      throw std::length_error("input array dimensions incompatible with declared ones");
+    if (outputs.dims() != inputs.dims())
+      throw std::length_error("output array dimensions differ from the input ones");
+#endif
+
+    const auto steps = inputs.dim(0);
+    const auto nin = m_last_inputs.dim(0);
+    const auto nout = m_last_outputs.dim(0);
+    const auto in_pos = m_in_pos;
+    const auto out_pos = m_out_pos;
+
+    const auto in_strides = remove_coordinate(inputs.strides(), 0);
+    const auto out_strides = remove_coordinate(outputs.strides(), 0);
+    const bool in_contiguous = in_strides == default_strides(m_dims);
+    const bool out_contiguous = out_strides == default_strides(m_dims);
+
+    parallel_for(m_size, [&](std::size_t begin, std::size_t end) {
+	for (auto cbegin = begin; cbegin < end; cbegin += chunk) {
+	  auto cend = std::min(cbegin + chunk, end);
+	  auto ipos = in_pos;
+	  auto opos = out_pos;
+	  for (std::size_t t = 0; t < steps; t++) {
+	    // Save the inputs
+	    ipos = previous(ipos, nin);
+	    auto src = inputs.data() + t*inputs.strides()[0];
+	    auto x = m_last_inputs.data() + ipos*m_size;
+	    if (in_contiguous)
+	      std::copy(src + cbegin, src + cend, x + cbegin);
+	    else
+	      for (auto j = cbegin; j < cend; j++)
+		x[j] = src[element_offset(j, in_strides)];
+
+	    auto npos = previous(opos, nout);
+	    step(cbegin, cend, ipos, opos, npos);
+	    opos = npos;
+
+	    // Copy the outputs
+	    auto dst = outputs.data() + t*outputs.strides()[0];
+	    auto y = m_last_outputs.data() + opos*m_size;
+	    if (out_contiguous)
+	      std::copy(y + cbegin, y + cend, dst + cbegin);
+	    else
+	      for (auto j = cbegin; j < cend; j++)
+		dst[element_offset(j, out_strides)] = y[j];
+	  }
+	}
+      }, 4*chunk);
+
+    m_in_pos = (m_in_pos + nin - steps % nin) % nin;
+    m_out_pos = (m_out_pos + nout - steps % nout) % nout;
+  }
+
+  /**
+   * Convenience overload allocating the outputs.
+   */
+  StridedArray<T,N+1> feed_block(const StridedArray<T,N+1>& inputs)
+  {
+    StridedArray<T,N+1> outputs(inputs.dims());
+    feed_block(inputs, outputs);
+    return outputs;
   }
   
 private:
+  /// Number of elements filtered together.
+  static constexpr std::size_t chunk = 256;
+
+  static std::size_t previous(std::size_t pos, std::size_t len)
+  {
+    return (pos + len - 1) % len;
+  }
+
+  /**
+   * Compute the elements [begin,end) of the output at position
+   * out_pos from the last outputs starting at position prev_pos and
+   * the last inputs starting at position in_pos.
+   */
+  void step(std::size_t begin, std::size_t end, std::size_t in_pos,
+	    std::size_t prev_pos, std::size_t out_pos)
+  {
+    const auto nin = m_last_inputs.dim(0);
+    const auto nout = m_last_outputs.dim(0);
+    const T* x = m_last_inputs.data();
+    T* y = m_last_outputs.data();
+
+    T b_x[chunk];
+    T a_y[chunk];
+    for (auto cbegin = begin; cbegin < end; cbegin += chunk) {
+      const auto n = std::min(chunk, end - cbegin);
+
+      // Compute B·X
+      auto src = x + in_pos*m_size + cbegin;
+      for (std::size_t k = 0; k < n; k++)
+	b_x[k] = m_b[0] * src[k];
+      for (std::size_t i = 1; i < m_b.size(); i++) {
+	src = x + ((in_pos + i) % nin)*m_size + cbegin;
+	for (std::size_t k = 0; k < n; k++)
+	  b_x[k] += m_b[i] * src[k];
+      }
+
+      // Compute A·Y
+      std::fill_n(a_y, n, T(0));
+      for (std::size_t i = 1; i < m_a.size(); i++) {
+	src = y + ((prev_pos + i - 1) % nout)*m_size + cbegin;
+	for (std::size_t k = 0; k < n; k++)
+	  a_y[k] += m_a[i] * src[k];
+      }
+
+      // Compute the output, overwriting the oldest one only now
+      auto dst = y + out_pos*m_size + cbegin;
+      for (std::size_t k = 0; k < n; k++)
+	dst[k] = (b_x[k] - a_y[k]) / m_a[0];
+    }
+  }
+
+  /**
+   * Offset of the j-th element of an array of filter dimensions
+   * with the given strides.
+   */
+  std::size_t element_offset(std::size_t j,
+			     const std::array<std::size_t,N>& strides) const
+  {
+    std::size_t offset = 0;
+    for (std::size_t d = N; d-- > 0; ) {
+      offset += (j % m_dims[d]) * strides[d];
+      j /= m_dims[d];
+    }
+    return offset;
+  }
+
   /// Coefficient applied to the last outputs.
   std::vector<T> m_a;
   /// Coefficient applied to the last inputs.
-  //std::vector<T> m_b;
-  StridedArray<T,1> m_b;
+  std::vector<T> m_b;
+  /// Dimensions of the filtered arrays.
+  std::array<std::size_t,N> m_dims;
+  /// Number of elements in the filtered arrays.
+  std::size_t m_size;
   /// Copy of the last inputs.
   necomi::StridedArray<T,N+1> m_last_inputs;
   /// Last outputs.
-  necomi::StridedArray<T,N+1> m_last_outputs;;
+  necomi::StridedArray<T,N+1> m_last_outputs;
   /// Position in the circular array of last inputs.
   std::size_t m_in_pos;
   /// Position in the circular array of last outputs.
   std::size_t m_out_pos;
 };
 
+template <typename T, std::size_t N>
+constexpr std::size_t RecursiveFilter<T,N>::chunk;
+
 
 #ifdef HAVE_BOOST
 
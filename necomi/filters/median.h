@@ -0,0 +1,356 @@
+// necomi/filters/median.h – Median filters
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/boundaries.h"
+#include "../core/parallel.h"
+
+/**
+ * \file median.h Median filtering of images
+ * \ingroup filters
+ */
+
+namespace necomi
+{
+
+/// Memory used by the column histograms of each median filter tile.
+constexpr std::size_t median_tile_bytes = 1UL << 22;
+/// Number of pixels sorted together by median networks.
+constexpr std::size_t median_lanes = 16;
+/// Largest radius for which medians are computed with sorting networks.
+constexpr std::size_t median_network_radius = 2;
+
+/**
+ * Comparators of a sorting network of n elements, pruned of those
+ * which do not contribute to the element of rank \c rank.
+ *
+ * Batcher's odd-even merge sort is used on the next power of two,
+ * the extra elements being set to the largest value.
+ */
+inline std::vector<std::pair<std::size_t,std::size_t>>
+median_network(std::size_t n, std::size_t rank, std::size_t& padded)
+{
+  padded = 1;
+  while (padded < n)
+    padded <<= 1;
+
+  std::vector<std::pair<std::size_t,std::size_t>> net;
+  for (std::size_t p = 1; p < padded; p <<= 1)
+    for (std::size_t k = p; k >= 1; k >>= 1)
+      for (std::size_t j = k % p; j + k < padded; j += 2*k)
+	for (std::size_t i = 0; i < k && i + j + k < padded; i++)
+	  if ((i + j) / (2*p) == (i + j + k) / (2*p))
+	    net.emplace_back(i + j, i + j + k);
+
+  // Only keep the comparators on which the output depends
+  std::vector<bool> needed(padded, false);
+  needed[rank] = true;
+  std::vector<std::pair<std::size_t,std::size_t>> pruned;
+  for (auto it = net.rbegin(); it != net.rend(); ++it)
+    if (needed[it->first] || needed[it->second]) {
+      needed[it->first] = needed[it->second] = true;
+      pruned.push_back(*it);
+    }
+  std::reverse(pruned.begin(), pruned.end());
+  return pruned;
+}
+
+/**
+ * Median filter computed by sorting each neighborhood, with sorting
+ * networks applied to several pixels at once for small radii, and a
+ * selection algorithm otherwise. Rows are filtered concurrently.
+ */
+template <typename T>
+void median_filter_sort(const StridedArray<T,2>& a, StridedArray<T,2>& res,
+			std::size_t radius, Boundary boundary, T value)
+{
+  const auto height = a.dim(0);
+  const auto width = a.dim(1);
+  const auto side = 2*radius + 1;
+  const auto n = side*side;
+  const auto rank = (n - 1) / 2;
+  const auto ext = width + 2*radius;
+
+  std::size_t padded = n;
+  std::vector<std::pair<std::size_t,std::size_t>> net;
+  const bool use_network = radius <= median_network_radius;
+  if (use_network)
+    net = median_network(n, rank, padded);
+  const T largest = std::numeric_limits<T>::has_infinity
+    ? std::numeric_limits<T>::infinity()
+    : std::numeric_limits<T>::max();
+
+  parallel_for(height, [&](std::size_t begin, std::size_t end) {
+      std::vector<T> rows(side * ext);
+      std::vector<T> v(padded * median_lanes);
+      for (auto i = begin; i < end; i++) {
+	// Neighboring rows, extended beyond the image borders
+	for (std::size_t dy = 0; dy < side; dy++) {
+	  auto y = boundary_index(static_cast<std::ptrdiff_t>(i + dy) - static_cast<std::ptrdiff_t>(radius),
+				  height, boundary);
+	  T* row = rows.data() + dy*ext;
+	  if (y == height)
+	    std::fill_n(row, ext, value);
+	  else
+	    extend_line(a.data() + y*a.strides()[0], a.strides()[1], width,
+			-static_cast<std::ptrdiff_t>(radius), ext, row, boundary, value);
+	}
+
+	if (! use_network) {
+	  for (std::size_t j = 0; j < width; j++) {
+	    for (std::size_t dy = 0; dy < side; dy++)
+	      std::copy_n(rows.data() + dy*ext + j, side, v.data() + dy*side);
+	    std::nth_element(v.begin(), v.begin() + rank, v.begin() + n);
+	    res(i, j) = v[rank];
+	  }
+	  continue;
+	}
+
+	for (std::size_t j0 = 0; j0 < width; j0 += median_lanes) {
+	  const auto m = std::min(median_lanes, width - j0);
+	  // Neighborhood elements of m pixels, interleaved
+	  for (std::size_t dy = 0; dy < side; dy++)
+	    for (std::size_t dx = 0; dx < side; dx++) {
+	      const T* src = rows.data() + dy*ext + j0 + dx;
+	      T* dst = v.data() + (dy*side + dx)*median_lanes;
+	      std::copy_n(src, m, dst);
+	    }
+	  for (auto k = n; k < padded; k++)
+	    std::fill_n(v.data() + k*median_lanes, median_lanes, largest);
+
+	  for (const auto& c : net) {
+	    T* x = v.data() + c.first*median_lanes;
+	    T* y = v.data() + c.second*median_lanes;
+	    for (std::size_t l = 0; l < median_lanes; l++) {
+	      const T lo = std::min(x[l], y[l]);
+	      const T hi = std::max(x[l], y[l]);
+	      x[l] = lo;
+	      y[l] = hi;
+	    }
+	  }
+	  for (std::size_t l = 0; l < m; l++)
+	    res(i, j0 + l) = v[rank*median_lanes + l];
+	}
+      }
+    });
+}
+
+/**
+ * Median filter in constant time per pixel using the histograms of
+ * the 8 or 16 bits pixel values, after Perreault and Hébert.
+ *
+ * A histogram is kept for each column of the neighborhood rows, and
+ * updated with one pixel added and one removed when moving down a
+ * row. The histogram of the neighborhood is updated with one column
+ * histogram added and one removed when moving right. Histograms have
+ * two levels: coarse histograms of the most significant bits are
+ * always updated, while the fine histogram of each coarse bin in the
+ * neighborhood is only updated when the median falls in that bin.
+ *
+ * The image is cut in tiles, made of a strip of rows and a range of
+ * columns whose histograms fit in memory, which are filtered
+ * concurrently.
+ */
+template <typename T>
+void median_filter_histogram(const StridedArray<T,2>& a, StridedArray<T,2>& res,
+			     std::size_t radius, Boundary boundary, T value)
+{
+  typedef std::uint16_t count_type;
+  constexpr std::size_t bits = 8 * sizeof(T);
+  constexpr std::size_t fine_bits = bits - bits / 2;
+  constexpr std::size_t ncoarse = 1UL << (bits / 2);
+  constexpr std::size_t nfine = 1UL << fine_bits;
+  constexpr std::size_t nbins = ncoarse * nfine;
+  const auto lowest = static_cast<std::int64_t>(std::numeric_limits<T>::lowest());
+
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (2*radius + 1 > std::numeric_limits<count_type>::max())
+    throw std::invalid_argument("median filter radius too large");
+#endif
+
+  const auto height = a.dim(0);
+  const auto width = a.dim(1);
+  const auto side = 2*radius + 1;
+  const auto rank = (side*side - 1) / 2;
+
+  // Tiles of columns whose histograms fit in memory, extended by 2r
+  // columns, at least half of which are filtered for large radii
+  const auto col_bytes = (ncoarse + nbins) * sizeof(count_type);
+  const auto max_cols = std::max(median_tile_bytes / col_bytes, 4*radius + 1);
+  const auto tile_width = std::min(max_cols - 2*radius, width);
+  const auto ntiles = (width + tile_width - 1) / tile_width;
+  // Strips of rows shared among the threads
+  const auto strip = std::max<std::size_t>((height + num_threads() - 1) / num_threads(), 1);
+  const auto nstrips = (height + strip - 1) / strip;
+
+  // Image column of each extended column, or width for constant ones
+  std::vector<std::size_t> colmap(width + 2*radius);
+  for (std::size_t v = 0; v < colmap.size(); v++)
+    colmap[v] = boundary_index(static_cast<std::ptrdiff_t>(v) - static_cast<std::ptrdiff_t>(radius),
+			       width, boundary);
+
+  auto key = [lowest](T x) {
+    return static_cast<std::size_t>(static_cast<std::int64_t>(x) - lowest);
+  };
+
+  parallel_for(nstrips * ntiles, [&](std::size_t begin, std::size_t end) {
+      // Column histograms, null between tiles
+      std::vector<count_type> col_coarse((tile_width + 2*radius) * ncoarse, 0);
+      std::vector<count_type> col_fine((tile_width + 2*radius) * nbins, 0);
+      std::vector<std::uint32_t> coarse(ncoarse), fine(nbins);
+      std::vector<std::size_t> synced(ncoarse);
+      const auto stale = std::numeric_limits<std::size_t>::max();
+
+      for (auto task = begin; task < end; task++) {
+	const auto r0 = (task / ntiles) * strip;
+	const auto r1 = std::min(r0 + strip, height);
+	const auto c0 = (task % ntiles) * tile_width;
+	const auto c1 = std::min(c0 + tile_width, width);
+	// Extended columns [c0, c1+2r) of the tile
+	const auto ncols = c1 - c0 + 2*radius;
+
+	auto update_row = [&](std::ptrdiff_t row, int delta) {
+	  auto y = boundary_index(row, height, boundary);
+	  const T* src = y < height ? a.data() + y*a.strides()[0] : nullptr;
+	  for (std::size_t v = 0; v < ncols; v++) {
+	    auto x = colmap[c0 + v];
+	    auto k = key(src && x < width ? src[x*a.strides()[1]] : value);
+	    col_coarse[v*ncoarse + (k >> fine_bits)] += delta;
+	    col_fine[v*nbins + k] += delta;
+	  }
+	};
+
+	for (std::ptrdiff_t dy = -static_cast<std::ptrdiff_t>(radius);
+	     dy <= static_cast<std::ptrdiff_t>(radius); dy++)
+	  update_row(static_cast<std::ptrdiff_t>(r0) + dy, 1);
+
+	for (auto i = r0; i < r1; i++) {
+	  if (i > r0) {
+	    update_row(static_cast<std::ptrdiff_t>(i - 1 - radius), -1);
+	    update_row(static_cast<std::ptrdiff_t>(i + radius), 1);
+	  }
+
+	  // Neighborhood of the first pixel
+	  std::fill(coarse.begin(), coarse.end(), 0);
+	  for (std::size_t v = 0; v < side; v++)
+	    for (std::size_t c = 0; c < ncoarse; c++)
+	      coarse[c] += col_coarse[v*ncoarse + c];
+	  std::fill(synced.begin(), synced.end(), stale);
+
+	  for (std::size_t j = 0; j < c1 - c0; j++) {
+	    if (j > 0) {
+	      const count_type* add = col_coarse.data() + (j + 2*radius)*ncoarse;
+	      const count_type* sub = col_coarse.data() + (j - 1)*ncoarse;
+	      for (std::size_t c = 0; c < ncoarse; c++)
+		coarse[c] += add[c] - sub[c];
+	    }
+
+	    // Coarse bin of the median
+	    std::size_t c = 0, count = 0;
+	    while (count + coarse[c] <= rank)
+	      count += coarse[c++];
+
+	    // Bring its fine histogram up to date
+	    std::uint32_t* f = fine.data() + c*nfine;
+	    if (synced[c] == stale || 2*(j - synced[c]) > side) {
+	      std::fill_n(f, nfine, 0);
+	      for (std::size_t v = j; v < j + side; v++) {
+		const count_type* col = col_fine.data() + v*nbins + c*nfine;
+		for (std::size_t b = 0; b < nfine; b++)
+		  f[b] += col[b];
+	      }
+	    }
+	    else {
+	      for (auto t = synced[c] + 1; t <= j; t++) {
+		const count_type* add = col_fine.data() + (t + 2*radius)*nbins + c*nfine;
+		const count_type* sub = col_fine.data() + (t - 1)*nbins + c*nfine;
+		for (std::size_t b = 0; b < nfine; b++)
+		  f[b] += add[b] - sub[b];
+	      }
+	    }
+	    synced[c] = j;
+
+	    std::size_t b = 0;
+	    while (count + f[b] <= rank)
+	      count += f[b++];
+	    res(i, c0 + j) = static_cast<T>(static_cast<std::int64_t>((c << fine_bits) | b) + lowest);
+	  }
+	}
+
+	// Clear the fine histograms of the coarse bins still counting
+	// pixels, the others being null already
+	for (std::size_t v = 0; v < ncols; v++)
+	  for (std::size_t c = 0; c < ncoarse; c++)
+	    if (col_coarse[v*ncoarse + c] != 0) {
+	      std::fill_n(col_fine.data() + v*nbins + c*nfine, nfine, 0);
+	      col_coarse[v*ncoarse + c] = 0;
+	    }
+      }
+    });
+}
+
+template <typename T>
+void median_filter_dispatch(const StridedArray<T,2>& a, StridedArray<T,2>& res,
+			    std::size_t radius, Boundary boundary, T value,
+			    std::true_type)
+{
+  // Sorting networks beat the large histograms of 16 bits values
+  if (sizeof(T) > 1 && radius <= median_network_radius)
+    median_filter_sort(a, res, radius, boundary, value);
+  else
+    median_filter_histogram(a, res, radius, boundary, value);
+}
+
+template <typename T>
+void median_filter_dispatch(const StridedArray<T,2>& a, StridedArray<T,2>& res,
+			    std::size_t radius, Boundary boundary, T value,
+			    std::false_type)
+{
+  median_filter_sort(a, res, radius, boundary, value);
+}
+
+/**
+ * Median of the square neighborhoods extending \c radius pixels
+ * around each pixel of an image, the image being extended beyond its
+ * borders with the given boundary condition.
+ *
+ * Images of 8 bits integers, and of 16 bits integers for radii above
+ * 2, are filtered in constant time per pixel with the Perreault-Hébert
+ * histogram algorithm. Other images are filtered by sorting the
+ * neighborhoods, with sorting networks vectorized across pixels when
+ * the radius is at most 2.
+ *
+ * \ingroup filters
+ */
+template <typename T>
+StridedArray<T,2> median_filter(const StridedArray<T,2>& a, std::size_t radius,
+				Boundary boundary = Boundary::REFLECT,
+				T value = T(0))
+{
+  StridedArray<T,2> res(a.dims());
+  if (a.dim(0) == 0 || a.dim(1) == 0)
+    return res;
+  median_filter_dispatch(a, res, radius, boundary, value,
+			 std::integral_constant<bool, (std::is_integral<T>::value
+						       && sizeof(T) <= 2)>());
+  return res;
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -0,0 +1,261 @@
+// necomi/filters/morphology.h – Sliding extrema and grayscale morphology
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+
+/**
+ * \file morphology.h Sliding window extrema and flat morphology
+ * \ingroup filters
+ */
+
+namespace necomi
+{
+
+/// Number of adjacent lines processed together by sliding extrema.
+constexpr std::size_t sliding_lanes = 16;
+
+/**
+ * Replace in place the elements of a contiguous array by the extremum
+ * of the window of \c size elements starting \c origin elements
+ * before them along a dimension, ignoring the elements outside of the
+ * array.
+ *
+ * The van Herk/Gil-Werman algorithm is used: lines are cut in blocks
+ * of the window size, in which running extrema are computed forward
+ * and backward, so that each window extremum only combines two of
+ * them, with three comparisons per element whatever the window size.
+ * Adjacent lines along a non-innermost dimension are processed
+ * together, and groups of lines concurrently.
+ *
+ * \param identity  Neutral element of \c op.
+ * \param op        Binary function returning the extremum of two values.
+ */
+template <typename T, std::size_t N, typename Operation>
+void sliding_extremum_inplace(StridedArray<T,N>& a, std::size_t dim,
+			      std::size_t size, std::size_t origin,
+			      T identity, Operation op)
+{
+  const auto& dims = a.dims();
+  std::size_t outer = 1, inner = 1;
+  for (std::size_t i = 0; i < dim; i++)
+    outer *= dims[i];
+  for (std::size_t i = dim + 1; i < N; i++)
+    inner *= dims[i];
+  const auto len = dims[dim];
+  if (outer * inner == 0 || len == 0 || size <= 1)
+    return;
+
+  T* data = a.data();
+  const auto ext = len + size - 1;
+  const auto nchunks = (inner + sliding_lanes - 1) / sliding_lanes;
+
+  parallel_for(outer * nchunks, [=,&op](std::size_t begin, std::size_t end) {
+      const auto lanes = std::min(inner, sliding_lanes);
+      std::vector<T> e(ext*lanes), g(ext*lanes), h(ext*lanes);
+      for (auto task = begin; task < end; task++) {
+	const auto o = task / nchunks;
+	const auto i0 = (task % nchunks) * sliding_lanes;
+	const auto m = std::min(sliding_lanes, inner - i0);
+	T* base = data + o*len*inner + i0;
+
+	// Extended lines, with the identity outside of the array
+	for (std::size_t k = 0; k < ext; k++) {
+	  T* ek = e.data() + k*m;
+	  if (k >= origin && k - origin < len)
+	    std::copy_n(base + (k - origin)*inner, m, ek);
+	  else
+	    std::fill_n(ek, m, identity);
+	}
+
+	// Running extrema forward and backward in each block
+	for (std::size_t s = 0; s < ext; s += size) {
+	  const auto last = std::min(s + size, ext) - 1;
+	  std::copy_n(e.data() + s*m, m, g.data() + s*m);
+	  for (auto k = s + 1; k <= last; k++)
+	    for (std::size_t l = 0; l < m; l++)
+	      g[k*m+l] = op(g[(k-1)*m+l], e[k*m+l]);
+	  std::copy_n(e.data() + last*m, m, h.data() + last*m);
+	  for (auto k = last; k-- > s; )
+	    for (std::size_t l = 0; l < m; l++)
+	      h[k*m+l] = op(h[(k+1)*m+l], e[k*m+l]);
+	}
+
+	for (std::size_t i = 0; i < len; i++) {
+	  T* out = base + i*inner;
+	  const T* hi = h.data() + i*m;
+	  const T* gi = g.data() + (i + size - 1)*m;
+	  for (std::size_t l = 0; l < m; l++)
+	    out[l] = op(hi[l], gi[l]);
+	}
+      }
+    }, std::max<std::size_t>(4096 / (ext * sliding_lanes), 1));
+}
+
+/// Largest value of a type, used as the identity of minima.
+template <typename T>
+T sliding_min_identity()
+{
+  return std::numeric_limits<T>::has_infinity
+    ? std::numeric_limits<T>::infinity()
+    : std::numeric_limits<T>::max();
+}
+
+/// Lowest value of a type, used as the identity of maxima.
+template <typename T>
+T sliding_max_identity()
+{
+  return std::numeric_limits<T>::has_infinity
+    ? -std::numeric_limits<T>::infinity()
+    : std::numeric_limits<T>::lowest();
+}
+
+/**
+ * Minimum of the windows of \c size elements along a dimension, each
+ * window starting \c origin elements before its element, ignoring
+ * the elements outside of the array. The window is centered by
+ * default; an origin of size-1 gives trailing windows, as in rolling
+ * minima of time series.
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> sliding_min(const Array& a, std::size_t dim,
+					  std::size_t size, std::size_t origin)
+{
+  static_assert(Array::ndim() > 0, "sliding windows require at least one dimension");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dim >= Array::ndim())
+    throw std::out_of_range("invalid sliding window dimension");
+  if (size == 0 || origin >= size)
+    throw std::invalid_argument("invalid sliding window size or origin");
+#endif
+  auto res = strided_array<T>(a);
+  sliding_extremum_inplace(res, dim, size, origin, sliding_min_identity<T>(),
+			   [](T x, T y) { return y < x ? y : x; });
+  return res;
+}
+
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> sliding_min(const Array& a, std::size_t dim,
+					  std::size_t size)
+{
+  return sliding_min(a, dim, size, size / 2);
+}
+
+/**
+ * Maximum of the windows of \c size elements along a dimension.
+ * \see sliding_min
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> sliding_max(const Array& a, std::size_t dim,
+					  std::size_t size, std::size_t origin)
+{
+  static_assert(Array::ndim() > 0, "sliding windows require at least one dimension");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dim >= Array::ndim())
+    throw std::out_of_range("invalid sliding window dimension");
+  if (size == 0 || origin >= size)
+    throw std::invalid_argument("invalid sliding window size or origin");
+#endif
+  auto res = strided_array<T>(a);
+  sliding_extremum_inplace(res, dim, size, origin, sliding_max_identity<T>(),
+			   [](T x, T y) { return x < y ? y : x; });
+  return res;
+}
+
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> sliding_max(const Array& a, std::size_t dim,
+					  std::size_t size)
+{
+  return sliding_max(a, dim, size, size / 2);
+}
+
+/**
+ * Grayscale erosion with a flat box extending \c radius[d] elements
+ * on both sides along each dimension d, computed as successive
+ * sliding minima along each dimension.
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> erosion(const Array& a,
+				      const std::array<std::size_t,Array::ndim()>& radius)
+{
+  auto res = strided_array<T>(a);
+  for (std::size_t d = 0; d < Array::ndim(); d++)
+    sliding_extremum_inplace(res, d, 2*radius[d] + 1, radius[d],
+			     sliding_min_identity<T>(),
+			     [](T x, T y) { return y < x ? y : x; });
+  return res;
+}
+
+/**
+ * Grayscale dilation with a flat box. \see erosion
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> dilation(const Array& a,
+				       const std::array<std::size_t,Array::ndim()>& radius)
+{
+  auto res = strided_array<T>(a);
+  for (std::size_t d = 0; d < Array::ndim(); d++)
+    sliding_extremum_inplace(res, d, 2*radius[d] + 1, radius[d],
+			     sliding_max_identity<T>(),
+			     [](T x, T y) { return x < y ? y : x; });
+  return res;
+}
+
+/**
+ * Grayscale opening with a flat box: an erosion followed by a
+ * dilation.
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> opening(const Array& a,
+				      const std::array<std::size_t,Array::ndim()>& radius)
+{
+  return dilation(erosion(a, radius), radius);
+}
+
+/**
+ * Grayscale closing with a flat box: a dilation followed by an
+ * erosion.
+ *
+ * \ingroup filters
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> closing(const Array& a,
+				      const std::array<std::size_t,Array::ndim()>& radius)
+{
+  return erosion(dilation(a, radius), radius);
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
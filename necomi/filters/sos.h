@@ -0,0 +1,401 @@
+// necomi/filters/sos.h – Cascades of second-order recursive filters
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/coordinates.h"
+#include "../core/parallel.h"
+#include "../core/strides.h"
+
+/**
+ * \file sos.h Second-order sections (biquad cascade) filtering
+ * \ingroup filters
+ */
+
+namespace necomi
+{
+
+/**
+ * Second-order section of a recursive filter, with a transfer function
+ *
+ *   (b0 + b1·z⁻¹ + b2·z⁻²) / (1 + a1·z⁻¹ + a2·z⁻²)
+ *
+ * \ingroup filters
+ */
+template <typename T>
+struct Biquad
+{
+  T b0, b1, b2;
+  T a1, a2;
+};
+
+/**
+ * Gain of a second-order section for a constant input.
+ */
+template <typename T>
+T biquad_gain(const Biquad<T>& s)
+{
+  return (s.b0 + s.b1 + s.b2) / (1 + s.a1 + s.a2);
+}
+
+/**
+ * Second-order sections of an exponential cascade filter of the
+ * given order and time constant, equivalent to exp_cascade().
+ *
+ * The order+1 identical real poles are paired into second-order
+ * sections, with a first-order section for an odd count, instead of
+ * being expanded into the ill-conditioned direct form polynomial.
+ */
+template <typename T>
+std::vector<Biquad<T>> exp_cascade_sos(std::size_t order, T tau)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"exp_cascade_sos requires a floating point argument");
+
+  const auto p = std::exp(- static_cast<T>(order) / tau);
+  const auto poles = order + 1;
+
+  std::vector<Biquad<T>> sos;
+  for (std::size_t i = 0; i < poles / 2; i++)
+    sos.push_back({(1-p)*(1-p), 0, 0, -2*p, p*p});
+  if (poles % 2)
+    sos.push_back({1-p, 0, 0, -p, 0});
+  return sos;
+}
+
+/**
+ * Filter in place \c steps rows of \c width channels through a
+ * cascade of second-order sections in transposed direct form II.
+ * The two state variables of each section are stored in rows of
+ * \c ld elements, starting at \c state. Rows are processed in
+ * reverse order if \c backward is set.
+ */
+template <typename T>
+void sos_rows(const Biquad<T>* sos, std::size_t nsec,
+	      T* state, std::size_t ld,
+	      T* rows, std::size_t steps, std::size_t width,
+	      bool backward)
+{
+  for (std::size_t s = 0; s < nsec; s++) {
+    const auto c = sos[s];
+    T* z1 = state + 2*s*ld;
+    T* z2 = z1 + ld;
+    for (std::size_t t = 0; t < steps; t++) {
+      T* x = rows + (backward ? steps - 1 - t : t)*width;
+      for (std::size_t k = 0; k < width; k++) {
+	const T xk = x[k];
+	const T yk = c.b0*xk + z1[k];
+	z1[k] = c.b1*xk - c.a1*yk + z2[k];
+	z2[k] = c.b2*xk - c.a2*yk;
+	x[k] = yk;
+      }
+    }
+  }
+}
+
+/**
+ * Cascade of second-order recursive filters applied independently to
+ * each element of a sequence of arrays.
+ *
+ * Array elements, or channels, are stored innermost in the filter
+ * state and in the working buffers, so that the recursions are
+ * vectorized across channels. Sequences are filtered in blocks of
+ * time steps going through all the sections while in cache.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+class SOSFilter
+{
+  static_assert(std::is_floating_point<T>::value,
+		"recursive filtering requires floating point values");
+
+public:
+  SOSFilter(const std::vector<Biquad<T>>& sos,
+	    const std::array<std::size_t,N>& dims)
+    : m_sos(sos), m_dims(dims)
+    , m_size(std::accumulate(dims.cbegin(), dims.cend(), 1UL,
+			     std::multiplies<std::size_t>()))
+    , m_state(2*sos.size()*m_size, T(0))
+    , m_output(dims)
+  {}
+
+  const std::vector<Biquad<T>>& sections() const
+  { return m_sos; }
+
+  const std::array<std::size_t,N>& dims() const
+  { return m_dims; }
+
+  /**
+   * Clear the filter memory.
+   */
+  void reset()
+  {
+    std::fill(m_state.begin(), m_state.end(), T(0));
+  }
+
+  /**
+   * Set the filter memory to its steady state for a constant input.
+   */
+  void initialize(const StridedArray<T,N>& input)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (input.dims() != m_dims)
+      throw std::length_error("input array dimensions incompatible with declared ones");
+#endif
+    auto strides = input.strides();
+    for (std::size_t j = 0; j < m_size; j++)
+      initialize_channel(j, input.data()[element_offset(j, strides)]);
+  }
+
+  /**
+   * Filter the next input, returning a view on the output valid
+   * until the next call.
+   */
+  const StridedArray<T,N> feed(const StridedArray<T,N>& input)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (input.dims() != m_dims)
+      throw std::length_error("input array dimensions incompatible with declared ones");
+#endif
+    auto strides = input.strides();
+    for (std::size_t j = 0; j < m_size; j++)
+      m_output.data()[j] = input.data()[element_offset(j, strides)];
+    sos_rows(m_sos.data(), m_sos.size(), m_state.data(), m_size,
+	     m_output.data(), 1, m_size, false);
+    return m_output;
+  }
+
+  /**
+   * Filter a sequence of inputs stored along the first dimension of
+   * an array, writing the outputs in an array of the same dimensions,
+   * possibly the input one. If \c backward is set, the sequence is
+   * filtered from its last element to its first one.
+   */
+  void feed_block(const StridedArray<T,N+1>& inputs,
+		  StridedArray<T,N+1>& outputs,
+		  bool backward = false)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (remove_coordinate(inputs.dims(), 0) != m_dims)
+      throw std::length_error("input array dimensions incompatible with declared ones");
+    if (outputs.dims() != inputs.dims())
+      throw std::length_error("output array dimensions differ from the input ones");
+#endif
+
+    const auto steps = inputs.dim(0);
+    const auto in_strides = remove_coordinate(inputs.strides(), 0);
+    const auto out_strides = remove_coordinate(outputs.strides(), 0);
+    const bool in_contiguous = in_strides == default_strides(m_dims);
+    const bool out_contiguous = out_strides == default_strides(m_dims);
+
+    parallel_for(m_size, [&](std::size_t begin, std::size_t end) {
+	std::vector<T> rows(sos_time_block * std::min(sos_channels, end - begin));
+	for (auto cbegin = begin; cbegin < end; cbegin += sos_channels) {
+	  const auto cend = std::min(cbegin + sos_channels, end);
+	  const auto width = cend - cbegin;
+	  for (std::size_t tb = 0; tb < steps; tb += sos_time_block) {
+	    const auto n = std::min(sos_time_block, steps - tb);
+	    const auto t0 = backward ? steps - tb - n : tb;
+
+	    // Gather the channels of the block of time steps
+	    for (std::size_t t = 0; t < n; t++) {
+	      auto src = inputs.data() + (t0 + t)*inputs.strides()[0];
+	      auto row = rows.data() + t*width;
+	      if (in_contiguous)
+		std::copy(src + cbegin, src + cend, row);
+	      else
+		for (auto j = cbegin; j < cend; j++)
+		  row[j-cbegin] = src[element_offset(j, in_strides)];
+	    }
+
+	    sos_rows(m_sos.data(), m_sos.size(), m_state.data() + cbegin, m_size,
+		     rows.data(), n, width, backward);
+
+	    // Scatter the outputs
+	    for (std::size_t t = 0; t < n; t++) {
+	      auto dst = outputs.data() + (t0 + t)*outputs.strides()[0];
+	      auto row = rows.data() + t*width;
+	      if (out_contiguous)
+		std::copy(row, row + width, dst + cbegin);
+	      else
+		for (auto j = cbegin; j < cend; j++)
+		  dst[element_offset(j, out_strides)] = row[j-cbegin];
+	    }
+	  }
+	}
+      }, sos_channels);
+  }
+
+  /**
+   * Convenience overload allocating the outputs.
+   */
+  StridedArray<T,N+1> feed_block(const StridedArray<T,N+1>& inputs,
+				 bool backward = false)
+  {
+    StridedArray<T,N+1> outputs(inputs.dims());
+    feed_block(inputs, outputs, backward);
+    return outputs;
+  }
+
+  /// Number of channels filtered together.
+  static constexpr std::size_t sos_channels = 256;
+  /// Number of time steps filtered together.
+  static constexpr std::size_t sos_time_block = 32;
+
+private:
+  /**
+   * Set the state of a channel to the steady state for a constant
+   * input, in which each section has the constant input scaled by the
+   * gain of the previous ones.
+   */
+  void initialize_channel(std::size_t j, T x)
+  {
+    for (std::size_t s = 0; s < m_sos.size(); s++) {
+      const auto& c = m_sos[s];
+      const auto y = biquad_gain(c) * x;
+      m_state[2*s*m_size + j] = y - c.b0*x;
+      m_state[(2*s+1)*m_size + j] = c.b2*x - c.a2*y;
+      x = y;
+    }
+  }
+
+  /**
+   * Offset of the j-th element of an array of filter dimensions
+   * with the given strides.
+   */
+  std::size_t element_offset(std::size_t j,
+			     const std::array<std::size_t,N>& strides) const
+  {
+    std::size_t offset = 0;
+    for (std::size_t d = N; d-- > 0; ) {
+      offset += (j % m_dims[d]) * strides[d];
+      j /= m_dims[d];
+    }
+    return offset;
+  }
+
+  /// Filter sections.
+  std::vector<Biquad<T>> m_sos;
+  /// Dimensions of the filtered arrays.
+  std::array<std::size_t,N> m_dims;
+  /// Number of elements in the filtered arrays.
+  std::size_t m_size;
+  /// State variables of the sections, channels innermost.
+  std::vector<T> m_state;
+  /// Last output.
+  StridedArray<T,N> m_output;
+};
+
+template <typename T, std::size_t N>
+constexpr std::size_t SOSFilter<T,N>::sos_channels;
+template <typename T, std::size_t N>
+constexpr std::size_t SOSFilter<T,N>::sos_time_block;
+
+/**
+ * View of an array with one of its dimensions moved first.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> sos_time_first(const StridedArray<T,N>& a, std::size_t axis)
+{
+  return StridedArray<T,N>(a.shared_data(), const_cast<T*>(a.data()),
+			   prepend_coordinate(remove_coordinate(a.strides(), axis),
+					      a.strides()[axis]),
+			   prepend_coordinate(remove_coordinate(a.dims(), axis),
+					      a.dim(axis)));
+}
+
+/**
+ * Filter an array along one of its dimensions with a cascade of
+ * second-order sections, starting from a zero state.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> sosfilt(const std::vector<Biquad<T>>& sos,
+			  const StridedArray<T,N>& a, std::size_t axis = 0)
+{
+  static_assert(N > 0, "cannot filter scalar values");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (axis >= N)
+    throw std::out_of_range("invalid filtering dimension");
+#endif
+
+  StridedArray<T,N> res(a.dims());
+  auto out = sos_time_first(res, axis);
+  SOSFilter<T,N-1> filter(sos, remove_coordinate(a.dims(), axis));
+  filter.feed_block(sos_time_first(a, axis), out);
+  return res;
+}
+
+/**
+ * Filter an array forward and backward along one of its dimensions
+ * with a cascade of second-order sections, for a zero-phase response
+ * with a squared magnitude.
+ *
+ * The array is extended by \c pad elements on each side by odd
+ * reflection about its edges, defaulting to three times the filter
+ * order, and each pass starts from the steady state for its first
+ * value, which limits the edge transients.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> sosfiltfilt(const std::vector<Biquad<T>>& sos,
+			      const StridedArray<T,N>& a, std::size_t axis = 0,
+			      std::ptrdiff_t pad = -1)
+{
+  static_assert(N > 0, "cannot filter scalar values");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (axis >= N)
+    throw std::out_of_range("invalid filtering dimension");
+#endif
+
+  const auto len = a.dim(axis);
+  const auto edge = pad < 0 ? 3*(2*sos.size() + 1) : static_cast<std::size_t>(pad);
+  const auto npad = len > 0 ? std::min(edge, len - 1) : 0;
+  const auto dims = remove_coordinate(a.dims(), axis);
+
+  // Odd extension of the signal about its edges
+  auto src = sos_time_first(a, axis);
+  StridedArray<T,N> ext(prepend_coordinate(dims, len + 2*npad));
+  for (std::size_t t = 0; t < len; t++)
+    ext[npad + t] = src[t];
+  for (std::size_t k = 1; k <= npad; k++) {
+    ext[npad - k] = 2*src[0] - src[k];
+    ext[npad + len - 1 + k] = 2*src[len-1] - src[len-1-k];
+  }
+
+  SOSFilter<T,N-1> filter(sos, dims);
+  if (ext.dim(0) > 0) {
+    filter.initialize(ext[0]);
+    filter.feed_block(ext, ext);
+    filter.initialize(ext[ext.dim(0) - 1]);
+    filter.feed_block(ext, ext, true);
+  }
+
+  StridedArray<T,N> res(a.dims());
+  auto out = sos_time_first(res, axis);
+  for (std::size_t t = 0; t < len; t++)
+    out[t] = ext[npad + t];
+  return res;
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
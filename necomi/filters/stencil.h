@@ -0,0 +1,378 @@
+// necomi/filters/stencil.h – Operations on the neighborhoods of array elements
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/boundaries.h"
+#include "../core/parallel.h"
+
+/**
+ * \file stencil.h Stencils and neighborhood operations
+ * \ingroup filters
+ */
+
+namespace necomi
+{
+
+/**
+ * Weighted sum of the elements at fixed offsets from each array
+ * element.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+class Stencil
+{
+public:
+  typedef std::array<std::ptrdiff_t,N> offset_type;
+
+  Stencil()
+  {}
+
+  Stencil(const std::vector<offset_type>& offsets,
+	  const std::vector<T>& weights)
+    : m_offsets(offsets), m_weights(weights)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (offsets.size() != weights.size())
+      throw std::length_error("stencil offsets and weights must have the same size");
+#endif
+  }
+
+  /**
+   * Add a weighted element to the stencil.
+   */
+  Stencil& add(const offset_type& offset, T weight)
+  {
+    m_offsets.push_back(offset);
+    m_weights.push_back(weight);
+    return *this;
+  }
+
+  const std::vector<offset_type>& offsets() const
+  { return m_offsets; }
+
+  const std::vector<T>& weights() const
+  { return m_weights; }
+
+  std::size_t size() const
+  { return m_offsets.size(); }
+
+  /**
+   * Number of elements required before each element along each
+   * dimension.
+   */
+  std::array<std::size_t,N> before() const
+  {
+    std::array<std::size_t,N> res;
+    res.fill(0);
+    for (const auto& o : m_offsets)
+      for (std::size_t d = 0; d < N; d++)
+	if (o[d] < 0)
+	  res[d] = std::max(res[d], static_cast<std::size_t>(-o[d]));
+    return res;
+  }
+
+  /**
+   * Number of elements required after each element along each
+   * dimension.
+   */
+  std::array<std::size_t,N> after() const
+  {
+    std::array<std::size_t,N> res;
+    res.fill(0);
+    for (const auto& o : m_offsets)
+      for (std::size_t d = 0; d < N; d++)
+	if (o[d] > 0)
+	  res[d] = std::max(res[d], static_cast<std::size_t>(o[d]));
+    return res;
+  }
+
+private:
+  std::vector<offset_type> m_offsets;
+  std::vector<T> m_weights;
+};
+
+/**
+ * Discrete Laplacian stencil, with 2N+1 elements.
+ */
+template <typename T, std::size_t N>
+Stencil<T,N> laplacian_stencil()
+{
+  Stencil<T,N> s;
+  std::array<std::ptrdiff_t,N> o;
+  o.fill(0);
+  s.add(o, -2 * static_cast<T>(N));
+  for (std::size_t d = 0; d < N; d++)
+    for (auto delta : {-1, 1}) {
+      o[d] = delta;
+      s.add(o, 1);
+      o[d] = 0;
+    }
+  return s;
+}
+
+/**
+ * Read-only view on the neighborhood of an array element, indexed by
+ * offsets relative to the element.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+class Neighborhood
+{
+public:
+  Neighborhood(const T* center, const std::array<std::ptrdiff_t,N>& strides)
+    : m_center(center), m_strides(strides)
+  {}
+
+  const T& operator()(const std::array<std::ptrdiff_t,N>& offset) const
+  {
+    std::ptrdiff_t pos = 0;
+    for (std::size_t d = 0; d < N; d++)
+      pos += offset[d] * m_strides[d];
+    return m_center[pos];
+  }
+
+  template <typename ...Offsets,
+	    std::enable_if_t<sizeof...(Offsets) == N>* = nullptr>
+  const T& operator()(Offsets... offsets) const
+  {
+    return (*this)(std::array<std::ptrdiff_t,N>{{static_cast<std::ptrdiff_t>(offsets)...}});
+  }
+
+private:
+  const T* m_center;
+  std::array<std::ptrdiff_t,N> m_strides;
+};
+
+/**
+ * Visit all the elements of an array with dimensions \c dims, one
+ * line along the innermost dimension at a time, distinguishing the
+ * interior elements, whose neighborhood extending \c before and \c
+ * after them is inside the array, from the border ones.
+ *
+ * For each line, \c interior(b, coords, begin, end) is called once for
+ * its interior range [begin,end), with coords the line coordinates,
+ * and \c border(b, coords) once for each of its border elements. \c b
+ * is the index of the concurrent block processing the line, lower
+ * than num_threads().
+ */
+template <std::size_t N, typename Interior, typename Border>
+void for_each_neighborhood(const std::array<std::size_t,N>& dims,
+			   const std::array<std::size_t,N>& before,
+			   const std::array<std::size_t,N>& after,
+			   Interior interior, Border border)
+{
+  static_assert(N > 0, "neighborhoods require at least one dimension");
+  const auto len = dims[N-1];
+  std::size_t lines = 1;
+  for (std::size_t d = 0; d < N-1; d++)
+    lines *= dims[d];
+  if (len == 0 || lines == 0)
+    return;
+
+  parallel_for_blocks(lines, [&](std::size_t b, std::size_t begin, std::size_t end) {
+      std::array<std::size_t,N> coords;
+      for (auto l = begin; l < end; l++) {
+	coords[N-1] = 0;
+	bool inside = true;
+	auto rem = l;
+	for (std::size_t d = N-1; d-- > 0; ) {
+	  coords[d] = rem % dims[d];
+	  rem /= dims[d];
+	  inside = inside && coords[d] >= before[d] && coords[d] + after[d] < dims[d];
+	}
+
+	std::size_t jlo = len, jhi = len;
+	if (inside && before[N-1] + after[N-1] < len) {
+	  jlo = before[N-1];
+	  jhi = len - after[N-1];
+	}
+	for (std::size_t j = 0; j < jlo; j++) {
+	  coords[N-1] = j;
+	  border(b, coords);
+	}
+	if (jlo < jhi) {
+	  coords[N-1] = 0;
+	  interior(b, coords, jlo, jhi);
+	}
+	for (std::size_t j = jhi; j < len; j++) {
+	  coords[N-1] = j;
+	  border(b, coords);
+	}
+      }
+    }, std::max<std::size_t>(4096 / len, 1));
+}
+
+/**
+ * Apply a stencil to an array.
+ *
+ * Interior elements are computed without bound checks, one stencil
+ * element at a time over contiguous runs of the result, while the
+ * elements near the array borders use the given boundary condition.
+ * Lines are processed concurrently.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> apply_stencil(const StridedArray<T,N>& a, const Stencil<T,N>& s,
+				Boundary boundary = Boundary::CONSTANT,
+				T value = T(0))
+{
+  const auto& dims = a.dims();
+  const auto& strides = a.strides();
+  StridedArray<T,N> res(dims);
+  const auto& rstrides = res.strides();
+  const T* src = a.data();
+  T* dst = res.data();
+
+  std::vector<std::ptrdiff_t> offsets;
+  for (const auto& o : s.offsets()) {
+    std::ptrdiff_t off = 0;
+    for (std::size_t d = 0; d < N; d++)
+      off += o[d] * static_cast<std::ptrdiff_t>(strides[d]);
+    offsets.push_back(off);
+  }
+  const auto& weights = s.weights();
+  const auto nw = weights.size();
+  const auto step = strides[N-1];
+
+  auto interior = [&](std::size_t, const std::array<std::size_t,N>& coords,
+		      std::size_t begin, std::size_t end) {
+    std::size_t base = 0, rbase = 0;
+    for (std::size_t d = 0; d < N-1; d++) {
+      base += coords[d] * strides[d];
+      rbase += coords[d] * rstrides[d];
+    }
+    T* out = dst + rbase;
+    std::fill(out + begin, out + end, T(0));
+    for (std::size_t k = 0; k < nw; k++) {
+      const T w = weights[k];
+      const T* in = src + base + offsets[k];
+      if (step == 1)
+	for (auto j = begin; j < end; j++)
+	  out[j] += w * in[j];
+      else
+	for (auto j = begin; j < end; j++)
+	  out[j] += w * in[j*step];
+    }
+  };
+
+  auto border = [&](std::size_t, const std::array<std::size_t,N>& coords) {
+    T acc = 0;
+    for (std::size_t k = 0; k < nw; k++) {
+      std::size_t pos = 0;
+      bool outside = false;
+      for (std::size_t d = 0; d < N; d++) {
+	auto i = boundary_index(static_cast<std::ptrdiff_t>(coords[d]) + s.offsets()[k][d],
+				dims[d], boundary);
+	outside = outside || i == dims[d];
+	pos += i * strides[d];
+      }
+      acc += weights[k] * (outside ? value : src[pos]);
+    }
+    res(coords) = acc;
+  };
+
+  for_each_neighborhood(dims, s.before(), s.after(), interior, border);
+  return res;
+}
+
+/**
+ * Apply a function to the neighborhood of each array element.
+ *
+ * \c f receives a Neighborhood view on the elements at offsets up to
+ * \c radius from each element. For interior elements, the view reads
+ * directly from the array without bound checks. For elements near
+ * the array borders, it reads from a copy of the neighborhood
+ * extended with the given boundary condition. Lines are processed
+ * concurrently.
+ *
+ * \ingroup filters
+ */
+template <typename T, std::size_t N, typename Function,
+	  typename U=std::decay_t<std::result_of_t<Function(const Neighborhood<T,N>&)>>>
+StridedArray<U,N> map_neighborhoods(const StridedArray<T,N>& a,
+				    const std::array<std::size_t,N>& radius,
+				    Function f,
+				    Boundary boundary = Boundary::CONSTANT,
+				    T value = T(0))
+{
+  const auto& dims = a.dims();
+  const auto& strides = a.strides();
+  StridedArray<U,N> res(dims);
+  const auto& rstrides = res.strides();
+  const T* src = a.data();
+  U* dst = res.data();
+
+  std::array<std::ptrdiff_t,N> sstrides;
+  for (std::size_t d = 0; d < N; d++)
+    sstrides[d] = static_cast<std::ptrdiff_t>(strides[d]);
+
+  // Extended neighborhoods of the border elements
+  std::array<std::size_t,N> ndims;
+  for (std::size_t d = 0; d < N; d++)
+    ndims[d] = 2*radius[d] + 1;
+  std::array<std::ptrdiff_t,N> nstrides;
+  std::size_t nsize = 1;
+  for (std::size_t d = N; d-- > 0; ) {
+    nstrides[d] = static_cast<std::ptrdiff_t>(nsize);
+    nsize *= ndims[d];
+  }
+  std::ptrdiff_t ncenter = 0;
+  for (std::size_t d = 0; d < N; d++)
+    ncenter += static_cast<std::ptrdiff_t>(radius[d]) * nstrides[d];
+  std::vector<std::vector<T>> scratch(num_threads());
+
+  auto interior = [&](std::size_t, const std::array<std::size_t,N>& coords,
+		      std::size_t begin, std::size_t end) {
+    std::size_t base = 0, rbase = 0;
+    for (std::size_t d = 0; d < N-1; d++) {
+      base += coords[d] * strides[d];
+      rbase += coords[d] * rstrides[d];
+    }
+    for (auto j = begin; j < end; j++)
+      dst[rbase + j*rstrides[N-1]] =
+	f(Neighborhood<T,N>(src + base + j*strides[N-1], sstrides));
+  };
+
+  auto border = [&](std::size_t b, const std::array<std::size_t,N>& coords) {
+    auto& buf = scratch[b];
+    buf.resize(nsize);
+    for (std::size_t k = 0; k < nsize; k++) {
+      std::size_t pos = 0;
+      bool outside = false;
+      auto rem = k;
+      for (std::size_t d = N; d-- > 0; ) {
+	const auto o = static_cast<std::ptrdiff_t>(rem % ndims[d]) - static_cast<std::ptrdiff_t>(radius[d]);
+	rem /= ndims[d];
+	auto i = boundary_index(static_cast<std::ptrdiff_t>(coords[d]) + o, dims[d], boundary);
+	outside = outside || i == dims[d];
+	pos += i * strides[d];
+      }
+      buf[k] = outside ? value : src[pos];
+    }
+    res(coords) = f(Neighborhood<T,N>(buf.data() + ncenter, nstrides));
+  };
+
+  for_each_neighborhood(dims, radius, radius, interior, border);
+  return res;
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -11,9 +11,11 @@
 #include "traits/generic.h"
 
 // Core definitions
+#include "core/boundaries.h"
 #include "core/coordinates.h"
 #include "core/loops.h"
 #include "core/mpl.h"
+#include "core/parallel.h"
 #include "core/shape.h"
 #include "core/slices.h"
 #include "core/strides.h"
@@ -32,6 +34,7 @@
 #include "delayed/transforms.h"
 
 // Algorithms
+#include "algorithms/labels.h"
 #include "algorithms/modif.h"
 #include "algorithms/sort.h"
 
@@ -39,9 +42,14 @@
 #include "numerics/arithmetics.h"
 #include "numerics/basic.h"
 #include "numerics/exponents.h"
+#include "numerics/histograms.h"
 #include "numerics/interpolation.h"
+#include "numerics/moments.h"
 #include "numerics/nearest-int.h"
+#include "numerics/quantiles.h"
 #include "numerics/random.h"
+#include "numerics/reductions.h"
+#include "numerics/scans.h"
 #include "numerics/sde.h"
 #include "numerics/statistics.h"
 #include "numerics/trigonometrics.h"
@@ -0,0 +1,1051 @@
+// necomi/numerics/convolution.h – Convolutions
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/boundaries.h"
+#include "../core/coordinates.h"
+#include "../core/parallel.h"
+#include "../core/strides.h"
+#include "fft.h"
+
+namespace necomi
+{
+
+/**
+ * Offsets of the first element of each line of an array along an axis.
+ */
+template <typename T, std::size_t N>
+void line_offsets(const StridedArray<T,N>& a, std::size_t axis,
+		  std::vector<std::size_t>& offsets)
+{
+  auto dims = a.dims();
+  dims[axis] = 1;
+  const auto strides = default_strides(dims);
+  std::size_t n = 1;
+  for (auto d : dims)
+    n *= d;
+  offsets.resize(n);
+  for (std::size_t l = 0; l < n; l++) {
+    const auto coords = strided_index_to_coords(l, strides);
+    std::size_t off = 0;
+    for (std::size_t i = 0; i < N; i++)
+      off += coords[i] * a.strides()[i];
+    offsets[l] = off;
+  }
+}
+
+#ifdef HAVE_FFTW
+
+/**
+ * Block decomposition used to convolve long signals.
+ */
+enum class OverlapMethod
+{
+  /// Blocks of new samples are padded with zeros, the tail of each
+  /// block result being added to the next one.
+  ADD,
+  /// Blocks start with the last input samples of the previous one,
+  /// whose contaminated results are discarded.
+  SAVE,
+};
+
+/**
+ * Streaming convolution of signals along an axis with a 1D kernel.
+ *
+ * The input is processed in blocks with Fourier transforms of a fixed
+ * size, reusing the same plans and kernel spectrum. All the lines of
+ * the signal along the axis are transformed together as a batch.
+ *
+ * Frames of any length along the axis can be fed successively, each
+ * one giving as many output samples of the causal convolution
+ * y[n] = Σ h[k] x[n-k], without latency.
+ */
+template <typename T, std::size_t N>
+class OverlapConvolver
+{
+public:
+  /**
+   * Prepare the convolution of frames with given dimensions.
+   *
+   * \param dims      Dimensions of the frames, the one along the axis
+   *                  being ignored.
+   * \param fft_size  Size of the Fourier transforms, automatically
+   *                  chosen if zero.
+   */
+  OverlapConvolver(const StridedArray<T,1>& kernel,
+		   const std::array<std::size_t,N>& dims, std::size_t axis,
+		   OverlapMethod method = OverlapMethod::SAVE,
+		   std::size_t fft_size = 0)
+    : m_dims(dims)
+    , m_axis(axis)
+    , m_method(method)
+    , m_klen(kernel.dim(0))
+    , m_fft_size(checked_fft_size(kernel.dim(0), fft_size))
+    , m_lines(count_lines(dims, axis))
+    , m_kernel(m_fft_size/2 + 1)
+    , m_block(m_lines, m_fft_size)
+    , m_spectrum(m_lines, m_fft_size/2 + 1)
+    , m_state(m_lines * (m_klen - 1), 0)
+  {
+    m_dims[axis] = 1;
+
+    // Kernel spectrum, including the inverse transform normalization
+    StridedArray<T,1> pkernel(m_fft_size);
+    pkernel.fill(0);
+    for (std::size_t k = 0; k < m_klen; k++)
+      pkernel(k) = kernel(k);
+    rfft(pkernel, m_kernel);
+    scale_elements(m_kernel, static_cast<T>(1) / m_fft_size);
+  }
+
+  /// Size of the Fourier transforms.
+  std::size_t fft_size() const
+  {
+    return m_fft_size;
+  }
+
+  /// Maximal number of new samples processed by each transform.
+  std::size_t block_size() const
+  {
+    return m_fft_size - m_klen + 1;
+  }
+
+  /**
+   * Convolve a frame, continuing the previous ones.
+   * \param out  Output frame, with the same dimensions as the input.
+   */
+  void feed(const StridedArray<T,N>& frame, StridedArray<T,N>& out)
+  {
+    check_frame(frame.dims());
+    check_frame(out.dims());
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (out.dim(m_axis) != frame.dim(m_axis))
+      throw std::length_error("convolution output must match its input");
+#endif
+    line_offsets(frame, m_axis, m_in_offsets);
+    line_offsets(out, m_axis, m_out_offsets);
+    const T* in = frame.data();
+    T* res = out.data();
+    const auto is = frame.strides()[m_axis];
+    const auto os = out.strides()[m_axis];
+    process(frame.dim(m_axis),
+	    [&](std::size_t l, std::size_t i) {
+	      return in[m_in_offsets[l] + i*is];
+	    },
+	    [&](std::size_t l, std::size_t i, T val) {
+	      res[m_out_offsets[l] + i*os] = val;
+	    });
+  }
+
+  /// Convolve a frame, continuing the previous ones.
+  StridedArray<T,N> feed(const StridedArray<T,N>& frame)
+  {
+    StridedArray<T,N> out(frame.dims());
+    feed(frame, out);
+    return out;
+  }
+
+  /**
+   * Convolve samples given by functions, continuing the previous ones.
+   *
+   * \param input   Called as input(l,i) to get the i-th sample of line l.
+   * \param output  Called as output(l,i,val) to store a result.
+   * \param skip    Number of first results to discard.
+   */
+  template <typename Input, typename Output>
+  void process(std::size_t len, Input&& input, Output&& output,
+	       std::size_t skip = 0)
+  {
+    const auto block = block_size();
+    for (std::size_t pos = 0; pos < len; pos += block)
+      process_block(pos, std::min(block, len - pos), input, output, skip);
+  }
+
+  /**
+   * Forget the previous frames.
+   */
+  void reset()
+  {
+    std::fill(m_state.begin(), m_state.end(), 0);
+  }
+
+protected:
+  /**
+   * Fourier transform size minimizing the cost per output sample,
+   * as a power of two about eight times the kernel size.
+   */
+  static std::size_t default_fft_size(std::size_t klen)
+  {
+    std::size_t n = 64;
+    while (n < 8*klen)
+      n *= 2;
+    return n;
+  }
+
+  static std::size_t checked_fft_size(std::size_t klen, std::size_t fft_size)
+  {
+    if (fft_size == 0)
+      fft_size = default_fft_size(klen);
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (klen == 0 || fft_size < klen || fft_size % 2 != 0)
+      throw std::length_error("invalid Fourier transform size for the kernel");
+#endif
+    return fft_size;
+  }
+
+  static std::size_t count_lines(const std::array<std::size_t,N>& dims,
+				 std::size_t axis)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (axis >= N)
+      throw std::out_of_range("invalid convolution axis");
+#endif
+    std::size_t n = 1;
+    for (std::size_t i = 0; i < N; i++)
+      if (i != axis)
+	n *= dims[i];
+    return n;
+  }
+
+  void check_frame(const std::array<std::size_t,N>& dims) const
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    for (std::size_t i = 0; i < N; i++)
+      if (i != m_axis && dims[i] != m_dims[i])
+	throw std::length_error("invalid frame dimensions for the convolution");
+#else
+    (void) dims;
+#endif
+  }
+
+  /**
+   * Convolve a block of at most block_size() samples of each line.
+   * \param pos  Position of the block in the samples being processed.
+   */
+  template <typename Input, typename Output>
+  void process_block(std::size_t pos, std::size_t count,
+		     Input& input, Output& output, std::size_t skip)
+  {
+    const auto F = m_fft_size;
+    const auto F2 = F/2 + 1;
+    const auto K1 = m_klen - 1;
+    const bool save = m_method == OverlapMethod::SAVE;
+    T* block = m_block.data();
+    T* state = m_state.data();
+    const std::size_t grain = std::max<std::size_t>(1, 16384 / F);
+
+    // Fill the blocks, after the previous input samples when saving
+    parallel_for(m_lines, [&](std::size_t begin, std::size_t end) {
+	for (std::size_t l = begin; l < end; l++) {
+	  T* b = block + l*F;
+	  const auto first = save ? K1 : 0;
+	  if (save)
+	    std::copy(state + l*K1, state + (l+1)*K1, b);
+	  for (std::size_t i = 0; i < count; i++)
+	    b[first + i] = input(l, pos + i);
+	  std::fill(b + first + count, b + F, static_cast<T>(0));
+	}
+      }, grain);
+
+    execute_fft<T>(FFTKind::REAL_FORWARD,
+		   fft_iodims(std::array<std::size_t,1>{{F}}, {{1}}, {{1}}),
+		   fft_iodims(std::array<std::size_t,1>{{m_lines}}, {{F}}, {{F2}}),
+		   block, m_spectrum.data());
+
+    // Real to complex transforms preserve their input, keep the last
+    // input samples for the next block
+    if (save)
+      parallel_for(m_lines, [&](std::size_t begin, std::size_t end) {
+	  for (std::size_t l = begin; l < end; l++)
+	    std::copy(block + l*F + count, block + l*F + count + K1, state + l*K1);
+	}, grain);
+
+    // Multiply by the kernel spectrum
+    const auto* h = m_kernel.data();
+    auto* spec = m_spectrum.data();
+    parallel_for(m_lines, [&](std::size_t begin, std::size_t end) {
+	for (std::size_t l = begin; l < end; l++)
+	  for (std::size_t f = 0; f < F2; f++)
+	    spec[l*F2 + f] *= h[f];
+      }, grain);
+
+    execute_fft<T>(FFTKind::REAL_BACKWARD,
+		   fft_iodims(std::array<std::size_t,1>{{F}}, {{1}}, {{1}}),
+		   fft_iodims(std::array<std::size_t,1>{{m_lines}}, {{F2}}, {{F}}),
+		   spec, block);
+
+    // Extract the results, adding or updating the tail of the
+    // previous blocks
+    parallel_for(m_lines, [&](std::size_t begin, std::size_t end) {
+	for (std::size_t l = begin; l < end; l++) {
+	  const T* y = block + l*F;
+	  T* tail = state + l*K1;
+	  for (std::size_t i = 0; i < count; i++) {
+	    T val;
+	    if (save)
+	      val = y[K1 + i];
+	    else
+	      val = y[i] + (i < K1 ? tail[i] : static_cast<T>(0));
+	    if (pos + i >= skip)
+	      output(l, pos + i - skip, val);
+	  }
+	  if (! save)
+	    for (std::size_t j = 0; j < K1; j++)
+	      tail[j] = y[count + j] + (j + count < K1 ? tail[j + count] : static_cast<T>(0));
+	}
+      }, grain);
+  }
+
+  /// Frame dimensions, with a single element along the axis.
+  std::array<std::size_t,N> m_dims;
+  std::size_t m_axis;
+  OverlapMethod m_method;
+  std::size_t m_klen;
+  std::size_t m_fft_size;
+  /// Number of lines along the axis.
+  std::size_t m_lines;
+  /// Normalized spectrum of the padded kernel.
+  StridedArray<std::complex<T>,1> m_kernel;
+  /// Blocks and spectra of all the lines.
+  StridedArray<T,2> m_block;
+  StridedArray<std::complex<T>,2> m_spectrum;
+  /// Last input samples or result tail of each line.
+  std::vector<T> m_state;
+  std::vector<std::size_t> m_in_offsets, m_out_offsets;
+};
+
+/**
+ * Convolve an array along an axis with a 1D kernel using blocks.
+ *
+ * As for fftconvolve(), the kernel is centered on its middle element
+ * and the result has the dimensions of the input, but memory use only
+ * grows with the kernel size.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> oaconvolve(const StridedArray<T,N>& input,
+			     const StridedArray<T,1>& kernel,
+			     std::size_t axis,
+			     OverlapMethod method = OverlapMethod::SAVE)
+{
+  OverlapConvolver<T,N> conv(kernel, input.dims(), axis, method);
+  StridedArray<T,N> res(input.dims());
+
+  std::vector<std::size_t> in_offsets, out_offsets;
+  line_offsets(input, axis, in_offsets);
+  line_offsets(res, axis, out_offsets);
+  const T* in = input.data();
+  T* out = res.data();
+  const auto len = input.dim(axis);
+  const auto is = input.strides()[axis];
+  const auto os = res.strides()[axis];
+
+  // Outputs are delayed by half the kernel size to center it
+  const auto delay = kernel.dim(0) / 2;
+  conv.process(len + delay,
+	       [&](std::size_t l, std::size_t i) {
+		 return i < len ? in[in_offsets[l] + i*is] : static_cast<T>(0);
+	       },
+	       [&](std::size_t l, std::size_t i, T val) {
+		 out[out_offsets[l] + i*os] = val;
+	       },
+	       delay);
+  return res;
+}
+
+/**
+ * Convolution of arrays of fixed dimensions with the same kernel.
+ *
+ * The padded kernel spectrum, the Fourier transform plans and the
+ * scratch buffers are prepared at construction, so that convolving
+ * an array only involves a forward transform, a pointwise product and
+ * an inverse transform, without any memory allocation. As with
+ * fftconvolve(), the kernel is centered on its middle element.
+ */
+template <typename T, std::size_t N>
+class Convolver
+{
+public:
+  using plan_cache = FFTPlanCache<T>;
+  using api = typename plan_cache::api;
+  using plan_type = typename plan_cache::plan_type;
+
+  /**
+   * Prepare the convolution of arrays of given dimensions.
+   * \param workers  Number of scratch buffers, bounding the number of
+   *                 arrays of a batch convolved concurrently.
+   */
+  Convolver(const StridedArray<T,N>& kernel,
+	    const std::array<std::size_t,N>& dims,
+	    std::size_t workers = 1)
+    : m_dims(dims)
+    , m_pdims(padded_dims(dims, kernel.dims()))
+    , m_spectrum(spectrum_dims(m_pdims))
+  {
+    static_assert( N >= 1, "scalar arrays cannot be convolved" );
+    for (std::size_t w = 0; w < std::max<std::size_t>(workers, 1); w++)
+      m_scratch.push_back(rfft_array<N,T>(m_pdims));
+
+    // Plans for in-place transforms of the scratch buffers
+    auto& r = m_scratch[0];
+    auto c = complex_view(r);
+    const auto threads = static_cast<int>(fft_threads());
+    const auto flags = fftw_planning_flags(fft_planning());
+    const auto ralign = api::alignment_of(r.data());
+    FFTLayout fwd{FFTKind::REAL_FORWARD, fft_iodims(m_pdims, r.strides(), c.strides()),
+	{}, true, threads, ralign, ralign, flags};
+    FFTLayout bwd{FFTKind::REAL_BACKWARD, fft_iodims(m_pdims, c.strides(), r.strides()),
+	{}, true, threads, ralign, ralign, flags};
+    m_forward = plan_cache::create_plan(fwd, r.data(), c.data());
+    try {
+      m_backward = plan_cache::create_plan(bwd, c.data(), r.data());
+    }
+    catch (...) {
+      plan_cache::destroy_plan(m_forward);
+      throw;
+    }
+
+    // Kernel wrapped around the origin, so that the circular
+    // convolution is centered, with the normalization of the inverse
+    r.fill(0);
+    kernel.map([&r,&kernel,this](const auto& coords, auto val) {
+	auto pos = coords;
+	for (std::size_t i = 0; i < N; i++)
+	  pos[i] = (coords[i] + m_pdims[i] - kernel.dim(i)/2) % m_pdims[i];
+	r(pos) = val;
+      });
+    api::execute_dft_r2c(m_forward, r.data(),
+			 reinterpret_cast<typename api::complex*>(c.data()));
+    m_spectrum = c;
+    scale_elements(m_spectrum, static_cast<T>(1) / size(r));
+  }
+
+  Convolver(const Convolver&) = delete;
+  Convolver& operator=(const Convolver&) = delete;
+
+  ~Convolver()
+  {
+    plan_cache::destroy_plan(m_forward);
+    plan_cache::destroy_plan(m_backward);
+  }
+
+  /// Dimensions of the convolved arrays.
+  const std::array<std::size_t,N>& dims() const
+  {
+    return m_dims;
+  }
+
+  /// Dimensions of the padded Fourier transforms.
+  const std::array<std::size_t,N>& padded_dims() const
+  {
+    return m_pdims;
+  }
+
+  /**
+   * Convolve an array into an existing one.
+   * \c output may be \c input itself.
+   */
+  void apply(const StridedArray<T,N>& input, StridedArray<T,N>& output)
+  {
+    check_dims(input.dims());
+    check_dims(output.dims());
+    convolve(m_scratch[0], input.data(), input.strides(),
+	     output.data(), output.strides());
+  }
+
+  /**
+   * Convolve a batch of arrays along the first dimension.
+   * Up to \c workers arrays are convolved concurrently.
+   */
+  void apply_batch(const StridedArray<T,N+1>& inputs,
+		   StridedArray<T,N+1>& outputs)
+  {
+    const auto n = inputs.dim(0);
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (outputs.dim(0) != n)
+      throw std::length_error("convolution outputs must match their inputs");
+#endif
+    check_dims(remove_coordinate(inputs.dims(), 0));
+    check_dims(remove_coordinate(outputs.dims(), 0));
+    const auto in_strides = remove_coordinate(inputs.strides(), 0);
+    const auto out_strides = remove_coordinate(outputs.strides(), 0);
+    const T* in = inputs.data();
+    T* out = outputs.data();
+
+    // No more blocks than scratch buffers
+    const auto workers = m_scratch.size();
+    parallel_for_blocks(n, [&](std::size_t b, std::size_t begin, std::size_t end) {
+	for (std::size_t i = begin; i < end; i++)
+	  convolve(m_scratch[b], in + i*inputs.strides()[0], in_strides,
+		   out + i*outputs.strides()[0], out_strides);
+      }, (n + workers - 1) / workers);
+  }
+
+protected:
+  /**
+   * Padded dimensions avoiding circular wrapping of the kernel.
+   */
+  static std::array<std::size_t,N> padded_dims(const std::array<std::size_t,N>& dims,
+					       const std::array<std::size_t,N>& kdims)
+  {
+    std::array<std::size_t,N> p;
+    for (std::size_t i = 0; i < N; i++) {
+#ifndef NECOMI_NO_BOUND_CHECKS
+      if (dims[i] == 0 || kdims[i] == 0)
+	throw std::length_error("cannot convolve empty arrays");
+#endif
+      p[i] = fft_fast_size(dims[i] + kdims[i] - 1);
+    }
+    return p;
+  }
+
+  static std::array<std::size_t,N> spectrum_dims(std::array<std::size_t,N> dims)
+  {
+    dims[N-1] = dims[N-1]/2 + 1;
+    return dims;
+  }
+
+  /// View of a scratch buffer as the complex array of its transform.
+  static StridedArray<std::complex<T>,N> complex_view(StridedArray<T,N>& r)
+  {
+    auto dims = spectrum_dims(r.dims());
+    auto strides = r.strides();
+    for (std::size_t i = 0; i + 1 < N; i++)
+      strides[i] /= 2;
+    auto data = reinterpret_cast<std::complex<T>*>(r.data());
+    return StridedArray<std::complex<T>,N>(std::shared_ptr<std::complex<T>>(r.shared_data(), data),
+					   data, strides, dims);
+  }
+
+  void check_dims(const std::array<std::size_t,N>& dims) const
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (dims != m_dims)
+      throw std::length_error("invalid dimensions for the convolution");
+#else
+    (void) dims;
+#endif
+  }
+
+  /**
+   * Apply a function to the offsets of the lines along the last
+   * dimension of the convolved arrays in two layouts.
+   */
+  template <typename Function>
+  void for_each_line(const std::array<std::size_t,N>& a_strides,
+		     const std::array<std::size_t,N>& b_strides,
+		     Function f) const
+  {
+    auto ldims = m_dims;
+    ldims[N-1] = 1;
+    const auto lstrides = default_strides(ldims);
+    const auto nlines = lstrides[0] * ldims[0];
+    for (std::size_t l = 0; l < nlines; l++) {
+      const auto coords = strided_index_to_coords(l, lstrides);
+      std::size_t a = 0, b = 0;
+      for (std::size_t i = 0; i + 1 < N; i++) {
+	a += coords[i] * a_strides[i];
+	b += coords[i] * b_strides[i];
+      }
+      f(a, b);
+    }
+  }
+
+  void convolve(StridedArray<T,N>& scratch,
+		const T* in, const std::array<std::size_t,N>& in_strides,
+		T* out, const std::array<std::size_t,N>& out_strides)
+  {
+    T* r = scratch.data();
+    const auto& rs = scratch.strides();
+    const auto len = m_dims[N-1];
+
+    // Copy the input in the corner of the zero-padded buffer
+    std::fill(r, r + rs[0] * m_pdims[0], static_cast<T>(0));
+    for_each_line(in_strides, rs, [&](std::size_t i, std::size_t o) {
+	for (std::size_t k = 0; k < len; k++)
+	  r[o + k] = in[i + k*in_strides[N-1]];
+      });
+
+    auto c = reinterpret_cast<typename api::complex*>(r);
+    api::execute_dft_r2c(m_forward, r, c);
+    auto z = reinterpret_cast<std::complex<T>*>(r);
+    const auto* h = m_spectrum.data();
+    const auto nc = size(m_spectrum);
+    for (std::size_t k = 0; k < nc; k++)
+      z[k] *= h[k];
+    api::execute_dft_c2r(m_backward, c, r);
+
+    for_each_line(rs, out_strides, [&](std::size_t i, std::size_t o) {
+	for (std::size_t k = 0; k < len; k++)
+	  out[o + k*out_strides[N-1]] = r[i + k];
+      });
+  }
+
+  std::array<std::size_t,N> m_dims;
+  std::array<std::size_t,N> m_pdims;
+  /// Normalized spectrum of the wrapped kernel.
+  StridedArray<std::complex<T>,N> m_spectrum;
+  /// Padded buffers for in-place real transforms, one per worker.
+  std::vector<StridedArray<T,N>> m_scratch;
+  plan_type m_forward, m_backward;
+};
+
+#endif // HAVE_FFTW
+
+/**
+ * Extent of a convolution result.
+ */
+enum class ConvolutionMode
+{
+  /// Every position where the kernel overlaps the input.
+  FULL,
+  /// The dimensions of the input, with a centered kernel.
+  SAME,
+  /// Positions where the kernel lies entirely within the input.
+  VALID,
+};
+
+/**
+ * Algorithm used to compute convolutions.
+ */
+enum class ConvolutionMethod
+{
+  /// Choose the fastest method with a cost model.
+  AUTO,
+  /// Sums over the kernel elements, or over separable factors.
+  DIRECT,
+  /// Products in the Fourier domain, if FFTW is available.
+  FFT,
+};
+
+/// Storage for the relative cost of Fourier convolutions.
+inline double& convolution_fft_cost_setting()
+{
+  static double c = 3;
+  return c;
+}
+
+/**
+ * Cost of Fourier convolutions per n log₂ n transformed elements,
+ * relative to a direct multiply-add.
+ */
+inline double convolution_fft_cost()
+{
+  return convolution_fft_cost_setting();
+}
+
+/**
+ * Set the relative cost of Fourier convolutions, used to choose
+ * between direct and Fourier convolutions.
+ * \see calibrate_convolution
+ */
+inline void set_convolution_fft_cost(double cost)
+{
+  convolution_fft_cost_setting() = cost;
+}
+
+/**
+ * Size of a convolution result along a dimension.
+ */
+inline std::size_t convolution_size(std::size_t len, std::size_t klen,
+				    ConvolutionMode mode)
+{
+  switch (mode) {
+  case ConvolutionMode::FULL:
+    return len + klen - 1;
+  case ConvolutionMode::VALID:
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (len < klen)
+      throw std::length_error("kernel larger than the input in valid convolution");
+#endif
+    return len - klen + 1;
+  default:
+    return len;
+  }
+}
+
+/**
+ * Position in the full convolution of the first result.
+ */
+inline std::size_t convolution_offset(std::size_t klen, ConvolutionMode mode)
+{
+  switch (mode) {
+  case ConvolutionMode::FULL:
+    return 0;
+  case ConvolutionMode::VALID:
+    return klen - 1;
+  default:
+    return klen / 2;
+  }
+}
+
+/**
+ * Factors of a separable kernel, if its elements are the products of
+ * the elements of 1D kernels along each dimension.
+ */
+template <typename T, std::size_t N>
+bool separable_factors(const StridedArray<T,N>& kernel,
+		       std::array<std::vector<T>,N>& factors)
+{
+  // Pivot on the largest element
+  std::array<std::size_t,N> pivot;
+  T max = 0;
+  kernel.map([&](const auto& coords, auto val) {
+      if (std::abs(val) > max) {
+	max = std::abs(val);
+	pivot = coords;
+      }
+    });
+  if (max == 0)
+    return false;
+
+  const T p = kernel(pivot);
+  for (std::size_t d = 0; d < N; d++) {
+    factors[d].resize(kernel.dim(d));
+    auto c = pivot;
+    for (std::size_t i = 0; i < kernel.dim(d); i++) {
+      c[d] = i;
+      factors[d][i] = kernel(c);
+    }
+  }
+  // h(c) = Π u_d(c_d) / p^(N-1)
+  for (std::size_t i = 0; i < kernel.dim(0); i++)
+    factors[0][i] /= std::pow(p, static_cast<T>(N-1));
+
+  const T tol = 64 * std::numeric_limits<T>::epsilon() * max;
+  bool separable = true;
+  kernel.map([&](const auto& coords, auto val) {
+      T prod = 1;
+      for (std::size_t d = 0; d < N; d++)
+	prod *= factors[d][coords[d]];
+      if (std::abs(prod - val) > tol)
+	separable = false;
+    });
+  return separable;
+}
+
+/**
+ * Direct convolution along an axis with a 1D kernel.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> convolve_axis(const StridedArray<T,N>& input,
+				const std::vector<T>& kernel, std::size_t axis,
+				ConvolutionMode mode, Boundary boundary, T value)
+{
+  const auto k = kernel.size();
+  const auto len = input.dim(axis);
+  auto odims = input.dims();
+  odims[axis] = convolution_size(len, k, mode);
+  const auto olen = odims[axis];
+  StridedArray<T,N> res(odims);
+
+  // Correlation with the flipped kernel: out[n] = Σ g[j] x[n+j+first]
+  const std::vector<T> g(kernel.rbegin(), kernel.rend());
+  const auto first = static_cast<std::ptrdiff_t>(convolution_offset(k, mode))
+    - static_cast<std::ptrdiff_t>(k - 1);
+
+  std::vector<std::size_t> in_offsets, out_offsets;
+  line_offsets(input, axis, in_offsets);
+  line_offsets(res, axis, out_offsets);
+  const T* in = input.data();
+  T* out = res.data();
+  const auto is = input.strides()[axis];
+  const auto os = res.strides()[axis];
+
+  parallel_for(in_offsets.size(), [&](std::size_t begin, std::size_t end) {
+      std::vector<T> buf(olen + k - 1), acc(olen);
+      for (std::size_t l = begin; l < end; l++) {
+	extend_line(in + in_offsets[l], is, len, first, buf.size(), buf.data(),
+		    boundary, value);
+	std::fill(acc.begin(), acc.end(), static_cast<T>(0));
+	T* a = acc.data();
+	for (std::size_t j = 0; j < k; j++) {
+	  const T gj = g[j];
+	  const T* src = buf.data() + j;
+	  for (std::size_t n = 0; n < olen; n++)
+	    a[n] += gj * src[n];
+	}
+	T* o = out + out_offsets[l];
+	for (std::size_t n = 0; n < olen; n++)
+	  o[n*os] = a[n];
+      }
+    }, std::max<std::size_t>(1, 8192 / std::max<std::size_t>(olen*k, 1)));
+
+  return res;
+}
+
+/**
+ * Direct convolution of a separable kernel, as successive 1D
+ * convolutions from a given dimension.
+ *
+ * The constant boundary value of each convolution is the result of
+ * the previous ones on a constant input.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> convolve_separable(const StridedArray<T,N>& input,
+				     const std::array<std::vector<T>,N>& factors,
+				     std::size_t dim, ConvolutionMode mode,
+				     Boundary boundary, T value)
+{
+  auto res = convolve_axis(input, factors[dim], dim, mode, boundary, value);
+  if (dim + 1 == N)
+    return res;
+  value *= std::accumulate(factors[dim].begin(), factors[dim].end(), static_cast<T>(0));
+  return convolve_separable(res, factors, dim + 1, mode, boundary, value);
+}
+
+/**
+ * Extend an array beyond its bounds, so that a convolution result is
+ * a correlation of the extended array with the flipped kernel.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> convolution_extension(const StridedArray<T,N>& input,
+					const std::array<std::size_t,N>& kdims,
+					ConvolutionMode mode,
+					Boundary boundary, T value)
+{
+  std::array<std::size_t,N> edims;
+  std::array<std::ptrdiff_t,N> first;
+  for (std::size_t d = 0; d < N; d++) {
+    edims[d] = convolution_size(input.dim(d), kdims[d], mode) + kdims[d] - 1;
+    first[d] = static_cast<std::ptrdiff_t>(convolution_offset(kdims[d], mode))
+      - static_cast<std::ptrdiff_t>(kdims[d] - 1);
+  }
+  StridedArray<T,N> ext(edims);
+
+  std::vector<std::size_t> ext_offsets;
+  line_offsets(ext, N-1, ext_offsets);
+  auto ldims = edims;
+  ldims[N-1] = 1;
+  const auto lstrides = default_strides(ldims);
+  const T* in = input.data();
+  T* e = ext.data();
+
+  parallel_for(ext_offsets.size(), [&](std::size_t begin, std::size_t end) {
+      for (std::size_t l = begin; l < end; l++) {
+	const auto coords = strided_index_to_coords(l, lstrides);
+	std::size_t off = 0;
+	bool inside = true;
+	for (std::size_t d = 0; d + 1 < N; d++) {
+	  auto idx = boundary_index(static_cast<std::ptrdiff_t>(coords[d]) + first[d],
+				    input.dim(d), boundary);
+	  inside = inside && idx < input.dim(d);
+	  off += idx * input.strides()[d];
+	}
+	T* dst = e + ext_offsets[l];
+	if (inside)
+	  extend_line(in + off, input.strides()[N-1], input.dim(N-1),
+		      first[N-1], edims[N-1], dst, boundary, value);
+	else
+	  std::fill(dst, dst + edims[N-1], value);
+      }
+    }, std::max<std::size_t>(1, 4096 / edims[N-1]));
+
+  return ext;
+}
+
+/**
+ * Direct convolution of a non-separable kernel.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> convolve_direct(const StridedArray<T,N>& input,
+				  const StridedArray<T,N>& kernel,
+				  ConvolutionMode mode, Boundary boundary, T value)
+{
+  auto ext = convolution_extension(input, kernel.dims(), mode, boundary, value);
+  std::array<std::size_t,N> odims;
+  for (std::size_t d = 0; d < N; d++)
+    odims[d] = ext.dim(d) - kernel.dim(d) + 1;
+  StridedArray<T,N> res(odims);
+
+  // Non-zero taps of the flipped kernel, as offsets in the extension
+  std::vector<std::size_t> taps;
+  std::vector<T> weights;
+  kernel.map([&](const auto& coords, auto val) {
+      if (val == 0)
+	return;
+      std::size_t off = 0;
+      for (std::size_t d = 0; d < N; d++)
+	off += (kernel.dim(d) - 1 - coords[d]) * ext.strides()[d];
+      taps.push_back(off);
+      weights.push_back(val);
+    });
+
+  std::vector<std::size_t> out_offsets;
+  line_offsets(res, N-1, out_offsets);
+  auto ldims = odims;
+  ldims[N-1] = 1;
+  const auto lstrides = default_strides(ldims);
+  const auto olen = odims[N-1];
+  const T* e = ext.data();
+  T* out = res.data();
+
+  parallel_for(out_offsets.size(), [&](std::size_t begin, std::size_t end) {
+      std::vector<T> acc(olen);
+      for (std::size_t l = begin; l < end; l++) {
+	const auto coords = strided_index_to_coords(l, lstrides);
+	std::size_t base = 0;
+	for (std::size_t d = 0; d + 1 < N; d++)
+	  base += coords[d] * ext.strides()[d];
+	// Accumulate whole lines for each tap, in vectorizable loops
+	std::fill(acc.begin(), acc.end(), static_cast<T>(0));
+	T* a = acc.data();
+	for (std::size_t t = 0; t < taps.size(); t++) {
+	  const T w = weights[t];
+	  const T* src = e + base + taps[t];
+	  for (std::size_t n = 0; n < olen; n++)
+	    a[n] += w * src[n];
+	}
+	std::copy(acc.begin(), acc.end(), out + out_offsets[l]);
+      }
+    }, std::max<std::size_t>(1, 8192 / std::max<std::size_t>(olen*taps.size(), 1)));
+
+  return res;
+}
+
+/**
+ * Estimated costs of the direct and Fourier convolutions, in direct
+ * multiply-adds.
+ */
+template <typename T, std::size_t N>
+std::pair<double,double> convolution_costs(const StridedArray<T,N>& input,
+					   const StridedArray<T,N>& kernel,
+					   ConvolutionMode mode, bool separable)
+{
+  double out = 1, taps = separable ? 0 : 1, fft = 1;
+  for (std::size_t d = 0; d < N; d++) {
+    const auto k = kernel.dim(d);
+    const auto olen = convolution_size(input.dim(d), k, mode);
+    out *= olen;
+    if (separable)
+      taps += k;
+    else
+      taps *= k;
+    // Padded dimensions of the Fourier convolution of the extension
+    fft *= olen + 2*k - 2;
+  }
+  return std::make_pair(out * taps,
+			convolution_fft_cost() * fft * std::log2(std::max(fft, 2.0)));
+}
+
+/**
+ * Convolve an array with a kernel.
+ *
+ * Small kernels are applied directly, separable ones as successive
+ * 1D convolutions along each dimension, while large ones are
+ * multiplied in the Fourier domain when FFTW is available.
+ *
+ * \param mode      Extent of the result.
+ * \param boundary  Values of the input outside its bounds.
+ * \param value     Value outside the bounds for constant boundaries.
+ * \param method    Convolution algorithm.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> convolve(const StridedArray<T,N>& input,
+			   const StridedArray<T,N>& kernel,
+			   ConvolutionMode mode = ConvolutionMode::SAME,
+			   Boundary boundary = Boundary::CONSTANT,
+			   T value = 0,
+			   ConvolutionMethod method = ConvolutionMethod::AUTO)
+{
+  static_assert( std::is_floating_point<T>::value,
+		 "convolutions require floating point elements" );
+  for (std::size_t d = 0; d < N; d++) {
+    convolution_size(input.dim(d), kernel.dim(d), mode);
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (input.dim(d) == 0 || kernel.dim(d) == 0)
+      throw std::length_error("cannot convolve empty arrays");
+#endif
+  }
+
+  std::array<std::vector<T>,N> factors;
+  const bool separable = N > 1 && method != ConvolutionMethod::FFT
+    && separable_factors(kernel, factors);
+
+#ifdef HAVE_FFTW
+  if (method == ConvolutionMethod::AUTO) {
+    auto costs = convolution_costs(input, kernel, mode, separable);
+    method = costs.second < costs.first ? ConvolutionMethod::FFT
+      : ConvolutionMethod::DIRECT;
+  }
+  if (method == ConvolutionMethod::FFT) {
+    // Full convolution of the extension, restricted to the result.
+    // The convolver pads singleton dimensions, unlike fftconvolve.
+    auto ext = convolution_extension(input, kernel.dims(), mode, boundary, value);
+    StridedArray<T,N> full(ext.dims());
+    Convolver<T,N>(kernel, ext.dims()).apply(ext, full);
+    std::array<std::array<std::size_t,3>,N> scs;
+    for (std::size_t d = 0; d < N; d++) {
+      scs[d][0] = kernel.dim(d) - 1 - kernel.dim(d)/2;
+      scs[d][1] = ext.dim(d) - kernel.dim(d) + 1;
+      scs[d][2] = 1;
+    }
+    return full.slice(Slice<std::size_t,N>(scs)).copy();
+  }
+#endif
+
+  if (! separable)
+    return convolve_direct(input, kernel, mode, boundary, value);
+
+  return convolve_separable(input, factors, 0, mode, boundary, value);
+}
+
+#ifdef HAVE_FFTW
+/**
+ * Measure the relative cost of Fourier convolutions on this host, and
+ * use it to choose between direct and Fourier convolutions.
+ *
+ * \param size   Size of the square images convolved.
+ * \param ksize  Size of the square kernel.
+ * \return The measured cost, also given to set_convolution_fft_cost().
+ */
+inline double calibrate_convolution(std::size_t size = 256, std::size_t ksize = 9)
+{
+  StridedArray<double,2> a(size, size), k(ksize, ksize);
+  a.map([](const auto& c, auto& val) { val = std::sin(0.1*c[0] + 0.3*c[1]); });
+  k.map([](const auto& c, auto& val) { val = 1 + (c[0]*c[1]) % 3; });
+
+  // Best of a few runs, the first one creating the plans
+  auto time = [&](ConvolutionMethod method) {
+    double best = std::numeric_limits<double>::max();
+    for (int r = 0; r < 4; r++) {
+      auto start = std::chrono::steady_clock::now();
+      auto res = convolve(a, k, ConvolutionMode::SAME, Boundary::CONSTANT, 0.0, method);
+      std::chrono::duration<double> dt = std::chrono::steady_clock::now() - start;
+      best = std::min(best, dt.count());
+    }
+    return best;
+  };
+  const auto direct = time(ConvolutionMethod::DIRECT);
+  const auto fft = time(ConvolutionMethod::FFT);
+
+  const auto costs = convolution_costs(a, k, ConvolutionMode::SAME, false);
+  const auto cost = (fft / (costs.second / convolution_fft_cost()))
+    / (direct / costs.first);
+  set_convolution_fft_cost(cost);
+  return cost;
+}
+#endif // HAVE_FFTW
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -9,213 +9,1056 @@
 
 #include <fftw3.h>
 
+#include <array>
 #include <complex>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <tuple>
 #include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+#include "../delayed/transforms.h"
 
 
 namespace necomi {
 
-/** Discrete Fourier transform of a 1D array of complex numbers. */
+/**
+ * Amount of work spent by FFTW to find fast plans.
+ *
+ * Plans are created once per transform layout and cached, so slower
+ * planning pays off for repeated transforms of the same shape. Only
+ * ESTIMATE planning is fast enough for one-shot transforms.
+ */
+enum class FFTPlanning
+{
+  ESTIMATE,
+  MEASURE,
+  PATIENT,
+  EXHAUSTIVE,
+};
+
+/// Storage for the planning rigor of new plans.
+inline FFTPlanning& fft_planning_setting()
+{
+  static FFTPlanning planning = FFTPlanning::ESTIMATE;
+  return planning;
+}
+
+/// Planning rigor used for new FFT plans.
+inline FFTPlanning fft_planning()
+{
+  return fft_planning_setting();
+}
+
+/**
+ * Set the planning rigor used for new FFT plans.
+ * Plans already cached with another rigor are kept.
+ */
+inline void set_fft_planning(FFTPlanning planning)
+{
+  fft_planning_setting() = planning;
+}
+
+/// FFTW flags corresponding to a planning rigor.
+inline unsigned fftw_planning_flags(FFTPlanning planning)
+{
+  switch (planning) {
+  case FFTPlanning::MEASURE:
+    return FFTW_MEASURE;
+  case FFTPlanning::PATIENT:
+    return FFTW_PATIENT;
+  case FFTPlanning::EXHAUSTIVE:
+    return FFTW_EXHAUSTIVE;
+  default:
+    return FFTW_ESTIMATE;
+  }
+}
+
+/// Storage for the number of threads used by new FFT plans.
+inline std::size_t& fft_threads_setting()
+{
+  static std::size_t n = 1;
+  return n;
+}
+
+/**
+ * Number of threads used by new FFT plans.
+ * Always 1 unless FFTW threads are available.
+ */
+inline std::size_t fft_threads()
+{
+#ifdef HAVE_FFTW_THREADS
+  auto n = fft_threads_setting();
+  return n == 0 ? num_threads() : n;
+#else
+  return 1;
+#endif
+}
+
+/**
+ * Set the number of threads used by new FFT plans.
+ *
+ * Large multi-dimensional transforms can be split among several
+ * threads, while small ones are faster on a single thread, the
+ * default. A value of 0 uses num_threads().
+ */
+inline void set_fft_threads(std::size_t n)
+{
+  fft_threads_setting() = n;
+}
+
+/**
+ * Mutex protecting the FFTW planner.
+ *
+ * Apart from the execution of existing plans, FFTW functions are not
+ * thread-safe and must hold this mutex.
+ */
+inline std::mutex& fftw_planner_mutex()
+{
+  static std::mutex m;
+  return m;
+}
+
+/**
+ * FFTW functions for a given floating point type, dispatching to the
+ * fftwf_, fftw_ and fftwl_ libraries for float, double and long double.
+ */
+template <typename T>
+struct fftw_api;
+
+#define NECOMI_DEFINE_FFTW_API(T, X)					\
+  template <>								\
+  struct fftw_api<T>							\
+  {									\
+    using plan = X ## plan;						\
+    using complex = X ## complex;					\
+									\
+    template <typename ...Args>						\
+    static plan plan_guru64_dft(Args... args)				\
+    { return X ## plan_guru64_dft(args...); }				\
+    template <typename ...Args>						\
+    static plan plan_guru64_dft_r2c(Args... args)			\
+    { return X ## plan_guru64_dft_r2c(args...); }			\
+    template <typename ...Args>						\
+    static plan plan_guru64_dft_c2r(Args... args)			\
+    { return X ## plan_guru64_dft_c2r(args...); }			\
+    static void execute_dft(plan p, complex* in, complex* out)		\
+    { X ## execute_dft(p, in, out); }					\
+    static void execute_dft_r2c(plan p, T* in, complex* out)		\
+    { X ## execute_dft_r2c(p, in, out); }				\
+    static void execute_dft_c2r(plan p, complex* in, T* out)		\
+    { X ## execute_dft_c2r(p, in, out); }				\
+    static void destroy_plan(plan p)					\
+    { X ## destroy_plan(p); }						\
+    static int alignment_of(T* p)					\
+    { return X ## alignment_of(p); }					\
+    static void* malloc(std::size_t n)					\
+    { return X ## malloc(n); }						\
+    static void free(void* p)						\
+    { X ## free(p); }							\
+    static int import_wisdom_from_filename(const char* path)		\
+    { return X ## import_wisdom_from_filename(path); }			\
+    static int export_wisdom_to_filename(const char* path)		\
+    { return X ## export_wisdom_to_filename(path); }			\
+    NECOMI_DEFINE_FFTW_THREADS_API(X)					\
+  };
+
+#ifdef HAVE_FFTW_THREADS
+#define NECOMI_DEFINE_FFTW_THREADS_API(X)				\
+    static int init_threads()						\
+    { return X ## init_threads(); }					\
+    static void plan_with_nthreads(int n)				\
+    { X ## plan_with_nthreads(n); }
+#else
+#define NECOMI_DEFINE_FFTW_THREADS_API(X)
+#endif
+
+NECOMI_DEFINE_FFTW_API(float, fftwf_)
+NECOMI_DEFINE_FFTW_API(double, fftw_)
+NECOMI_DEFINE_FFTW_API(long double, fftwl_)
+
+#undef NECOMI_DEFINE_FFTW_THREADS_API
+#undef NECOMI_DEFINE_FFTW_API
+
+/**
+ * Kind of Fourier transform.
+ */
+enum class FFTKind
+{
+  /// Complex to complex forward transform.
+  FORWARD,
+  /// Complex to complex backward transform.
+  BACKWARD,
+  /// Real to complex forward transform.
+  REAL_FORWARD,
+  /// Complex to real backward transform.
+  REAL_BACKWARD,
+};
+
+/**
+ * Memory layout of a transform, as given to FFTW guru interface.
+ *
+ * Each dimension has a logical size and input and output strides in
+ * elements. For real transforms, the size of the last transformed
+ * dimension is the one of the real array.
+ */
+struct FFTLayout
+{
+  FFTKind kind;
+  std::vector<fftw_iodim64> dims;
+  std::vector<fftw_iodim64> batch;
+  bool inplace;
+  /// Number of threads executing the transform.
+  int threads;
+  /// FFTW alignments of the input and output arrays.
+  int in_alignment, out_alignment;
+  unsigned flags;
+
+protected:
+  auto key() const
+  {
+    return std::make_tuple(kind, inplace, threads, in_alignment, out_alignment, flags,
+			   iodims_key(dims), iodims_key(batch));
+  }
+
+  static std::vector<std::ptrdiff_t> iodims_key(const std::vector<fftw_iodim64>& d)
+  {
+    std::vector<std::ptrdiff_t> k;
+    k.reserve(3*d.size());
+    for (auto& x : d) {
+      k.push_back(x.n);
+      k.push_back(x.is);
+      k.push_back(x.os);
+    }
+    return k;
+  }
+
+public:
+  bool operator<(const FFTLayout& o) const
+  {
+    return key() < o.key();
+  }
+};
+
+/**
+ * Number of elements spanned by a transform input or output.
+ */
+inline std::size_t fft_extent(const FFTLayout& layout, bool input)
+{
+  std::size_t extent = 1;
+  auto add = [&](const fftw_iodim64& d, std::ptrdiff_t n) {
+    extent += (n - 1) * (input ? d.is : d.os);
+  };
+  for (auto& d : layout.batch)
+    add(d, d.n);
+  for (std::size_t i = 0; i < layout.dims.size(); i++) {
+    auto n = layout.dims[i].n;
+    // Complex side of a real transform
+    if (i + 1 == layout.dims.size()
+	&& ((layout.kind == FFTKind::REAL_FORWARD && ! input)
+	    || (layout.kind == FFTKind::REAL_BACKWARD && input)))
+      n = n/2 + 1;
+    add(layout.dims[i], n);
+  }
+  return extent;
+}
+
+/**
+ * Thread-safe cache of FFTW plans indexed by transform layout.
+ *
+ * Plans are executed on new arrays with FFTW new-array execute
+ * functions, which only require the arrays to have the layout and
+ * alignment the plan was created with.
+ */
+template <typename T>
+class FFTPlanCache
+{
+public:
+  using api = fftw_api<T>;
+  using plan_type = typename api::plan;
+
+  FFTPlanCache() = default;
+  FFTPlanCache(const FFTPlanCache&) = delete;
+  FFTPlanCache& operator=(const FFTPlanCache&) = delete;
+
+  ~FFTPlanCache()
+  {
+    clear();
+  }
+
+  /**
+   * Retrieve or create the plan for a given layout.
+   * \param in   Input array, only used with ESTIMATE planning.
+   * \param out  Output array, only used with ESTIMATE planning.
+   */
+  plan_type plan(const FFTLayout& layout, void* in, void* out)
+  {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+    auto it = m_plans.find(layout);
+    if (it != m_plans.end())
+      return it->second;
+
+    plan_type p;
+    if (layout.flags & FFTW_ESTIMATE) {
+      // Estimated planning does not touch the arrays
+      p = create(layout, in, out);
+    }
+    else {
+      // Other planners overwrite their arrays, use scratch ones with
+      // the same alignment instead
+      const auto in_bytes = fft_extent(layout, true) * element_size(layout, true);
+      const auto out_bytes = fft_extent(layout, false) * element_size(layout, false);
+      const std::size_t pad = 64;
+      if (layout.inplace) {
+	auto buf = static_cast<char*>(api::malloc(std::max(in_bytes, out_bytes) + pad));
+	p = create(layout, buf + layout.in_alignment, buf + layout.in_alignment);
+	api::free(buf);
+      }
+      else {
+	auto ibuf = static_cast<char*>(api::malloc(in_bytes + pad));
+	auto obuf = static_cast<char*>(api::malloc(out_bytes + pad));
+	p = create(layout, ibuf + layout.in_alignment, obuf + layout.out_alignment);
+	api::free(ibuf);
+	api::free(obuf);
+      }
+    }
+
+    if (p == nullptr)
+      throw std::runtime_error("FFTW could not create a plan");
+    m_plans.emplace(layout, p);
+    return p;
+  }
+
+  /**
+   * Create a plan outside of the cache, to be released with
+   * destroy_plan() by its owner.
+   *
+   * Unless planning with ESTIMATE, the arrays are overwritten.
+   */
+  static plan_type create_plan(const FFTLayout& layout, void* in, void* out)
+  {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+    auto p = create(layout, in, out);
+    if (p == nullptr)
+      throw std::runtime_error("FFTW could not create a plan");
+    return p;
+  }
+
+  /// Release a plan created with create_plan().
+  static void destroy_plan(plan_type p)
+  {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+    api::destroy_plan(p);
+  }
+
+  /// Number of cached plans.
+  std::size_t size() const
+  {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+    return m_plans.size();
+  }
+
+  /**
+   * Destroy all the cached plans.
+   * No transform should be running concurrently.
+   */
+  void clear()
+  {
+    std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+    for (auto& kv : m_plans)
+      api::destroy_plan(kv.second);
+    m_plans.clear();
+  }
+
+protected:
+  static std::size_t element_size(const FFTLayout& layout, bool input)
+  {
+    if ((layout.kind == FFTKind::REAL_FORWARD && input)
+	|| (layout.kind == FFTKind::REAL_BACKWARD && ! input))
+      return sizeof(T);
+    return sizeof(typename api::complex);
+  }
+
+  /// Create a plan, the planner mutex being locked.
+  static plan_type create(const FFTLayout& layout, void* in, void* out)
+  {
+#ifdef HAVE_FFTW_THREADS
+    static const bool threads_ready = api::init_threads() != 0;
+    api::plan_with_nthreads(threads_ready ? layout.threads : 1);
+#endif
+
+    const int rank = static_cast<int>(layout.dims.size());
+    const int batch_rank = static_cast<int>(layout.batch.size());
+    switch (layout.kind) {
+    case FFTKind::REAL_FORWARD:
+      return api::plan_guru64_dft_r2c(rank, layout.dims.data(),
+				      batch_rank, layout.batch.data(),
+				      static_cast<T*>(in),
+				      static_cast<typename api::complex*>(out),
+				      layout.flags);
+    case FFTKind::REAL_BACKWARD:
+      return api::plan_guru64_dft_c2r(rank, layout.dims.data(),
+				      batch_rank, layout.batch.data(),
+				      static_cast<typename api::complex*>(in),
+				      static_cast<T*>(out),
+				      layout.flags);
+    default:
+      return api::plan_guru64_dft(rank, layout.dims.data(),
+				  batch_rank, layout.batch.data(),
+				  static_cast<typename api::complex*>(in),
+				  static_cast<typename api::complex*>(out),
+				  layout.kind == FFTKind::FORWARD ? FFTW_FORWARD : FFTW_BACKWARD,
+				  layout.flags);
+    }
+  }
+
+  std::map<FFTLayout,plan_type> m_plans;
+};
+
+/// Global cache of FFT plans for a given floating point type.
+template <typename T=double>
+FFTPlanCache<T>& fft_plan_cache()
+{
+  static FFTPlanCache<T> cache;
+  return cache;
+}
+
+/**
+ * Load FFTW wisdom from a file, so that plans created later can skip
+ * expensive planning.
+ * Each floating point type has its own wisdom.
+ */
+template <typename T=double>
+void import_fft_wisdom(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+  if (! fftw_api<T>::import_wisdom_from_filename(path.c_str()))
+    throw std::runtime_error("could not import FFTW wisdom from " + path);
+}
+
+/**
+ * Save the FFTW wisdom accumulated by planning into a file.
+ */
+template <typename T=double>
+void export_fft_wisdom(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(fftw_planner_mutex());
+  if (! fftw_api<T>::export_wisdom_to_filename(path.c_str()))
+    throw std::runtime_error("could not export FFTW wisdom to " + path);
+}
+
+/**
+ * Smallest size not lower than n that FFTW transforms efficiently,
+ * having no prime factor above 7.
+ */
+inline std::size_t fft_fast_size(std::size_t n)
+{
+  if (n <= 1)
+    return 1;
+  for (;; n++) {
+    auto m = n;
+    for (std::size_t p : {2, 3, 5, 7})
+      while (m % p == 0)
+	m /= p;
+    if (m <= 1)
+      return n;
+  }
+}
+
+/**
+ * Transform dimensions of strided input and output arrays.
+ * \param dims  Logical dimensions of the transform.
+ */
+template <std::size_t N>
+std::vector<fftw_iodim64> fft_iodims(const std::array<std::size_t,N>& dims,
+				     const std::array<std::size_t,N>& in_strides,
+				     const std::array<std::size_t,N>& out_strides)
+{
+  std::vector<fftw_iodim64> res(N);
+  for (std::size_t i = 0; i < N; i++) {
+    res[i].n = static_cast<std::ptrdiff_t>(dims[i]);
+    res[i].is = static_cast<std::ptrdiff_t>(in_strides[i]);
+    res[i].os = static_cast<std::ptrdiff_t>(out_strides[i]);
+  }
+  return res;
+}
+
+/**
+ * Execute a transform of T elements with a cached plan.
+ */
+template <typename T>
+void execute_fft(FFTKind kind, std::vector<fftw_iodim64> dims,
+		 std::vector<fftw_iodim64> batch,
+		 void* in, void* out)
+{
+  using api = fftw_api<T>;
+  using complex = typename api::complex;
+  FFTLayout layout{kind, std::move(dims), std::move(batch), in == out,
+      static_cast<int>(fft_threads()),
+      api::alignment_of(static_cast<T*>(in)),
+      api::alignment_of(static_cast<T*>(out)),
+      fftw_planning_flags(fft_planning())};
+  auto p = fft_plan_cache<T>().plan(layout, in, out);
+
+  switch (kind) {
+  case FFTKind::REAL_FORWARD:
+    api::execute_dft_r2c(p, static_cast<T*>(in), static_cast<complex*>(out));
+    break;
+  case FFTKind::REAL_BACKWARD:
+    api::execute_dft_c2r(p, static_cast<complex*>(in), static_cast<T*>(out));
+    break;
+  default:
+    api::execute_dft(p, static_cast<complex*>(in), static_cast<complex*>(out));
+  }
+}
+
+/**
+ * Scale all the elements of an array.
+ */
+template <typename T, std::size_t N, typename U>
+void scale_elements(StridedArray<T,N>& a, U factor)
+{
+  if (a.contiguous()) {
+    T* p = a.data();
+    for (std::size_t i = 0; i < size(a); i++)
+      p[i] *= factor;
+  }
+  else {
+    a.map([factor](const auto&, auto& val) { val *= factor; });
+  }
+}
+
+/**
+ * Make sure the output of a transform has the expected dimensions.
+ */
 template <std::size_t N>
-StridedArray<std::complex<double>,N> fft(StridedArray<std::complex<double>,N>& a)
+void check_fft_output(const std::array<std::size_t,N>& dims,
+		      const std::array<std::size_t,N>& expected)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dims != expected)
+    throw std::length_error("invalid dimensions for the Fourier transform output");
+#else
+  (void) dims; (void) expected;
+#endif
+}
+
+/**
+ * Discrete Fourier transform of an array of complex numbers into
+ * an existing array.
+ *
+ * \c out may be \c a itself for an in-place transform.
+ */
+template <typename T, std::size_t N>
+void fft(const StridedArray<std::complex<T>,N>& a,
+	 StridedArray<std::complex<T>,N>& out)
 {
   static_assert( N >= 1,
 		 "scalar arrays are not Fourier transformable" );
-  
-  StridedArray<std::complex<double>,N> res(a.dims());
-  fftw_plan p;
-
-  if (N == 1)
-    p = fftw_plan_dft_1d(a.dim(0),
-			 reinterpret_cast<fftw_complex*>(a.data()),
-			 reinterpret_cast<fftw_complex*>(res.data()),
-			 FFTW_FORWARD, FFTW_ESTIMATE);
-  else if (N == 2)
-    p = fftw_plan_dft_2d(a.dim(0), a.dim(1),
-			 reinterpret_cast<fftw_complex*>(a.data()),
-			 reinterpret_cast<fftw_complex*>(res.data()),
-			 FFTW_FORWARD, FFTW_ESTIMATE);
-  else if (N == 3)
-    p = fftw_plan_dft_3d(a.dim(0), a.dim(1), a.dim(2),
-			 reinterpret_cast<fftw_complex*>(a.data()),
-			 reinterpret_cast<fftw_complex*>(res.data()),
-			 FFTW_FORWARD, FFTW_ESTIMATE);
-  else {
-    int dims[N];
-    for (int i = 0UL; i < a.ndim; i++)
-      dims[i] = a.dim(i);
-    p = fftw_plan_dft(N, dims,
-		      reinterpret_cast<fftw_complex*>(a.data()),
-		      reinterpret_cast<fftw_complex*>(res.data()),
-		      FFTW_FORWARD, FFTW_ESTIMATE);
-  }
-
-  fftw_execute(p);
-  fftw_destroy_plan(p);
-  
+  check_fft_output(out.dims(), a.dims());
+
+  execute_fft<T>(FFTKind::FORWARD, fft_iodims(a.dims(), a.strides(), out.strides()), {},
+	      const_cast<std::complex<T>*>(a.data()), out.data());
+}
+
+/** Discrete Fourier transform of an array of complex numbers. */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> fft(const StridedArray<std::complex<T>,N>& a)
+{
+  StridedArray<std::complex<T>,N> res(a.dims());
+  fft(a, res);
   return res;
 }
 
-/** Inverse Fourier transform of a contiguous array of complex numbers. */
-template <std::size_t N>
-StridedArray<std::complex<double>,N> ifft(StridedArray<std::complex<double>,N>& a)
+/**
+ * Inverse Fourier transform of an array of complex numbers into an
+ * existing array.
+ *
+ * \c out may be \c a itself for an in-place transform.
+ */
+template <typename T, std::size_t N>
+void ifft(const StridedArray<std::complex<T>,N>& a,
+	  StridedArray<std::complex<T>,N>& out)
 {
   static_assert( N >= 1,
 		 "scalar arrays are not Fourier transformable" );
-  
-  StridedArray<std::complex<double>,N> res(a.dims());
-  fftw_plan p;
-
-  if (N == 1)
-    p = fftw_plan_dft_1d(a.dim(0),
-			 reinterpret_cast<fftw_complex*>(a.data()),
-			 reinterpret_cast<fftw_complex*>(res.data()),
-			 FFTW_BACKWARD, FFTW_ESTIMATE);
-  else if (N == 2)
-    p = fftw_plan_dft_2d(a.dim(0), a.dim(1),
-			 reinterpret_cast<fftw_complex*>(a.data()),
-			 reinterpret_cast<fftw_complex*>(res.data()),
-			 FFTW_BACKWARD, FFTW_ESTIMATE);
-  else if (N == 3)
-    p = fftw_plan_dft_3d(a.dim(0), a.dim(1), a.dim(2),
-			 reinterpret_cast<fftw_complex*>(a.data()),
-			 reinterpret_cast<fftw_complex*>(res.data()),
-			 FFTW_BACKWARD, FFTW_ESTIMATE);
-  else {
-    int dims[N];
-    for (int i = 0UL; i < a.ndim; i++)
-      dims[i] = a.dim(i);
-    p = fftw_plan_dft(N, dims,
-		      reinterpret_cast<fftw_complex*>(a.data()),
-		      reinterpret_cast<fftw_complex*>(res.data()),
-		      FFTW_BACKWARD, FFTW_ESTIMATE);
-  }
-  
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+  check_fft_output(out.dims(), a.dims());
+
+  execute_fft<T>(FFTKind::BACKWARD, fft_iodims(a.dims(), a.strides(), out.strides()), {},
+	      const_cast<std::complex<T>*>(a.data()), out.data());
 
   // Normalize so that ifft(fft(a)) == a
-  res /= size(a);
-    
+  scale_elements(out, static_cast<T>(1) / size(a));
+}
+
+/** Inverse Fourier transform of an array of complex numbers. */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> ifft(const StridedArray<std::complex<T>,N>& a)
+{
+  StridedArray<std::complex<T>,N> res(a.dims());
+  ifft(a, res);
   return res;
 }
 
+/** In-place discrete Fourier transform of an array of complex numbers. */
+template <typename T, std::size_t N>
+void fft_inplace(StridedArray<std::complex<T>,N>& a)
+{
+  fft(a, a);
+}
 
+/** In-place inverse Fourier transform of an array of complex numbers. */
+template <typename T, std::size_t N>
+void ifft_inplace(StridedArray<std::complex<T>,N>& a)
+{
+  ifft(a, a);
+}
 
-/** Discrete Fourier transform of a 1D array of real numbers. */
-template <std::size_t N>
-StridedArray<std::complex<double>,N> rfft(StridedArray<double,N>& a)
+/**
+ * Discrete Fourier transform of an array of real numbers into an
+ * existing array.
+ *
+ * \c out must have the dimensions of \c a, except for the last one
+ * which holds a.dim(N-1)/2+1 non-negative frequencies.
+ */
+template <typename T, std::size_t N>
+void rfft(const StridedArray<T,N>& a,
+	  StridedArray<std::complex<T>,N>& out)
 {
   static_assert( N >= 1,
 		 "scalar arrays are not Fourier transformable" );
+  auto out_dims = a.dims();
+  out_dims[N-1] = out_dims[N-1]/2 + 1;
+  check_fft_output(out.dims(), out_dims);
 
+  execute_fft<T>(FFTKind::REAL_FORWARD, fft_iodims(a.dims(), a.strides(), out.strides()), {},
+	      const_cast<T*>(a.data()), out.data());
+}
+
+/**
+ * Discrete Fourier transform of an array of real numbers.
+ * Only the non-negative frequencies of the last dimension are kept.
+ */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> rfft(const StridedArray<T,N>& a)
+{
   auto res_dims = a.dims();
   res_dims[N-1] = res_dims[N-1]/2 + 1;
-  StridedArray<std::complex<double>,N> res(res_dims);
-  fftw_plan p;
-
-  if (N == 1)
-    p = fftw_plan_dft_r2c_1d(a.dim(0), a.data(),
-			     reinterpret_cast<fftw_complex*>(res.data()),
-			     FFTW_ESTIMATE);
-  else if (N == 2)
-    p = fftw_plan_dft_r2c_2d(a.dim(0), a.dim(1), a.data(),
-			     reinterpret_cast<fftw_complex*>(res.data()),
-			     FFTW_ESTIMATE);
-  else if (N == 3)
-    p = fftw_plan_dft_r2c_3d(a.dim(0), a.dim(1), a.dim(2), a.data(),
-			     reinterpret_cast<fftw_complex*>(res.data()),
-			     FFTW_ESTIMATE);
-  else {
-    int dims[N];
-    for (int i = 0UL; i < a.ndim; i++)
-      dims[i] = a.dim(i);
-    p = fftw_plan_dft_r2c(N, dims, a.data(),
-			  reinterpret_cast<fftw_complex*>(res.data()),
-			  FFTW_ESTIMATE);
-  }
-
-  fftw_execute(p);
-  fftw_destroy_plan(p);
-  
+  StridedArray<std::complex<T>,N> res(res_dims);
+  rfft(a, res);
   return res;
 }
 
-/** Inverse Fourier transform of a 1D array of real numbers. */
-template <std::size_t N>
-StridedArray<double,N> irfft(StridedArray<std::complex<double>,N>& a,
-			     std::size_t last_dim)
+/**
+ * Inverse Fourier transform of an array of real numbers into an
+ * existing array.
+ *
+ * As FFTW complex to real transforms, this overwrites the content of
+ * its input, but does not allocate any memory.
+ */
+template <typename T, std::size_t N>
+void irfft(StridedArray<std::complex<T>,N>& a, StridedArray<T,N>& out)
 {
   static_assert( N >= 1,
 		 "scalar arrays are not Fourier transformable" );
+  auto in_dims = out.dims();
+  in_dims[N-1] = in_dims[N-1]/2 + 1;
+  check_fft_output(a.dims(), in_dims);
 
+  execute_fft<T>(FFTKind::REAL_BACKWARD, fft_iodims(out.dims(), a.strides(), out.strides()), {},
+	      a.data(), out.data());
+
+  // Normalize so that irfft(rfft(a), a.dim(N-1)) == a
+  scale_elements(out, static_cast<T>(1) / size(out));
+}
+
+/**
+ * Inverse Fourier transform of an array of real numbers.
+ * \param last_dim  Size of the last dimension of the real array.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> irfft(const StridedArray<std::complex<T>,N>& a,
+			std::size_t last_dim)
+{
   auto res_dims = a.dims();
   res_dims[N-1] = last_dim;
-  StridedArray<double,N> res(res_dims);
-  fftw_plan p;
-
-  if (N == 1)
-    p = fftw_plan_dft_c2r_1d(res.dim(0),
-			     reinterpret_cast<fftw_complex*>(a.data()),
-			     res.data(), FFTW_ESTIMATE);
-  else if (N == 2)
-    p = fftw_plan_dft_c2r_2d(res.dim(0), res.dim(1),
-			     reinterpret_cast<fftw_complex*>(a.data()),
-			     res.data(), FFTW_ESTIMATE);
-  else if (N == 3)
-    p = fftw_plan_dft_c2r_3d(res.dim(0), res.dim(1), res.dim(2),
-			     reinterpret_cast<fftw_complex*>(a.data()),
-			     res.data(), FFTW_ESTIMATE);
-  else {
-    int dims[N];
-    for (int i = 0UL; i < a.ndim; i++)
-      dims[i] = res.dim(i);
-    p = fftw_plan_dft_c2r(N, dims,
-			  reinterpret_cast<fftw_complex*>(a.data()),
-			  res.data(), FFTW_ESTIMATE);
+  StridedArray<T,N> res(res_dims);
+
+  // Complex to real transforms destroy their input
+  auto tmp = a.copy();
+  irfft(tmp, res);
+  return res;
+}
+
+/**
+ * Split the dimensions of strided arrays into transformed ones, in the
+ * order of \c axes, and batch ones, over which independent transforms
+ * are computed.
+ */
+template <std::size_t M, std::size_t N>
+std::pair<std::vector<fftw_iodim64>,std::vector<fftw_iodim64>>
+fft_axes_iodims(const std::array<std::size_t,N>& dims,
+		const std::array<std::size_t,N>& in_strides,
+		const std::array<std::size_t,N>& out_strides,
+		const std::array<std::size_t,M>& axes)
+{
+  static_assert( M >= 1 && M <= N,
+		 "invalid number of Fourier transform axes" );
+  const auto all = fft_iodims(dims, in_strides, out_strides);
+  std::array<bool,N> transformed;
+  transformed.fill(false);
+  std::vector<fftw_iodim64> tdims, batch;
+  for (auto ax : axes) {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (ax >= N || transformed[ax])
+      throw std::out_of_range("invalid Fourier transform axes");
+#endif
+    transformed[ax] = true;
+    tdims.push_back(all[ax]);
   }
+  for (std::size_t i = 0; i < N; i++)
+    if (! transformed[i])
+      batch.push_back(all[i]);
+  return std::make_pair(std::move(tdims), std::move(batch));
+}
 
-  fftw_execute(p);
-  fftw_destroy_plan(p);
+/**
+ * Number of elements in each transform along given axes.
+ */
+template <std::size_t M, std::size_t N>
+std::size_t fft_axes_size(const std::array<std::size_t,N>& dims,
+			  const std::array<std::size_t,M>& axes)
+{
+  std::size_t n = 1;
+  for (auto ax : axes)
+    n *= dims[ax];
+  return n;
+}
 
-  // Normalize so that irfft(rfft(a), a.dim(N-1)) == a
-  res /= size(res);
-  
+/**
+ * Last of the transformed axes, whose size is halved in the complex
+ * array of real transforms.
+ */
+template <std::size_t N, std::size_t M>
+std::size_t fft_last_axis(const std::array<std::size_t,M>& axes)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (axes[M-1] >= N)
+    throw std::out_of_range("invalid Fourier transform axes");
+#endif
+  return axes[M-1];
+}
+
+/**
+ * Discrete Fourier transforms along given axes of an array of
+ * complex numbers, into an existing array.
+ *
+ * One transform is computed for each position along the other
+ * dimensions, in a single FFTW call using the actual array strides.
+ */
+template <typename T, std::size_t N, std::size_t M>
+void fft(const StridedArray<std::complex<T>,N>& a,
+	 StridedArray<std::complex<T>,N>& out,
+	 const std::array<std::size_t,M>& axes)
+{
+  check_fft_output(out.dims(), a.dims());
+  auto io = fft_axes_iodims(a.dims(), a.strides(), out.strides(), axes);
+  execute_fft<T>(FFTKind::FORWARD, std::move(io.first), std::move(io.second),
+		 const_cast<std::complex<T>*>(a.data()), out.data());
+}
+
+/** Discrete Fourier transforms along given axes. */
+template <typename T, std::size_t N, std::size_t M>
+StridedArray<std::complex<T>,N> fft(const StridedArray<std::complex<T>,N>& a,
+				    const std::array<std::size_t,M>& axes)
+{
+  StridedArray<std::complex<T>,N> res(a.dims());
+  fft(a, res, axes);
+  return res;
+}
+
+/** Discrete Fourier transforms along an axis, into an existing array. */
+template <typename T, std::size_t N>
+void fft(const StridedArray<std::complex<T>,N>& a,
+	 StridedArray<std::complex<T>,N>& out, std::size_t axis)
+{
+  fft(a, out, std::array<std::size_t,1>{{axis}});
+}
+
+/** Discrete Fourier transforms along an axis. */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> fft(const StridedArray<std::complex<T>,N>& a,
+				    std::size_t axis)
+{
+  return fft(a, std::array<std::size_t,1>{{axis}});
+}
+
+/**
+ * Normalized inverse Fourier transforms along given axes, into an
+ * existing array.
+ */
+template <typename T, std::size_t N, std::size_t M>
+void ifft(const StridedArray<std::complex<T>,N>& a,
+	  StridedArray<std::complex<T>,N>& out,
+	  const std::array<std::size_t,M>& axes)
+{
+  check_fft_output(out.dims(), a.dims());
+  auto io = fft_axes_iodims(a.dims(), a.strides(), out.strides(), axes);
+  execute_fft<T>(FFTKind::BACKWARD, std::move(io.first), std::move(io.second),
+		 const_cast<std::complex<T>*>(a.data()), out.data());
+  scale_elements(out, static_cast<T>(1) / fft_axes_size(a.dims(), axes));
+}
+
+/** Normalized inverse Fourier transforms along given axes. */
+template <typename T, std::size_t N, std::size_t M>
+StridedArray<std::complex<T>,N> ifft(const StridedArray<std::complex<T>,N>& a,
+				     const std::array<std::size_t,M>& axes)
+{
+  StridedArray<std::complex<T>,N> res(a.dims());
+  ifft(a, res, axes);
+  return res;
+}
+
+/** Normalized inverse Fourier transforms along an axis, into an existing array. */
+template <typename T, std::size_t N>
+void ifft(const StridedArray<std::complex<T>,N>& a,
+	  StridedArray<std::complex<T>,N>& out, std::size_t axis)
+{
+  ifft(a, out, std::array<std::size_t,1>{{axis}});
+}
+
+/** Normalized inverse Fourier transforms along an axis. */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> ifft(const StridedArray<std::complex<T>,N>& a,
+				     std::size_t axis)
+{
+  return ifft(a, std::array<std::size_t,1>{{axis}});
+}
+
+/**
+ * Discrete Fourier transforms along given axes of an array of real
+ * numbers, into an existing array.
+ *
+ * Only the non-negative frequencies of the last given axis are kept.
+ */
+template <typename T, std::size_t N, std::size_t M>
+void rfft(const StridedArray<T,N>& a,
+	  StridedArray<std::complex<T>,N>& out,
+	  const std::array<std::size_t,M>& axes)
+{
+  const auto last = fft_last_axis<N>(axes);
+  auto out_dims = a.dims();
+  out_dims[last] = out_dims[last]/2 + 1;
+  check_fft_output(out.dims(), out_dims);
+  auto io = fft_axes_iodims(a.dims(), a.strides(), out.strides(), axes);
+  execute_fft<T>(FFTKind::REAL_FORWARD, std::move(io.first), std::move(io.second),
+		 const_cast<T*>(a.data()), out.data());
+}
+
+/** Discrete Fourier transforms along given axes of an array of real numbers. */
+template <typename T, std::size_t N, std::size_t M>
+StridedArray<std::complex<T>,N> rfft(const StridedArray<T,N>& a,
+				     const std::array<std::size_t,M>& axes)
+{
+  const auto last = fft_last_axis<N>(axes);
+  auto res_dims = a.dims();
+  res_dims[last] = res_dims[last]/2 + 1;
+  StridedArray<std::complex<T>,N> res(res_dims);
+  rfft(a, res, axes);
+  return res;
+}
+
+/** Discrete Fourier transforms along an axis of an array of real numbers. */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> rfft(const StridedArray<T,N>& a, std::size_t axis)
+{
+  return rfft(a, std::array<std::size_t,1>{{axis}});
+}
+
+/**
+ * Inverse Fourier transforms along given axes of an array of real
+ * numbers, into an existing array.
+ *
+ * The input is overwritten, as for irfft(a, out).
+ */
+template <typename T, std::size_t N, std::size_t M>
+void irfft(StridedArray<std::complex<T>,N>& a, StridedArray<T,N>& out,
+	   const std::array<std::size_t,M>& axes)
+{
+  const auto last = fft_last_axis<N>(axes);
+  auto in_dims = out.dims();
+  in_dims[last] = in_dims[last]/2 + 1;
+  check_fft_output(a.dims(), in_dims);
+  auto io = fft_axes_iodims(out.dims(), a.strides(), out.strides(), axes);
+  execute_fft<T>(FFTKind::REAL_BACKWARD, std::move(io.first), std::move(io.second),
+		 a.data(), out.data());
+  scale_elements(out, static_cast<T>(1) / fft_axes_size(out.dims(), axes));
+}
+
+/**
+ * Inverse Fourier transforms along given axes of an array of real numbers.
+ * \param n  Size of the last given axis in the real array.
+ */
+template <typename T, std::size_t N, std::size_t M>
+StridedArray<T,N> irfft(const StridedArray<std::complex<T>,N>& a,
+			const std::array<std::size_t,M>& axes, std::size_t n)
+{
+  auto res_dims = a.dims();
+  res_dims[fft_last_axis<N>(axes)] = n;
+  StridedArray<T,N> res(res_dims);
+  auto tmp = a.copy();
+  irfft(tmp, res, axes);
   return res;
 }
 
+/**
+ * Inverse Fourier transforms along an axis of an array of real numbers.
+ * \param n  Size of the axis in the real array.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> irfft(const StridedArray<std::complex<T>,N>& a,
+			std::size_t axis, std::size_t n)
+{
+  return irfft(a, std::array<std::size_t,1>{{axis}}, n);
+}
+
+/**
+ * Create an array of real numbers whose memory can also hold its real
+ * Fourier transform.
+ *
+ * The last dimension is padded to 2*(n/2+1) elements, as required by
+ * rfft_inplace(), and the returned array is a view on the n first ones.
+ */
+template <std::size_t N, typename T=double>
+StridedArray<T,N> rfft_array(const std::array<std::size_t,N>& dims)
+{
+  static_assert( N >= 1,
+		 "scalar arrays are not Fourier transformable" );
+  auto pdims = dims;
+  pdims[N-1] = 2*(dims[N-1]/2 + 1);
+  StridedArray<T,N> a(pdims);
+  std::array<std::size_t,N> start, steps;
+  start.fill(0);
+  steps.fill(1);
+  return a.slice(Slice<std::size_t,N>(start, dims, steps));
+}
+
+/**
+ * Make sure a real array has the padded layout of in-place transforms.
+ */
 template <std::size_t N>
-StridedArray<double,N> fftconvolve(const StridedArray<double,N>& input,
-				   const StridedArray<double,N>& kernel)
+void check_rfft_inplace(const std::array<std::size_t,N>& strides,
+			std::size_t last_dim)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  bool valid = strides[N-1] == 1;
+  for (std::size_t i = 0; i + 1 < N; i++)
+    valid = valid && strides[i] % 2 == 0;
+  if (N > 1)
+    valid = valid && strides[N-2] >= 2*(last_dim/2 + 1);
+  if (! valid)
+    throw std::length_error("array layout does not allow in-place real Fourier transforms");
+#else
+  (void) strides; (void) last_dim;
+#endif
+}
+
+/**
+ * In-place discrete Fourier transform of an array of real numbers.
+ *
+ * The array must have the padded layout given by rfft_array(). The
+ * returned array of complex numbers is a view on the same memory.
+ */
+template <typename T, std::size_t N>
+StridedArray<std::complex<T>,N> rfft_inplace(StridedArray<T,N>& a)
+{
+  check_rfft_inplace(a.strides(), a.dim(N-1));
+
+  auto dims = a.dims();
+  dims[N-1] = dims[N-1]/2 + 1;
+  auto strides = a.strides();
+  for (std::size_t i = 0; i + 1 < N; i++)
+    strides[i] /= 2;
+  auto data = reinterpret_cast<std::complex<T>*>(a.data());
+  StridedArray<std::complex<T>,N> res(std::shared_ptr<std::complex<T>>(a.shared_data(), data),
+				      data, strides, dims);
+  rfft(a, res);
+  return res;
+}
+
+/**
+ * In-place inverse Fourier transform of an array of real numbers.
+ *
+ * This is the inverse of rfft_inplace(), returning a view of the
+ * padded memory as an array of real numbers.
+ * \param last_dim  Size of the last dimension of the real array.
+ */
+template <typename T, std::size_t N>
+StridedArray<T,N> irfft_inplace(StridedArray<std::complex<T>,N>& a,
+				std::size_t last_dim)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (a.strides()[N-1] != 1 || a.dim(N-1) != last_dim/2 + 1)
+    throw std::length_error("array layout does not allow in-place real Fourier transforms");
+#endif
+  auto dims = a.dims();
+  dims[N-1] = last_dim;
+  auto strides = a.strides();
+  for (std::size_t i = 0; i + 1 < N; i++)
+    strides[i] *= 2;
+  auto data = reinterpret_cast<T*>(a.data());
+  StridedArray<T,N> res(std::shared_ptr<T>(a.shared_data(), data),
+			data, strides, dims);
+  irfft(a, res);
+  return res;
+}
+
+template <typename T, std::size_t N>
+StridedArray<T,N> fftconvolve(const StridedArray<T,N>& input,
+			      const StridedArray<T,N>& kernel)
 {
   // Compute the padded dimensions
   auto pdims = input.dims();
   for (auto i = 0UL; i < N; i++)
     pdims[i] = 2*((input.dim(i) + kernel.dim(i))/2);
 
-  // Pad the input and kernel arrays
+  // Pad the input and kernel arrays, the kernel center being put in
+  // the middle so that the sign flip below centers the result
   auto pinput = strided(pad(input, pdims));
-  auto pkernel = strided(pad(kernel, pdims));
+  StridedArray<T,N> pkernel(pdims);
+  pkernel.fill(0);
+  kernel.map([&pkernel,&pdims,&kernel](const auto& coords, auto val) {
+      auto pos = coords;
+      for (auto i = 0UL; i < N; i++)
+	pos[i] += pdims[i]/2 - kernel.dim(i)/2;
+      pkernel(pos) = val;
+    });
 
-  // Compute the real Fourier tranforms of the input and kernel
-  // TODO: reuse at least the plan here
+  // Compute the real Fourier tranforms of the input and kernel, both
+  // sharing the same cached plan
   auto finput = rfft(pinput);
   auto fkernel = rfft(pkernel);
 
-  // Center the FFT
-  finput.map([](const auto& coords, auto& val) {
-      auto s = std::accumulate(coords.cbegin(), coords.cend(), 0);
-      auto sign = s % 2 == 0 ? 1 : -1;
-      val *= sign;
+  // Multiply the transformed signals, centering the result
+  const auto* fk = fkernel.data();
+  finput.map([fk,&finput](const auto& coords, auto& val) {
+      std::size_t s = 0, idx = 0;
+      for (auto i = 0UL; i < N; i++) {
+	s += coords[i];
+	idx += coords[i] * finput.strides()[i];
+      }
+      val *= (s % 2 == 0 ? static_cast<T>(1) : static_cast<T>(-1)) * fk[idx];
     });
 
-  // Multiply the transformed signals
-  auto fres = strided(finput * fkernel);
-
   // Convert back the transformed signal into the real domain
-  auto res = irfft(fres, pinput.dim(N-1));
+  auto res = irfft(finput, pinput.dim(N-1));
 
   // Remove the padding
   std::array<std::array<std::size_t,3>,N> scs;
@@ -224,10 +1067,10 @@ StridedArray<double,N> fftconvolve(const StridedArray<double,N>& input,
     scs[i][1] = input.dim(i);
     scs[i][2] = 1;
   }
-  
+
   return strided(res.slice(Slice<std::size_t,N>(scs)));
 }
-				   
+
 
 } // namespace necomi
 
@@ -0,0 +1,358 @@
+// necomi/numerics/histograms.h – Histograms and value counts
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+
+namespace necomi
+{
+
+/// Minimal number of elements counted by each histogram thread.
+constexpr std::size_t histogram_grain = 1UL << 16;
+
+/**
+ * Unsigned integral types small enough to be counted with one bin
+ * per possible value, such as 8 and 16 bits image pixels.
+ */
+template <typename T>
+struct is_directly_countable
+  : std::integral_constant<bool, std::is_unsigned<T>::value
+			   && ! std::is_same<T,bool>::value
+			   && sizeof(T) <= 2>
+{};
+
+/**
+ * Sum tables of counters stored every \c stride elements of \c counts,
+ * keeping only their first \c nbins counters.
+ */
+inline StridedArray<std::size_t,1>
+merge_counts(const std::vector<std::size_t>& counts, std::size_t ntables,
+	     std::size_t stride, std::size_t nbins)
+{
+  StridedArray<std::size_t,1> res(nbins);
+  auto* out = res.data();
+  const auto* in = counts.data();
+  parallel_for(nbins, [=](std::size_t begin, std::size_t end) {
+      for (std::size_t k = begin; k < end; k++)
+	out[k] = in[k];
+      for (std::size_t t = 1; t < ntables; t++) {
+	const auto* c = in + t*stride;
+	for (std::size_t k = begin; k < end; k++)
+	  out[k] += c[k];
+      }
+    }, histogram_grain / std::max<std::size_t>(ntables, 1));
+  return res;
+}
+
+/**
+ * Count the elements falling in each bin.
+ *
+ * \c bin maps an element index in [0,n) to its bin index in [0,nbins),
+ * or to \c nbins for elements to discard. Each thread fills its own
+ * private bins, which are summed once all the elements have been seen.
+ */
+template <typename BinFunction>
+StridedArray<std::size_t,1> parallel_counts(std::size_t n, std::size_t nbins,
+					    BinFunction bin)
+{
+  // An extra bin collects discarded elements without branching
+  const auto stride = nbins + 1;
+  const auto nblocks = parallel_blocks(n, histogram_grain);
+  std::vector<std::size_t> counts(nblocks * stride, 0);
+  parallel_for_blocks(n, [stride,&counts,&bin]
+		      (std::size_t b, std::size_t begin, std::size_t end) {
+      auto* c = counts.data() + b*stride;
+      for (std::size_t i = begin; i < end; i++)
+	c[bin(i)]++;
+    }, histogram_grain);
+
+  return merge_counts(counts, nblocks, stride, nbins);
+}
+
+/**
+ * Count the occurrences of every possible value in a buffer of small
+ * unsigned integers, by direct indexing.
+ *
+ * 8 bits values are spread over four interleaved tables, so that
+ * successive increments of the same bin do not wait on each other.
+ */
+template <typename T,
+	  std::enable_if_t<is_directly_countable<T>::value>* = nullptr>
+StridedArray<std::size_t,1> direct_counts(const T* x, std::size_t n)
+{
+  constexpr std::size_t nvalues = static_cast<std::size_t>(std::numeric_limits<T>::max()) + 1;
+  constexpr std::size_t lanes = sizeof(T) == 1 ? 4 : 1;
+  const auto nblocks = parallel_blocks(n, histogram_grain);
+  std::vector<std::size_t> counts(nblocks * lanes * nvalues, 0);
+  parallel_for_blocks(n, [x,&counts]
+		      (std::size_t b, std::size_t begin, std::size_t end) {
+      auto* c = counts.data() + b*lanes*nvalues;
+      std::size_t i = begin;
+      if (lanes == 4) {
+	for (; i + 4 <= end; i += 4) {
+	  c[x[i]]++;
+	  c[nvalues + x[i+1]]++;
+	  c[2*nvalues + x[i+2]]++;
+	  c[3*nvalues + x[i+3]]++;
+	}
+      }
+      for (; i < end; i++)
+	c[x[i]]++;
+    }, histogram_grain);
+
+  return merge_counts(counts, nblocks * lanes, nvalues, nvalues);
+}
+
+/**
+ * Bin counts of a buffer, for small unsigned integers.
+ * Values are first counted directly, then gathered into their bins.
+ */
+template <typename T, typename BinFunction>
+StridedArray<std::size_t,1> binned_counts(const T* x, std::size_t n,
+					  std::size_t nbins, BinFunction bin,
+					  std::true_type /* directly countable */)
+{
+  auto values = direct_counts(x, n);
+  StridedArray<std::size_t,1> res(nbins);
+  res.fill(0);
+  auto* c = res.data();
+  const auto* v = values.data();
+  for (std::size_t k = 0; k < size(values); k++) {
+    const auto i = bin(static_cast<T>(k));
+    if (i < nbins)
+      c[i] += v[k];
+  }
+  return res;
+}
+
+/**
+ * Bin counts of a buffer.
+ */
+template <typename T, typename BinFunction>
+StridedArray<std::size_t,1> binned_counts(const T* x, std::size_t n,
+					  std::size_t nbins, BinFunction bin,
+					  std::false_type /* directly countable */)
+{
+  return parallel_counts(n, nbins, [x,&bin](std::size_t i) {
+      return bin(x[i]);
+    });
+}
+
+/**
+ * Histogram of the elements of an array with uniform bins.
+ *
+ * The range [min,max] is split in \c nbins bins of equal widths. Every
+ * bin is half-open except the last one which includes \c max, and
+ * elements outside the range or NaNs are ignored.
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<std::size_t,1> histogram(const Array& a, std::size_t nbins,
+				      double min, double max)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (nbins == 0)
+    throw std::length_error("histograms need at least one bin");
+  if (! (min < max))
+    throw std::range_error("invalid histogram range");
+#endif
+  const auto scale = nbins / (max - min);
+  auto bin = [=](T val) -> std::size_t {
+    const auto x = static_cast<double>(val);
+    if (! (x >= min && x <= max))
+      return nbins;
+    return std::min(static_cast<std::size_t>((x - min) * scale), nbins - 1);
+  };
+
+  auto c = contiguous_array(a);
+  return binned_counts(c.data(), size(c), nbins, bin,
+		       is_directly_countable<T>());
+}
+
+/**
+ * Histogram of the elements of an array with explicit bin edges.
+ *
+ * \param edges  Increasing bin edges, giving edges.size()-1 bins. As
+ *               for uniform bins, the last one includes its upper edge.
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<std::size_t,1> histogram(const Array& a,
+				      const std::vector<double>& edges)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (edges.size() < 2)
+    throw std::length_error("histograms need at least two bin edges");
+  if (std::adjacent_find(edges.begin(), edges.end(),
+			 [](double x, double y) { return ! (x < y); })
+      != edges.end())
+    throw std::range_error("histogram bin edges must be increasing");
+#endif
+  const auto nbins = edges.size() - 1;
+  const double* e = edges.data();
+  auto bin = [=](T val) -> std::size_t {
+    const auto x = static_cast<double>(val);
+    if (! (x >= e[0] && x <= e[nbins]))
+      return nbins;
+    const auto k = static_cast<std::size_t>(std::upper_bound(e, e + nbins + 1, x) - e);
+    return std::min(k - 1, nbins - 1);
+  };
+
+  auto c = contiguous_array(a);
+  return binned_counts(c.data(), size(c), nbins, bin,
+		       is_directly_countable<T>());
+}
+
+/**
+ * Histogram of 8 or 16 bits unsigned values, with one bin per value.
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value
+			   && is_directly_countable<T>::value>* = nullptr>
+StridedArray<std::size_t,1> histogram(const Array& a)
+{
+  auto c = contiguous_array(a);
+  return direct_counts(c.data(), size(c));
+}
+
+/**
+ * Counts of the non-negative integers in a buffer of small unsigned
+ * integers, by direct indexing.
+ */
+template <typename T>
+StridedArray<std::size_t,1> bincount(const T* x, std::size_t n,
+				     std::size_t minlength,
+				     std::true_type /* directly countable */)
+{
+  auto values = direct_counts(x, n);
+  const auto* v = values.data();
+  std::size_t len = size(values);
+  while (len > 0 && v[len-1] == 0)
+    len--;
+
+  StridedArray<std::size_t,1> res(std::max(len, minlength));
+  res.fill(0);
+  std::copy(v, v + len, res.data());
+  return res;
+}
+
+/**
+ * Counts of the non-negative integers in a buffer.
+ */
+template <typename T>
+StridedArray<std::size_t,1> bincount(const T* x, std::size_t n,
+				     std::size_t minlength,
+				     std::false_type /* directly countable */)
+{
+  // Largest and smallest values, to size the bins, avoiding the
+  // packed bits of std::vector<bool> written by concurrent blocks
+  typedef std::conditional_t<std::is_same<T,bool>::value, unsigned char, T> E;
+  const auto nblocks = parallel_blocks(n, histogram_grain);
+  std::vector<E> lows(nblocks, 0), highs(nblocks, 0);
+  parallel_for_blocks(n, [x,&lows,&highs]
+		      (std::size_t b, std::size_t begin, std::size_t end) {
+      if (begin == end)
+	return;
+      const auto mm = std::minmax_element(x + begin, x + end);
+      lows[b] = *mm.first;
+      highs[b] = *mm.second;
+    }, histogram_grain);
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (*std::min_element(lows.begin(), lows.end()) < 0)
+    throw std::range_error("cannot count negative values");
+#endif
+  const auto high = *std::max_element(highs.begin(), highs.end());
+  const auto len = std::max(n > 0 ? static_cast<std::size_t>(high) + 1 : 0,
+			    minlength);
+
+  // Negative values, if unchecked, wrap around and are discarded
+  return parallel_counts(n, len, [x,len](std::size_t i) {
+      return std::min(static_cast<std::size_t>(x[i]), len);
+    });
+}
+
+/**
+ * Number of occurrences of each non-negative integer in an array.
+ *
+ * \param minlength  Minimal number of bins in the result.
+ * \return Counts for the values from 0 to the largest element of \c a.
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value
+			   && std::is_integral<T>::value>* = nullptr>
+StridedArray<std::size_t,1> bincount(const Array& a, std::size_t minlength = 0)
+{
+  auto c = contiguous_array(a);
+  return bincount(c.data(), size(c), minlength, is_directly_countable<T>());
+}
+
+/**
+ * Joint histogram of samples in D dimensions with uniform bins.
+ *
+ * \param samples  Array of dimensions [n × D] holding one sample per row.
+ * \param nbins    Number of bins along each of the D dimensions.
+ * \param min      Lower bound of the range along each dimension.
+ * \param max      Upper bound of the range along each dimension.
+ * \return A D-dimensional array of counts. Samples outside the range
+ *         along any dimension are ignored.
+ */
+template <typename Array, std::size_t D, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value
+			   && Array::ndim() == 2>* = nullptr>
+StridedArray<std::size_t,D> histogram(const Array& samples,
+				      const std::array<std::size_t,D>& nbins,
+				      const std::array<double,D>& min,
+				      const std::array<double,D>& max)
+{
+  static_assert(D > 0, "joint histograms need at least one dimension");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (samples.dim(1) != D)
+    throw std::length_error("samples dimension does not match the number of bins");
+  for (std::size_t d = 0; d < D; d++) {
+    if (nbins[d] == 0)
+      throw std::length_error("histograms need at least one bin");
+    if (! (min[d] < max[d]))
+      throw std::range_error("invalid histogram range");
+  }
+#endif
+  StridedArray<std::size_t,D> res(nbins);
+  const auto& strides = res.strides();
+  const auto total = size(res);
+  std::array<double,D> scale;
+  for (std::size_t d = 0; d < D; d++)
+    scale[d] = nbins[d] / (max[d] - min[d]);
+
+  auto c = contiguous_array(samples);
+  const T* x = c.data();
+  auto counts = parallel_counts(c.dim(0), total, [&,x](std::size_t i) {
+      const T* p = x + i*D;
+      std::size_t k = 0;
+      for (std::size_t d = 0; d < D; d++) {
+	const auto v = static_cast<double>(p[d]);
+	if (! (v >= min[d] && v <= max[d]))
+	  return total;
+	k += std::min(static_cast<std::size_t>((v - min[d]) * scale[d]),
+		      nbins[d] - 1) * strides[d];
+      }
+      return k;
+    });
+  std::copy(counts.data(), counts.data() + total, res.data());
+  return res;
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
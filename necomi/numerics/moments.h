@@ -0,0 +1,352 @@
+// necomi/numerics/moments.h – Streaming statistical moments
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "../arrays/stridedarray.h"
+#include "../core/coordinates.h"
+#include "../delayed/transforms.h"
+#include "reductions.h"
+
+namespace necomi
+{
+
+/**
+ * Element-wise running moments of a stream of arrays.
+ *
+ * Each call to update() adds a new frame of dimensions `dims`, and the
+ * count, mean, centered second moment, minimum and maximum of every
+ * element are updated in a single pass with Welford’s algorithm, using
+ * a memory proportional to a single frame. When \c higher_moments is
+ * set, third and fourth centered moments are tracked as well, giving
+ * access to skewness and kurtosis.
+ *
+ * Accumulators filled independently, for instance by several threads
+ * or on different shards of a dataset, can be combined with merge().
+ */
+template <typename T, std::size_t N, bool higher_moments=false>
+class Moments
+{
+  static_assert(std::is_floating_point<T>::value,
+		"moments require floating point values");
+  static_assert(N > 0, "moments are accumulated over non-scalar frames");
+
+public:
+  using dims_type = std::array<std::size_t,N>;
+
+  explicit Moments(const dims_type& dims)
+    : m_count(0)
+    , m_mean(dims), m_m2(dims)
+    , m_m3(higher_moments ? dims : dims_type{})
+    , m_m4(higher_moments ? dims : dims_type{})
+    , m_min(dims), m_max(dims)
+  {
+    reset();
+  }
+
+  /**
+   * Copy an accumulator, without sharing its statistics, so that
+   * copies can be updated independently and merged back.
+   */
+  Moments(const Moments& other)
+    : m_count(other.m_count)
+    , m_mean(other.m_mean.copy()), m_m2(other.m_m2.copy())
+    , m_m3(other.m_m3.copy()), m_m4(other.m_m4.copy())
+    , m_min(other.m_min.copy()), m_max(other.m_max.copy())
+  {}
+
+  /**
+   * Replace the statistics by a copy of another accumulator,
+   * possibly of different dimensions.
+   */
+  Moments& operator=(const Moments& other)
+  {
+    Moments tmp(other);
+    swap(tmp);
+    return *this;
+  }
+
+  /// Exchange the statistics of two accumulators.
+  void swap(Moments& other) noexcept
+  {
+    std::swap(m_count, other.m_count);
+    m_mean.swap(other.m_mean);
+    m_m2.swap(other.m_m2);
+    m_m3.swap(other.m_m3);
+    m_m4.swap(other.m_m4);
+    m_min.swap(other.m_min);
+    m_max.swap(other.m_max);
+  }
+
+  /**
+   * Forget all the frames seen so far.
+   */
+  void reset()
+  {
+    m_count = 0;
+    m_mean.fill(0);
+    m_m2.fill(0);
+    m_m3.fill(0);
+    m_m4.fill(0);
+    m_min.fill(std::numeric_limits<T>::infinity());
+    m_max.fill(-std::numeric_limits<T>::infinity());
+  }
+
+  const dims_type& dims() const
+  { return m_mean.dims(); }
+
+  /// Number of frames accumulated.
+  std::size_t count() const
+  { return m_count; }
+
+  /**
+   * Add a new frame to the statistics.
+   */
+  template <typename Frame,
+	    std::enable_if_t<is_indexable<Frame>::value
+			     && Frame::ndim() == N>* = nullptr>
+  Moments& update(const Frame& frame)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (frame.dims() != dims())
+      throw std::length_error("frame dimensions incompatible with the accumulated ones");
+#endif
+    m_count++;
+    const T n = static_cast<T>(m_count);
+    const T inv_n = 1 / n;
+
+    T* mean = m_mean.data();
+    T* m2 = m_m2.data();
+    T* m3 = m_m3.data();
+    T* m4 = m_m4.data();
+    T* mn = m_min.data();
+    T* mx = m_max.data();
+
+    for_each_reduced_row(frame, m_mean.strides(),
+			 [=](const auto* in, std::size_t is,
+			     std::size_t off, std::size_t, std::size_t len) {
+	for (std::size_t i = 0; i < len; i++) {
+	  const T x = in[i*is];
+	  const std::size_t j = off + i;
+	  const T delta = x - mean[j];
+	  const T delta_n = delta * inv_n;
+	  const T term = delta * delta_n * (n - 1);
+	  if (higher_moments) {
+	    const T delta_n2 = delta_n * delta_n;
+	    m4[j] += term * delta_n2 * (n*n - 3*n + 3)
+	      + 6 * delta_n2 * m2[j] - 4 * delta_n * m3[j];
+	    m3[j] += term * delta_n * (n - 2) - 3 * delta_n * m2[j];
+	  }
+	  mean[j] += delta_n;
+	  m2[j] += term;
+	  mn[j] = std::min(mn[j], x);
+	  mx[j] = std::max(mx[j], x);
+	}
+      });
+
+    return *this;
+  }
+
+  /**
+   * Add a stack of frames to the statistics.
+   * The first dimension of \c frames indexes the frames.
+   */
+  template <typename Frames,
+	    std::enable_if_t<is_indexable<Frames>::value
+			     && Frames::ndim() == N+1>* = nullptr>
+  Moments& update(const Frames& frames)
+  {
+    for (std::size_t t = 0; t < frames.dim(0); t++)
+      update(slice(frames, t));
+    return *this;
+  }
+
+  template <typename U, std::size_t M,
+	    std::enable_if_t<M == N+1>* = nullptr>
+  Moments& update(const StridedArray<U,M>& frames)
+  {
+    for (std::size_t t = 0; t < frames.dim(0); t++)
+      update(frames[t]);
+    return *this;
+  }
+
+  /**
+   * Combine the statistics of another accumulator into this one.
+   *
+   * The result is the same, up to rounding errors, as if all the
+   * frames given to \c other had been given to this accumulator.
+   */
+  Moments& merge(const Moments& other)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (other.dims() != dims())
+      throw std::length_error("cannot merge moments of different dimensions");
+#endif
+    if (other.m_count == 0)
+      return *this;
+    if (m_count == 0) {
+      m_count = other.m_count;
+      m_mean = other.m_mean;
+      m_m2 = other.m_m2;
+      m_m3 = other.m_m3;
+      m_m4 = other.m_m4;
+      m_min = other.m_min;
+      m_max = other.m_max;
+      return *this;
+    }
+
+    const T na = static_cast<T>(m_count);
+    const T nb = static_cast<T>(other.m_count);
+    const T n = na + nb;
+
+    T* mean = m_mean.data();
+    T* m2 = m_m2.data();
+    T* m3 = m_m3.data();
+    T* m4 = m_m4.data();
+    T* mn = m_min.data();
+    T* mx = m_max.data();
+    const T* omean = other.m_mean.data();
+    const T* om2 = other.m_m2.data();
+    const T* om3 = other.m_m3.data();
+    const T* om4 = other.m_m4.data();
+    const T* omn = other.m_min.data();
+    const T* omx = other.m_max.data();
+
+    for (std::size_t j = 0; j < size(m_mean); j++) {
+      const T delta = omean[j] - mean[j];
+      const T delta_n = delta / n;
+      if (higher_moments) {
+	const T delta2 = delta * delta;
+	m4[j] += om4[j]
+	  + delta2 * delta2 * na * nb * (na*na - na*nb + nb*nb) / (n*n*n)
+	  + 6 * delta2 * (na*na*om2[j] + nb*nb*m2[j]) / (n*n)
+	  + 4 * delta_n * (na*om3[j] - nb*m3[j]);
+	m3[j] += om3[j]
+	  + delta2 * delta * na * nb * (na - nb) / (n*n)
+	  + 3 * delta_n * (na*om2[j] - nb*m2[j]);
+      }
+      m2[j] += om2[j] + delta * delta_n * na * nb;
+      mean[j] += delta_n * nb;
+      mn[j] = std::min(mn[j], omn[j]);
+      mx[j] = std::max(mx[j], omx[j]);
+    }
+    m_count += other.m_count;
+
+    return *this;
+  }
+
+  /// Element-wise mean of the frames.
+  const StridedArray<T,N>& mean() const
+  { return m_mean; }
+
+  /// Element-wise minimum of the frames.
+  const StridedArray<T,N>& min() const
+  { return m_min; }
+
+  /// Element-wise maximum of the frames.
+  const StridedArray<T,N>& max() const
+  { return m_max; }
+
+  /// Element-wise sum of squared deviations to the mean.
+  const StridedArray<T,N>& m2() const
+  { return m_m2; }
+
+  /**
+   * Element-wise variance of the frames.
+   * \see variance(const Array&, dim_type, bool) for the Bessel correction.
+   */
+  StridedArray<T,N> variance(bool bessel_correction) const
+  {
+    auto res = m_m2.copy();
+    if (m_count <= (bessel_correction ? 1U : 0U)) {
+#ifndef NECOMI_NO_BOUND_CHECKS
+      throw std::domain_error("not enough frames to estimate the variance");
+#endif
+      res.fill(std::numeric_limits<T>::quiet_NaN());
+      return res;
+    }
+    const T div = static_cast<T>(bessel_correction ? m_count - 1 : m_count);
+    T* p = res.data();
+    for (std::size_t j = 0; j < size(res); j++)
+      p[j] /= div;
+    return res;
+  }
+
+  /// Element-wise standard deviation of the frames.
+  StridedArray<T,N> deviation(bool bessel_correction) const
+  {
+    auto res = variance(bessel_correction);
+    T* p = res.data();
+    for (std::size_t j = 0; j < size(res); j++)
+      p[j] = std::sqrt(p[j]);
+    return res;
+  }
+
+  /// Element-wise sample skewness of the frames.
+  template <bool H = higher_moments, std::enable_if_t<H>* = nullptr>
+  StridedArray<T,N> skewness() const
+  {
+    const T n = static_cast<T>(m_count);
+    StridedArray<T,N> res(dims());
+    T* p = res.data();
+    const T* m2 = m_m2.data();
+    const T* m3 = m_m3.data();
+    for (std::size_t j = 0; j < size(res); j++)
+      p[j] = std::sqrt(n) * m3[j] / std::pow(m2[j], static_cast<T>(1.5));
+    return res;
+  }
+
+  /// Element-wise excess kurtosis of the frames.
+  template <bool H = higher_moments, std::enable_if_t<H>* = nullptr>
+  StridedArray<T,N> kurtosis() const
+  {
+    const T n = static_cast<T>(m_count);
+    StridedArray<T,N> res(dims());
+    T* p = res.data();
+    const T* m2 = m_m2.data();
+    const T* m4 = m_m4.data();
+    for (std::size_t j = 0; j < size(res); j++)
+      p[j] = n * m4[j] / (m2[j] * m2[j]) - 3;
+    return res;
+  }
+
+protected:
+  /// Number of frames accumulated.
+  std::size_t m_count;
+  /// Running mean.
+  StridedArray<T,N> m_mean;
+  /// Running sums of powers of deviations to the mean.
+  StridedArray<T,N> m_m2, m_m3, m_m4;
+  /// Running extrema.
+  StridedArray<T,N> m_min, m_max;
+};
+
+/**
+ * Compute the running moments of an array along its first dimension.
+ */
+template <bool higher_moments=false, typename Array,
+	  std::enable_if_t<is_indexable<Array>::value
+			   && (Array::ndim() > 1)>* = nullptr>
+auto moments(const Array& a)
+{
+  using T = typename Array::dtype;
+  Moments<T,Array::ndim()-1,higher_moments> m(remove_coordinate(a.dims(), 0));
+  m.update(a);
+  return m;
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
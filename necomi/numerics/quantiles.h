@@ -0,0 +1,260 @@
+// necomi/numerics/quantiles.h – Medians, percentiles and quantiles
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/coordinates.h"
+#include "../core/parallel.h"
+
+namespace necomi
+{
+
+/**
+ * Algorithm used to select order statistics.
+ */
+enum class QuantileMethod
+{
+  /// Selection with std::nth_element, linear in average.
+  EXACT,
+  /// Counting in at most 2¹⁶ bins, only for integral elements. The
+  /// result is exact when the values span less than 2¹⁶ integers, as
+  /// for 8 and 16 bits images. Floating point elements always use an
+  /// exact selection.
+  HISTOGRAM,
+};
+
+/// Element type of quantiles computed on arrays of T.
+template <typename T>
+using quantile_type = std::conditional_t<std::is_floating_point<T>::value, T, double>;
+
+/// Maximal number of bins for histogram-based selection.
+constexpr std::size_t quantile_max_bins = 1UL << 16;
+
+/**
+ * Value of the order statistic of given rank using a histogram.
+ */
+template <typename T>
+quantile_type<T> histogram_order_statistic(const std::vector<std::size_t>& counts,
+					   T min, std::uintmax_t width,
+					   std::size_t rank)
+{
+  std::size_t b = 0, seen = counts[0];
+  while (seen <= rank)
+    seen += counts[++b];
+  // Center of the bin, exact for unit bins
+  return static_cast<quantile_type<T>>(min)
+    + static_cast<quantile_type<T>>(b * width)
+    + static_cast<quantile_type<T>>(width - 1) / 2;
+}
+
+/**
+ * Quantile of a buffer of elements, whose order is modified.
+ *
+ * Linear interpolation is used between the two closest order
+ * statistics, as in NumPy’s default.
+ */
+template <typename T>
+quantile_type<T> buffer_quantile(T* x, std::size_t n, double q,
+				 QuantileMethod,
+				 std::vector<std::size_t>&,
+				 std::false_type /* exact */)
+{
+  const double pos = q * (n - 1);
+  const auto lo = static_cast<std::size_t>(pos);
+  const auto frac = static_cast<quantile_type<T>>(pos - lo);
+  std::nth_element(x, x + lo, x + n);
+  const auto vlo = static_cast<quantile_type<T>>(x[lo]);
+  if (frac == 0 || lo + 1 >= n)
+    return vlo;
+  // Elements after the selected one are all greater or equal
+  const auto vhi = static_cast<quantile_type<T>>(*std::min_element(x + lo + 1, x + n));
+  return vlo + frac * (vhi - vlo);
+}
+
+/**
+ * Quantile of a buffer of integral elements, possibly using a histogram.
+ * \param counts Scratch space for the histogram-based selection.
+ */
+template <typename T>
+quantile_type<T> buffer_quantile(T* x, std::size_t n, double q,
+				 QuantileMethod method,
+				 std::vector<std::size_t>& counts,
+				 std::true_type /* integral */)
+{
+  if (method != QuantileMethod::HISTOGRAM)
+    return buffer_quantile(x, n, q, method, counts, std::false_type());
+
+  const auto mm = std::minmax_element(x, x + n);
+  const T min = *mm.first;
+  // Modular arithmetic gives the span for both signed and unsigned
+  const auto span = static_cast<std::uintmax_t>(*mm.second)
+    - static_cast<std::uintmax_t>(min);
+  const auto nbins = static_cast<std::size_t>(std::min<std::uintmax_t>(span, quantile_max_bins - 1) + 1);
+  const std::uintmax_t width = span / nbins + 1;
+
+  counts.assign(nbins, 0);
+  for (std::size_t i = 0; i < n; i++)
+    counts[(static_cast<std::uintmax_t>(x[i]) - static_cast<std::uintmax_t>(min)) / width]++;
+
+  const double pos = q * (n - 1);
+  const auto lo = static_cast<std::size_t>(pos);
+  const auto frac = static_cast<quantile_type<T>>(pos - lo);
+  const auto vlo = histogram_order_statistic(counts, min, width, lo);
+  if (frac == 0 || lo + 1 >= n)
+    return vlo;
+  const auto vhi = histogram_order_statistic(counts, min, width, lo + 1);
+  return vlo + frac * (vhi - vlo);
+}
+
+/**
+ * Make sure quantile arguments are valid.
+ */
+inline void check_quantile(double q, std::size_t n)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (! (q >= 0 && q <= 1))
+    throw std::out_of_range("quantiles must be in [0,1]");
+  if (n == 0)
+    throw std::length_error("cannot compute the quantile of an empty array");
+#else
+  (void) q; (void) n;
+#endif
+}
+
+/**
+ * Quantile of all the elements of an array.
+ *
+ * \param q       Quantile in [0,1].
+ * \param method  Selection algorithm.
+ */
+template <typename Array, typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+quantile_type<T> quantile(const Array& a, double q,
+			  QuantileMethod method = QuantileMethod::EXACT)
+{
+  const auto n = size(a);
+  check_quantile(q, n);
+
+  std::vector<T> x;
+  x.reserve(n);
+  for_each(a, [&x](const auto&, auto val) { x.push_back(val); });
+  std::vector<std::size_t> counts;
+  return buffer_quantile(x.data(), n, q, method, counts,
+			 std::is_integral<T>());
+}
+
+/**
+ * Quantiles of a strided array along a dimension.
+ *
+ * Output elements are distributed among threads, each one copying the
+ * lines it handles into its own scratch buffer before selecting.
+ */
+template <typename T, std::size_t N,
+	  std::enable_if_t<(N > 0)>* = nullptr>
+StridedArray<quantile_type<T>,N-1>
+quantile(const StridedArray<T,N>& a, double q, std::size_t dim,
+	 QuantileMethod method = QuantileMethod::EXACT)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dim >= N)
+    throw std::out_of_range("invalid quantile dimension");
+#endif
+  const auto len = a.dim(dim);
+  check_quantile(q, len);
+
+  StridedArray<quantile_type<T>,N-1> res(remove_coordinate(a.dims(), dim));
+  const auto res_strides = res.strides();
+  const auto in_strides = remove_coordinate(a.strides(), dim);
+  const auto line_stride = a.strides()[dim];
+  const T* data = a.data();
+  auto* out = res.data();
+
+  parallel_for(size(res), [&](std::size_t begin, std::size_t end) {
+      std::vector<T> line(len);
+      std::vector<std::size_t> counts;
+      for (std::size_t j = begin; j < end; j++) {
+	// Offset of the line in the input
+	const auto coords = strided_index_to_coords(j, res_strides);
+	std::size_t off = 0;
+	for (std::size_t i = 0; i < N-1; i++)
+	  off += coords[i] * in_strides[i];
+	for (std::size_t k = 0; k < len; k++)
+	  line[k] = data[off + k*line_stride];
+	out[j] = buffer_quantile(line.data(), len, q, method, counts,
+				 std::is_integral<T>());
+      }
+    }, std::max<std::size_t>(4096 / std::max<std::size_t>(len, 1), 1));
+
+  return res;
+}
+
+/**
+ * Quantiles of an indexable array along a dimension.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto quantile(const Array& a, double q, std::size_t dim,
+	      QuantileMethod method = QuantileMethod::EXACT)
+{
+  return quantile(strided_array(a), q, dim, method);
+}
+
+/**
+ * Percentile of all the elements of an array.
+ * \param p  Percentile in [0,100].
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto percentile(const Array& a, double p,
+		QuantileMethod method = QuantileMethod::EXACT)
+{
+  return quantile(a, p / 100, method);
+}
+
+/**
+ * Percentiles of an array along a dimension.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto percentile(const Array& a, double p, std::size_t dim,
+		QuantileMethod method = QuantileMethod::EXACT)
+{
+  return quantile(a, p / 100, dim, method);
+}
+
+/**
+ * Median of all the elements of an array.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto median(const Array& a, QuantileMethod method = QuantileMethod::EXACT)
+{
+  return quantile(a, 0.5, method);
+}
+
+/**
+ * Medians of an array along a dimension.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto median(const Array& a, std::size_t dim,
+	    QuantileMethod method = QuantileMethod::EXACT)
+{
+  return quantile(a, 0.5, dim, method);
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
@@ -6,10 +6,16 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 #include <random>
 #include <type_traits>
 
 #include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
 
 namespace necomi
 {
@@ -52,6 +58,569 @@ protected:
 };
 
 
+/**
+ * Counter-based random number generator of the Philox-4×32-10 family,
+ * after Salmon et al.
+ *
+ * Random blocks of four 32 bits words are a pure function of a 64 bits
+ * seed, a 32 bits stream identifier and a counter, so that any block
+ * can be generated independently of the others. Array generation
+ * functions use the flat index of each element as counter, so that
+ * elements are generated concurrently, while the generated arrays do
+ * not depend on the number of threads.
+ */
+class Philox
+{
+public:
+  typedef std::array<std::uint32_t,4> block_type;
+
+  explicit Philox(std::uint64_t seed = 0, std::uint32_t stream = 0)
+    : m_seed(seed), m_stream(stream)
+  {}
+
+  std::uint64_t seed() const
+  { return m_seed; }
+
+  std::uint32_t stream() const
+  { return m_stream; }
+
+  /**
+   * Apply the ten Philox rounds to a counter with a given key.
+   */
+  static block_type bijection(block_type ctr, std::array<std::uint32_t,2> key)
+  {
+    for (int r = 0; r < 10; r++) {
+      const auto p0 = static_cast<std::uint64_t>(0xD2511F53) * ctr[0];
+      const auto p1 = static_cast<std::uint64_t>(0xCD9E8D57) * ctr[2];
+      ctr = {{static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ key[0],
+	      static_cast<std::uint32_t>(p1),
+	      static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ key[1],
+	      static_cast<std::uint32_t>(p0)}};
+      key[0] += 0x9E3779B9;
+      key[1] += 0xBB67AE85;
+    }
+    return ctr;
+  }
+
+  /**
+   * Random block number \c draw of the element at a given index.
+   */
+  block_type operator()(std::uint64_t index, std::uint32_t draw = 0) const
+  {
+    return bijection({{static_cast<std::uint32_t>(index),
+		       static_cast<std::uint32_t>(index >> 32),
+		       draw, m_stream}},
+      {{static_cast<std::uint32_t>(m_seed),
+	static_cast<std::uint32_t>(m_seed >> 32)}});
+  }
+
+private:
+  std::uint64_t m_seed;
+  std::uint32_t m_stream;
+};
+
+/**
+ * Random number engine generating the successive blocks of a single
+ * element of a counter-based generator, starting at a given draw, so
+ * that standard distributions can be used per element.
+ */
+class PhiloxEngine
+{
+public:
+  typedef std::uint32_t result_type;
+
+  PhiloxEngine(const Philox& rng, std::uint64_t index, std::uint32_t draw = 0)
+    : m_rng(rng), m_index(index), m_draw(draw), m_pos(4)
+  {}
+
+  static constexpr result_type min()
+  { return 0; }
+
+  static constexpr result_type max()
+  { return 0xFFFFFFFF; }
+
+  result_type operator()()
+  {
+    if (m_pos == 4) {
+      m_block = m_rng(m_index, m_draw++);
+      m_pos = 0;
+    }
+    return m_block[m_pos++];
+  }
+
+private:
+  Philox m_rng;
+  std::uint64_t m_index;
+  std::uint32_t m_draw;
+  std::size_t m_pos;
+  Philox::block_type m_block;
+};
+
+/**
+ * Whether a random number generator is counter-based.
+ */
+template <typename PRNG>
+struct is_counter_based : std::false_type {};
+
+template <>
+struct is_counter_based<Philox> : std::true_type {};
+
+template <>
+struct is_counter_based<const Philox> : std::true_type {};
+
+/**
+ * Set each element of an array to \c f(engine), with \c engine a
+ * PhiloxEngine for the flat index of the element in row-major order.
+ * Elements are generated concurrently.
+ */
+template <typename T, std::size_t N, typename Function>
+void fill_random(StridedArray<T,N>& a, const Philox& rng, Function f)
+{
+  const auto& dims = a.dims();
+  const auto& strides = a.strides();
+  std::size_t total = 1;
+  for (auto d : dims)
+    total *= d;
+  T* data = a.data();
+
+  parallel_for(total, [&](std::size_t begin, std::size_t end) {
+      std::array<std::size_t,N> coords;
+      std::size_t offset = 0;
+      auto rem = begin;
+      for (std::size_t d = N; d-- > 0; ) {
+	coords[d] = rem % dims[d];
+	rem /= dims[d];
+	offset += coords[d] * strides[d];
+      }
+      for (auto i = begin; i < end; i++) {
+	PhiloxEngine engine(rng, i);
+	data[offset] = f(engine);
+	for (std::size_t d = N; d-- > 0; ) {
+	  offset += strides[d];
+	  if (++coords[d] < dims[d])
+	    break;
+	  offset -= coords[d] * strides[d];
+	  coords[d] = 0;
+	}
+      }
+    }, 4096);
+}
+
+/// Number of random values generated together by bulk sampling kernels.
+constexpr std::size_t random_block = 256;
+
+/// Random words used to generate floating point values of type T.
+template <typename T>
+using random_word_t = std::conditional_t<std::numeric_limits<T>::digits <= 32,
+					 std::uint32_t, std::uint64_t>;
+
+/**
+ * Uniformly distributed random word drawn from a random number
+ * engine, combining several engine values if needed.
+ */
+template <typename W, typename PRNG>
+W random_bits(PRNG& prng)
+{
+  if (PRNG::min() == 0 && PRNG::max() >= std::numeric_limits<W>::max())
+    return static_cast<W>(prng());
+  if (PRNG::min() == 0 && PRNG::max() == 0xFFFFFFFF) {
+    const auto hi = static_cast<W>(prng());
+    return static_cast<W>(static_cast<std::uint64_t>(hi) << 32 | prng());
+  }
+  return std::uniform_int_distribution<W>()(prng);
+}
+
+/**
+ * Uniformly distributed floating point value in [0,1) from the
+ * highest bits of a random word.
+ */
+template <typename T, typename W>
+T unit_uniform(W bits)
+{
+  constexpr int w = std::numeric_limits<W>::digits;
+  constexpr int d = std::min(std::numeric_limits<T>::digits, w - 1);
+  return static_cast<T>(bits >> (w - d)) * (T(1) / static_cast<T>(W(1) << d));
+}
+
+/**
+ * Uniformly distributed floating point value in (0,1] from the
+ * highest bits of a random word, which can be safely given to log.
+ */
+template <typename T, typename W>
+T open_unit_uniform(W bits)
+{
+  constexpr int w = std::numeric_limits<W>::digits;
+  constexpr int d = std::min(std::numeric_limits<T>::digits, w - 1);
+  return (static_cast<T>(bits >> (w - d)) + 1) * (T(1) / static_cast<T>(W(1) << d));
+}
+
+/// Number of layers of the ziggurat used for normal sampling.
+constexpr std::size_t ziggurat_layers = 128;
+
+/**
+ * Layers of the ziggurat covering the standard normal density, after
+ * Marsaglia and Tsang, with the construction of Doornik.
+ */
+template <typename T>
+struct ZigguratTables
+{
+  /// Right edge of the tail layer, and area of each layer.
+  static constexpr double edge = 3.442619855899;
+  static constexpr double area = 9.91256303526217e-3;
+
+  /// Widths of the layers.
+  T x[ziggurat_layers + 1];
+  /// Ratios of the widths of consecutive layers.
+  T r[ziggurat_layers];
+
+  ZigguratTables()
+  {
+    double w[ziggurat_layers + 1];
+    double f = std::exp(-0.5 * edge * edge);
+    w[0] = area / f;
+    w[1] = edge;
+    w[ziggurat_layers] = 0;
+    for (std::size_t i = 2; i < ziggurat_layers; i++) {
+      w[i] = std::sqrt(-2 * std::log(area / w[i-1] + f));
+      f = std::exp(-0.5 * w[i] * w[i]);
+    }
+    for (std::size_t i = 0; i <= ziggurat_layers; i++)
+      x[i] = static_cast<T>(w[i]);
+    for (std::size_t i = 0; i < ziggurat_layers; i++)
+      r[i] = static_cast<T>(w[i+1] / w[i]);
+  }
+};
+
+template <typename T>
+constexpr double ZigguratTables<T>::edge;
+
+template <typename T>
+constexpr double ZigguratTables<T>::area;
+
+template <typename T>
+const ZigguratTables<T>& ziggurat_tables()
+{
+  static const ZigguratTables<T> tables;
+  return tables;
+}
+
+/**
+ * Standard normal value from a ziggurat sample \c u in [-1,1) of layer
+ * \c i which failed the rectangle test, drawing further words from a
+ * random number engine for the wedges and the tail.
+ */
+template <typename T, typename Engine>
+T ziggurat_retry(T u, std::size_t i, Engine& engine)
+{
+  typedef random_word_t<T> W;
+  const auto& z = ziggurat_tables<T>();
+  for (;;) {
+    if (i == 0) {
+      const T edge = static_cast<T>(ZigguratTables<T>::edge);
+      T x, y;
+      do {
+	x = std::log(open_unit_uniform<T>(random_bits<W>(engine))) / edge;
+	y = std::log(open_unit_uniform<T>(random_bits<W>(engine)));
+      } while (-2 * y < x * x);
+      return u < 0 ? x - edge : edge - x;
+    }
+    const T x = u * z.x[i];
+    const T f0 = std::exp(-(z.x[i] * z.x[i] - x * x) / 2);
+    const T f1 = std::exp(-(z.x[i+1] * z.x[i+1] - x * x) / 2);
+    if (f1 + unit_uniform<T>(random_bits<W>(engine)) * (f0 - f1) < 1)
+      return x;
+
+    const auto bits = random_bits<W>(engine);
+    i = bits & (ziggurat_layers - 1);
+    u = 2 * unit_uniform<T>(bits) - 1;
+    if (std::abs(u) < z.r[i])
+      return u * z.x[i];
+  }
+}
+
+/**
+ * Standard normal value drawn from a random number engine with the
+ * ziggurat method. Each word gives both the layer, from its lowest
+ * bits, and the position in the layer, from its highest bits.
+ */
+template <typename T, typename Engine>
+T normal_sample(Engine& engine)
+{
+  const auto& z = ziggurat_tables<T>();
+  const auto bits = random_bits<random_word_t<T>>(engine);
+  const std::size_t i = bits & (ziggurat_layers - 1);
+  const T u = 2 * unit_uniform<T>(bits) - 1;
+  if (std::abs(u) < z.r[i])
+    return u * z.x[i];
+  return ziggurat_retry(u, i, engine);
+}
+
+/**
+ * Standard gamma distributed value of shape \c alpha drawn from a
+ * random number engine with the Marsaglia–Tsang method, boosted for
+ * shapes lower than one.
+ */
+template <typename T, typename Engine>
+T gamma_sample(T alpha, Engine& engine)
+{
+  typedef random_word_t<T> W;
+  T boost = 1;
+  if (alpha < 1) {
+    boost = std::pow(open_unit_uniform<T>(random_bits<W>(engine)), 1 / alpha);
+    alpha += 1;
+  }
+  const T d = alpha - T(1)/3;
+  const T c = 1 / std::sqrt(9 * d);
+
+  for (;;) {
+    T x, v;
+    do {
+      x = normal_sample<T>(engine);
+      v = 1 + c * x;
+    } while (v <= 0);
+    v = v * v * v;
+    const T u = open_unit_uniform<T>(random_bits<W>(engine));
+    const T x2 = x * x;
+    if (u < 1 - T(0.0331) * x2 * x2
+	|| std::log(u) < x2 / 2 + d * (1 - v + std::log(v)))
+      return boost * d * v;
+  }
+}
+
+/**
+ * Random words drawn in sequence from a random number engine.
+ */
+template <typename PRNG>
+class EngineWords
+{
+public:
+  explicit EngineWords(PRNG& prng)
+    : m_prng(prng)
+  {}
+
+  /// Fill \c out with \c n random words.
+  template <typename W>
+  void operator()(std::size_t, std::size_t n, W* out)
+  {
+    for (std::size_t k = 0; k < n; k++)
+      out[k] = random_bits<W>(m_prng);
+  }
+
+  /// Random number engine for variable numbers of words.
+  PRNG& engine(std::size_t)
+  { return m_prng; }
+
+private:
+  PRNG& m_prng;
+};
+
+/**
+ * Random words of a counter-based generator, the word of each flat
+ * index being taken from the block of its counter.
+ */
+class PhiloxWords
+{
+public:
+  explicit PhiloxWords(const Philox& rng)
+    : m_rng(rng)
+  {}
+
+  /// Fill \c out with the words of the flat indices [begin,begin+n).
+  void operator()(std::size_t begin, std::size_t n, std::uint32_t* out) const
+  {
+    for (auto j = begin; j < begin + n; ) {
+      const auto block = m_rng(j / 4);
+      for (auto k = j % 4; k < 4 && j < begin + n; k++, j++)
+	out[j - begin] = block[k];
+    }
+  }
+
+  void operator()(std::size_t begin, std::size_t n, std::uint64_t* out) const
+  {
+    for (auto j = begin; j < begin + n; ) {
+      const auto block = m_rng(j / 2);
+      for (auto k = j % 2; k < 2 && j < begin + n; k++, j++)
+	out[j - begin] = static_cast<std::uint64_t>(block[2*k]) << 32 | block[2*k+1];
+    }
+  }
+
+  /// Random number engine of a given flat index, whose draws do not
+  /// overlap with the words.
+  PhiloxEngine engine(std::size_t index) const
+  { return PhiloxEngine(m_rng, index, 1); }
+
+private:
+  Philox m_rng;
+};
+
+/**
+ * Fill the flat indices [begin,end) of an array, in row-major order,
+ * with blocks of at most random_block values generated by
+ * \c gen(words, i, n, out), which sets the values of the flat indices
+ * [i,i+n) in \c out.
+ */
+template <typename T, std::size_t N, typename Words, typename Generator>
+void fill_random_blocks(StridedArray<T,N>& a, std::size_t begin, std::size_t end,
+			Words& words, Generator& gen)
+{
+  const auto& dims = a.dims();
+  const auto& strides = a.strides();
+  T* data = a.data();
+  std::array<std::size_t,N> coords;
+  std::size_t offset = 0;
+  auto rem = begin;
+  for (std::size_t d = N; d-- > 0; ) {
+    coords[d] = rem % dims[d];
+    rem /= dims[d];
+    offset += coords[d] * strides[d];
+  }
+
+  T buf[random_block];
+  for (auto i = begin; i < end; i += random_block) {
+    const auto n = std::min(random_block, end - i);
+    gen(words, i, n, buf);
+    for (std::size_t k = 0; k < n; k++) {
+      data[offset] = buf[k];
+      for (std::size_t d = N; d-- > 0; ) {
+	offset += strides[d];
+	if (++coords[d] < dims[d])
+	  break;
+	offset -= coords[d] * strides[d];
+	coords[d] = 0;
+      }
+    }
+  }
+}
+
+/**
+ * Fill an array with blocks of random values drawn in sequence from
+ * a random number engine. \see fill_random_blocks
+ */
+template <typename T, std::size_t N, typename PRNG, typename Generator,
+	  typename std::enable_if_t<! is_counter_based<PRNG>::value>* = nullptr>
+void fill_random_blocks(StridedArray<T,N>& a, PRNG& prng, Generator gen)
+{
+  EngineWords<PRNG> words(prng);
+  fill_random_blocks(a, 0, size(a), words, gen);
+}
+
+/**
+ * Fill an array with blocks of random values from a counter-based
+ * generator, blocks being generated concurrently.
+ * \see fill_random_blocks
+ */
+template <typename T, std::size_t N, typename Generator>
+void fill_random_blocks(StridedArray<T,N>& a, const Philox& rng, Generator gen)
+{
+  parallel_for(size(a), [&](std::size_t begin, std::size_t end) {
+      PhiloxWords words(rng);
+      auto g = gen;
+      fill_random_blocks(a, begin, end, words, g);
+    }, 4*random_block);
+}
+
+/**
+ * Fill an array in place with uniformly distributed floating point
+ * values in [min,max), converted from the bits of random words.
+ */
+template <typename T, std::size_t N, typename PRNG>
+void fill_uniform(StridedArray<T,N>& a, PRNG& prng,
+		  typename StridedArray<T,N>::dtype min = 0,
+		  typename StridedArray<T,N>::dtype max = 1)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"uniform sampling requires floating point values");
+  typedef random_word_t<T> W;
+  const T scale = max - min;
+  fill_random_blocks(a, prng, [min,scale](auto& words, std::size_t i,
+					  std::size_t n, T* out) {
+      W bits[random_block];
+      words(i, n, bits);
+      for (std::size_t k = 0; k < n; k++)
+	out[k] = min + scale * unit_uniform<T>(bits[k]);
+    });
+}
+
+/**
+ * Fill an array in place with normally distributed values.
+ *
+ * Values are generated in blocks with the ziggurat method: a first
+ * loop without branches accepts most values from a single random word
+ * each, and the few rejected values are then drawn again one by one.
+ */
+template <typename T, std::size_t N, typename PRNG>
+void fill_normal(StridedArray<T,N>& a, PRNG& prng,
+		 typename StridedArray<T,N>::dtype mean = 0,
+		 typename StridedArray<T,N>::dtype deviation = 1)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"normal sampling requires floating point values");
+  typedef random_word_t<T> W;
+  const auto& z = ziggurat_tables<T>();
+  fill_random_blocks(a, prng, [mean,deviation,&z](auto& words, std::size_t i,
+						  std::size_t n, T* out) {
+      W bits[random_block];
+      bool accepted[random_block];
+      words(i, n, bits);
+      for (std::size_t k = 0; k < n; k++) {
+	const std::size_t l = bits[k] & (ziggurat_layers - 1);
+	const T u = 2 * unit_uniform<T>(bits[k]) - 1;
+	out[k] = u * z.x[l];
+	accepted[k] = std::abs(u) < z.r[l];
+      }
+      for (std::size_t k = 0; k < n; k++)
+	if (! accepted[k]) {
+	  auto&& engine = words.engine(i + k);
+	  out[k] = ziggurat_retry(2 * unit_uniform<T>(bits[k]) - 1,
+				  bits[k] & (ziggurat_layers - 1), engine);
+	}
+      for (std::size_t k = 0; k < n; k++)
+	out[k] = mean + deviation * out[k];
+    });
+}
+
+/**
+ * Fill an array in place with gamma distributed values of shape \c
+ * alpha and scale \c theta, using the Marsaglia–Tsang method.
+ */
+template <typename T, std::size_t N, typename PRNG>
+void fill_gamma(StridedArray<T,N>& a, PRNG& prng,
+		typename StridedArray<T,N>::dtype alpha,
+		typename StridedArray<T,N>::dtype theta = 1)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"gamma sampling requires floating point values");
+  fill_random_blocks(a, prng, [alpha,theta](auto& words, std::size_t i,
+					    std::size_t n, T* out) {
+      for (std::size_t k = 0; k < n; k++) {
+	auto&& engine = words.engine(i + k);
+	out[k] = theta * gamma_sample(alpha, engine);
+      }
+    });
+}
+
+/**
+ * Fill an array in place with beta distributed values, as ratios of
+ * gamma distributed values.
+ */
+template <typename T, std::size_t N, typename PRNG>
+void fill_beta(StridedArray<T,N>& a, PRNG& prng,
+	       typename StridedArray<T,N>::dtype alpha,
+	       typename StridedArray<T,N>::dtype beta)
+{
+  static_assert(std::is_floating_point<T>::value,
+		"beta sampling requires floating point values");
+  fill_random_blocks(a, prng, [alpha,beta](auto& words, std::size_t i,
+					   std::size_t n, T* out) {
+      for (std::size_t k = 0; k < n; k++) {
+	auto&& engine = words.engine(i + k);
+	const auto x = gamma_sample(alpha, engine);
+	out[k] = x / (x + gamma_sample(beta, engine));
+      }
+    });
+}
+
+
 /**
  * Generate a one dimensional array filled with random numbers
  * following a normal distribution.
@@ -63,9 +632,9 @@ StridedArray<W,N> normal(const T& mean, const U& deviation,
 			 const std::array<std::size_t,N>& dims,
 			 PRNG& prng)
 {
-  std::normal_distribution<W> dist(mean, deviation);
-    StridedArray<W,N> a(dims);
-  return transform(a, [&dist,&prng](auto){ return dist(prng); });
+  StridedArray<W,N> a(dims);
+  fill_normal(a, prng, mean, deviation);
+  return a;
 }
 
 
@@ -114,18 +683,14 @@ StridedArray<T,N> uniform(const T& min, const T& max,
 			  const std::array<std::size_t,N>& dims,
 			  PRNG& prng)
 {
-  std::uniform_real_distribution<T> dist(min, max);
   StridedArray<T,N> a(dims);
-
-  a.map([&dist,&prng](const auto&, auto& val) {
-      val = dist(prng);
-    });
-
+  fill_uniform(a, prng, min, max);
   return a;
 }
 
 template <typename T, std::size_t N, typename PRNG,
-	  typename std::enable_if_t<std::is_integral<T>::value>* = nullptr>
+	  typename std::enable_if_t<std::is_integral<T>::value
+				    && ! is_counter_based<PRNG>::value>* = nullptr>
 StridedArray<T,N> uniform(const T& min, const T& max,
 			  const std::array<std::size_t,N>& dims,
 			  PRNG& prng)
@@ -140,6 +705,23 @@ StridedArray<T,N> uniform(const T& min, const T& max,
   return a;
 }
 
+/**
+ * Generate an array of uniformly distributed integers in [min,max]
+ * with a counter-based generator.
+ */
+template <typename T, std::size_t N,
+	  typename std::enable_if_t<std::is_integral<T>::value>* = nullptr>
+StridedArray<T,N> uniform(const T& min, const T& max,
+			  const std::array<std::size_t,N>& dims,
+			  const Philox& rng)
+{
+  StridedArray<T,N> a(dims);
+  fill_random(a, rng, [min,max](auto& engine) {
+      return std::uniform_int_distribution<T>(min, max)(engine);
+    });
+  return a;
+}
+
 template <typename T, typename PRNG,
 	  typename std::enable_if_t<std::is_floating_point<T>::value
 				    || std::is_integral<T>::value>* = nullptr>
@@ -161,15 +743,8 @@ StridedArray<T,N> betarnd(const T& alpha, const T& beta,
 			  const std::array<std::size_t,N>& dims,
 			  PRNG& prng)
 {
-  std::gamma_distribution<T> xd(alpha, 1);
-  std::gamma_distribution<T> yd(beta, 1);
   StridedArray<T,N> a(dims);
-
-  a.map([&xd,&yd,&prng](const auto&, auto& val) {
-      auto x = xd(prng);
-      val = x / (x + yd(prng));
-    });
-
+  fill_beta(a, prng, alpha, beta);
   return a;
 }
 
@@ -181,6 +756,29 @@ StridedArray<T,1> betarnd(const T& alpha, const T& beta,
   return betarnd<T,1>(alpha, beta, {size}, prng);
 }
 
+/**
+ * Generate an array filled with random floating point numbers
+ * following a gamma distribution of shape \c alpha and scale \c theta.
+ */
+template <typename T, std::size_t N, typename PRNG,
+	  typename std::enable_if_t<std::is_floating_point<T>::value>* = nullptr>
+StridedArray<T,N> gammarnd(const T& alpha, const T& theta,
+			   const std::array<std::size_t,N>& dims,
+			   PRNG& prng)
+{
+  StridedArray<T,N> a(dims);
+  fill_gamma(a, prng, alpha, theta);
+  return a;
+}
+
+template <typename T, typename PRNG,
+	  typename std::enable_if_t<std::is_floating_point<T>::value>* = nullptr>
+StridedArray<T,1> gammarnd(const T& alpha, const T& theta,
+			   std::size_t size, PRNG& prng)
+{
+  return gammarnd<T,1>(alpha, theta, {size}, prng);
+}
+
 template <typename Array>
 typename Array::dtype find_higher_index(Array& a, const typename Array::dtype& val)
 {
@@ -0,0 +1,237 @@
+// necomi/numerics/reductions.h – Eager reductions along array axes
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+
+#include "../arrays/stridedarray.h"
+
+namespace necomi
+{
+
+/**
+ * Flag the axes of an N-dimensional array that are reduced.
+ */
+template <std::size_t N, std::size_t M>
+std::array<bool,N> reduced_axes_mask(const std::array<std::size_t,M>& axes)
+{
+  std::array<bool,N> mask;
+  mask.fill(false);
+  for (auto axis : axes) {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (axis >= N)
+      throw std::out_of_range("invalid reduction axis");
+    if (mask[axis])
+      throw std::length_error("reduction axes must be distinct");
+#endif
+    mask[axis] = true;
+  }
+  return mask;
+}
+
+/**
+ * Dimensions of an array reduced along the given axes.
+ *
+ * When \c keepdims is set, reduced axes are kept with a size of 1,
+ * otherwise they are removed.
+ */
+template <bool keepdims, std::size_t N, std::size_t M>
+std::array<std::size_t, keepdims ? N : N-M>
+reduced_dims(const std::array<std::size_t,N>& dims,
+	     const std::array<std::size_t,M>& axes)
+{
+  static_assert(M <= N, "cannot reduce more axes than available");
+  auto mask = reduced_axes_mask<N>(axes);
+
+  std::array<std::size_t, keepdims ? N : N-M> res;
+  for (std::size_t i = 0, j = 0; i < N; i++) {
+    if (! mask[i])
+      res[j++] = dims[i];
+    else if (keepdims)
+      res[j++] = 1;
+  }
+  return res;
+}
+
+/**
+ * Strides of a contiguous reduced array, expressed in the coordinates
+ * of the original array. Reduced axes get a null stride so that all
+ * the elements along them map onto the same output element.
+ */
+template <std::size_t N, std::size_t M>
+std::array<std::size_t,N>
+reduction_strides(const std::array<std::size_t,N>& dims,
+		  const std::array<std::size_t,M>& axes)
+{
+  auto mask = reduced_axes_mask<N>(axes);
+  auto strides = default_strides(reduced_dims<true>(dims, axes));
+  for (std::size_t i = 0; i < N; i++)
+    if (mask[i])
+      strides[i] = 0;
+  return strides;
+}
+
+/**
+ * Visit the innermost rows of a strided array in memory order.
+ *
+ * For each row, \c op is called with a pointer to its first element,
+ * the stride between its elements, the offset of the matching
+ * element in the output, the output stride along the row (null when
+ * the innermost axis is reduced), and the length of the row.
+ */
+template <typename T, std::size_t N, typename RowOperation>
+void for_each_reduced_row(const StridedArray<T,N>& a,
+			  const std::array<std::size_t,N>& out_strides,
+			  RowOperation op)
+{
+  static_assert(N > 0, "scalar arrays cannot be reduced");
+  if (size(a) == 0)
+    return;
+
+  const auto& strides = a.strides();
+  const auto n = a.dim(N-1);
+  std::array<std::size_t,N> coords;
+  coords.fill(0);
+  const T* in = a.data();
+  std::size_t out = 0;
+
+  for (;;) {
+    op(in, strides[N-1], out, out_strides[N-1], n);
+    // Move to the next row, odometer style
+    std::size_t d = N-1;
+    for (;;) {
+      if (d == 0)
+	return;
+      d--;
+      if (++coords[d] < a.dim(d)) {
+	in += strides[d];
+	out += out_strides[d];
+	break;
+      }
+      in -= (a.dim(d) - 1) * strides[d];
+      out -= (a.dim(d) - 1) * out_strides[d];
+      coords[d] = 0;
+    }
+  }
+}
+
+/**
+ * Visit the innermost rows of an indexable array.
+ *
+ * Rows are evaluated once into a temporary buffer before being given
+ * to \c op.
+ * \see for_each_reduced_row(const StridedArray<T,N>&, const std::array<std::size_t,N>&, RowOperation)
+ */
+template <typename Array, typename RowOperation,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+void for_each_reduced_row(const Array& a,
+			  const std::array<std::size_t,Array::ndim()>& out_strides,
+			  RowOperation op)
+{
+  constexpr auto N = Array::ndim();
+  static_assert(N > 0, "scalar arrays cannot be reduced");
+  if (size(a) == 0)
+    return;
+
+  const auto n = a.dim(N-1);
+  // Not a vector, which packs booleans
+  std::unique_ptr<typename Array::dtype[]> row(new typename Array::dtype[n]);
+  typename Array::dims_type coords;
+  coords.fill(0);
+  std::size_t out = 0;
+
+  for (;;) {
+    for (std::size_t i = 0; i < n; i++) {
+      coords[N-1] = i;
+      row[i] = a(coords);
+    }
+    op(row.get(), 1UL, out, out_strides[N-1], n);
+    std::size_t d = N-1;
+    for (;;) {
+      if (d == 0)
+	return;
+      d--;
+      if (++coords[d] < a.dim(d)) {
+	out += out_strides[d];
+	break;
+      }
+      out -= (a.dim(d) - 1) * out_strides[d];
+      coords[d] = 0;
+    }
+  }
+}
+
+/**
+ * Reduce an array along several axes at once.
+ *
+ * The input is traversed a single time in memory order, each of its
+ * rows being accumulated into the matching output elements with
+ * \c op, starting from \c init. When the innermost axis is kept,
+ * complete output rows are updated at once.
+ *
+ * \param axes     Distinct axes along which to reduce.
+ * \param init     Initial value of each output element.
+ * \param op       Associative binary operation.
+ * \tparam keepdims Keep the reduced axes with a size of 1.
+ */
+template <bool keepdims=false, typename Array, std::size_t M,
+	  typename T=typename Array::dtype, typename BinaryOperation,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T, keepdims ? Array::ndim() : Array::ndim()-M>
+reduce(const Array& a, const std::array<std::size_t,M>& axes,
+       T init, BinaryOperation op)
+{
+  StridedArray<T, keepdims ? Array::ndim() : Array::ndim()-M>
+    res(reduced_dims<keepdims>(a.dims(), axes));
+  res.fill(init);
+
+  T* o = res.data();
+  for_each_reduced_row(a, reduction_strides(a.dims(), axes),
+		       [o,&op](const auto* in, std::size_t is,
+			       std::size_t off, std::size_t os, std::size_t n) {
+      if (os == 0) {
+	// Whole row reduced into a single element
+	T acc = o[off];
+	for (std::size_t i = 0; i < n; i++)
+	  acc = op(acc, in[i*is]);
+	o[off] = acc;
+      }
+      else if (is == 1 && os == 1) {
+	// Contiguous row update
+	T* out = o + off;
+	for (std::size_t i = 0; i < n; i++)
+	  out[i] = op(out[i], in[i]);
+      }
+      else {
+	for (std::size_t i = 0; i < n; i++)
+	  o[off+i*os] = op(o[off+i*os], in[i*is]);
+      }
+    });
+
+  return res;
+}
+
+/**
+ * Number of elements merged into each output element of a reduction.
+ */
+template <std::size_t N, std::size_t M>
+std::size_t reduction_size(const std::array<std::size_t,N>& dims,
+			   const std::array<std::size_t,M>& axes)
+{
+  std::size_t n = 1;
+  for (auto axis : axes)
+    n *= dims[axis];
+  return n;
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
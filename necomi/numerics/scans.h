@@ -0,0 +1,218 @@
+// necomi/numerics/scans.h – Prefix scans along array axes
+//
+// Copyright © 2016 Émilien Tlapale
+// Licensed under the Simplified BSD License.
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "../arrays/stridedarray.h"
+#include "../core/parallel.h"
+
+namespace necomi
+{
+
+/**
+ * Kind of prefix scan.
+ *
+ * An inclusive scan of x gives x0, x0∘x1, x0∘x1∘x2, …, while an
+ * exclusive one gives e, x0, x0∘x1, … with e the identity element.
+ */
+enum class ScanType
+{
+  INCLUSIVE,
+  EXCLUSIVE,
+};
+
+/// Minimal number of elements processed by each scanning thread.
+constexpr std::size_t scan_grain = 1UL << 14;
+
+/**
+ * Scan in place a contiguous line of elements, starting from \c acc.
+ */
+template <typename T, typename BinaryOperation>
+void scan_line(T* x, std::size_t n, T acc, BinaryOperation& op,
+	       ScanType type)
+{
+  if (type == ScanType::INCLUSIVE) {
+    for (std::size_t i = 0; i < n; i++)
+      x[i] = acc = op(acc, x[i]);
+  }
+  else {
+    for (std::size_t i = 0; i < n; i++) {
+      const T t = x[i];
+      x[i] = acc;
+      acc = op(acc, t);
+    }
+  }
+}
+
+/**
+ * Scan in place a single long contiguous line with several threads.
+ *
+ * The line is split in blocks. A first pass reduces each block
+ * independently, the block totals are then scanned, and a second
+ * pass scans each block starting from the total of the previous
+ * ones.
+ */
+template <typename T, typename BinaryOperation>
+void parallel_scan_line(T* x, std::size_t n, T init, BinaryOperation& op,
+			ScanType type)
+{
+  // Blocks are recorded by the first pass, as the number of threads
+  // may change before the second one
+  const auto max_blocks = std::max<std::size_t>(n / scan_grain, 1);
+  std::vector<T> totals(max_blocks, init);
+  std::vector<std::size_t> ends(max_blocks, 0);
+  parallel_for_blocks(n, [x,init,&op,&totals,&ends]
+		      (std::size_t b, std::size_t begin, std::size_t end) {
+      T acc = init;
+      for (std::size_t i = begin; i < end; i++)
+	acc = op(acc, x[i]);
+      totals[b] = acc;
+      ends[b] = end;
+    }, scan_grain);
+  const auto nblocks = static_cast<std::size_t>
+    (std::find(ends.begin(), ends.end(), 0) - ends.begin());
+
+  // Prefix of each block
+  scan_line(totals.data(), nblocks, init, op, ScanType::EXCLUSIVE);
+
+  parallel_for(nblocks, [x,&op,&totals,&ends,type]
+	       (std::size_t first, std::size_t last) {
+      for (std::size_t b = first; b < last; b++) {
+	const auto begin = b > 0 ? ends[b-1] : 0;
+	scan_line(x + begin, ends[b] - begin, totals[b], op, type);
+      }
+    });
+}
+
+/**
+ * Scan in place a contiguous array along one of its dimensions.
+ */
+template <typename T, std::size_t N, typename BinaryOperation>
+void scan_inplace(StridedArray<T,N>& a, std::size_t dim, T init,
+		  BinaryOperation op, ScanType type)
+{
+  const auto& dims = a.dims();
+  std::size_t outer = 1, inner = 1;
+  for (std::size_t i = 0; i < dim; i++)
+    outer *= dims[i];
+  for (std::size_t i = dim + 1; i < N; i++)
+    inner *= dims[i];
+  const auto len = dims[dim];
+  T* data = a.data();
+
+  if (outer * inner == 0 || len == 0)
+    return;
+
+  if (inner == 1) {
+    // Contiguous lines: either a few long lines scanned by blocks,
+    // or many independent lines distributed among threads
+    if (outer < num_threads() && len >= 2 * scan_grain) {
+      for (std::size_t o = 0; o < outer; o++)
+	parallel_scan_line(data + o*len, len, init, op, type);
+    }
+    else {
+      parallel_for(outer, [data,len,init,&op,type]
+		   (std::size_t begin, std::size_t end) {
+	  for (std::size_t o = begin; o < end; o++)
+	    scan_line(data + o*len, len, init, op, type);
+	}, std::max<std::size_t>(scan_grain / len, 1));
+    }
+    return;
+  }
+
+  // Scanned axis is not the innermost: adjacent lines are scanned
+  // together, one contiguous row of them at a time. Rows are split in
+  // chunks so that each thread gets some of them.
+  const auto chunk = std::min(inner, std::max<std::size_t>(1024, inner / num_threads()));
+  const auto nchunks = (inner + chunk - 1) / chunk;
+  parallel_for(outer * nchunks, [=,&op](std::size_t begin, std::size_t end) {
+      std::vector<T> acc;
+      for (std::size_t task = begin; task < end; task++) {
+	const auto o = task / nchunks;
+	const auto i0 = (task % nchunks) * chunk;
+	const auto m = std::min(chunk, inner - i0);
+	T* row = data + o*len*inner + i0;
+	if (type == ScanType::INCLUSIVE) {
+	  for (std::size_t k = 1; k < len; k++) {
+	    T* prev = row;
+	    row += inner;
+	    for (std::size_t i = 0; i < m; i++)
+	      row[i] = op(prev[i], row[i]);
+	  }
+	}
+	else {
+	  acc.assign(m, init);
+	  for (std::size_t k = 0; k < len; k++, row += inner) {
+	    for (std::size_t i = 0; i < m; i++) {
+	      const T t = row[i];
+	      row[i] = acc[i];
+	      acc[i] = op(acc[i], t);
+	    }
+	  }
+	}
+      }
+    }, std::max<std::size_t>(scan_grain / (len * chunk), 1));
+}
+
+/**
+ * Prefix scan of an array along a dimension.
+ *
+ * Independent lines are processed by several threads. A single long
+ * line is split into blocks scanned in two passes, and lines along a
+ * non-innermost dimension are scanned together, one contiguous row at
+ * a time.
+ *
+ * \param dim   Dimension along which to scan.
+ * \param init  Identity element of \c op.
+ * \param op    Associative binary operation.
+ * \param type  Whether each element is included in its own result.
+ */
+template <typename Array, typename BinaryOperation,
+	  typename T=typename Array::dtype,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+StridedArray<T,Array::ndim()> scan(const Array& a, std::size_t dim,
+				   T init, BinaryOperation op,
+				   ScanType type = ScanType::INCLUSIVE)
+{
+  static_assert(Array::ndim() > 0, "scalar arrays cannot be scanned");
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dim >= Array::ndim())
+    throw std::out_of_range("invalid scanning dimension");
+#endif
+  auto res = strided_array<T>(a);
+  scan_inplace(res, dim, init, op, type);
+  return res;
+}
+
+/**
+ * Cumulative sum.
+ */
+template <typename Indexable, typename T=typename Indexable::dtype>
+StridedArray<T,Indexable::ndim()> cumsum(const Indexable& a, std::size_t dim = 0,
+					 ScanType type = ScanType::INCLUSIVE)
+{
+  return scan(a, dim, static_cast<T>(0), std::plus<T>(), type);
+}
+
+/**
+ * Cumulative product.
+ */
+template <typename Indexable, typename T=typename Indexable::dtype>
+StridedArray<T,Indexable::ndim()> cumprod(const Indexable& a, std::size_t dim = 0,
+					  ScanType type = ScanType::INCLUSIVE)
+{
+  return scan(a, dim, static_cast<T>(1), std::multiplies<T>(), type);
+}
+
+} // namespace necomi
+
+// Local Variables:
+// mode: c++
+// End:
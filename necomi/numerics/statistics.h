@@ -6,8 +6,22 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "../arrays/delayed.h"
 #include "../arrays/stridedarray.h"
+#include "../core/coordinates.h"
+#include "../core/parallel.h"
+#include "exponents.h"
+#include "reductions.h"
+#include "scans.h"
 
 namespace necomi
 {
@@ -84,6 +98,207 @@ T min(const Array& a)
 }
 
 
+/**
+ * Sum an array along several axes at once.
+ *
+ * The result is computed immediately in a single pass over the
+ * input, in memory order.
+ * \tparam keepdims Keep the summed axes with a size of 1.
+ */
+template <bool keepdims=false, typename Array, std::size_t M,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto sum(const Array& a, const std::array<std::size_t,M>& axes)
+{
+  using T = typename Array::dtype;
+  return reduce<keepdims>(a, axes, static_cast<T>(0), std::plus<T>());
+}
+
+/**
+ * Average an array along several axes at once.
+ * \tparam keepdims Keep the averaged axes with a size of 1.
+ */
+template <bool keepdims=false, typename Array, std::size_t M,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto average(const Array& a, const std::array<std::size_t,M>& axes)
+{
+  using T = typename Array::dtype;
+  auto res = sum<keepdims>(a, axes);
+  const auto n = static_cast<T>(reduction_size(a.dims(), axes));
+  T* p = res.data();
+  for (std::size_t i = 0; i < size(res); i++)
+    p[i] /= n;
+  return res;
+}
+
+/**
+ * Compute a sample variance along several axes with a two-pass formula.
+ *
+ * Both passes traverse the input in memory order: the first one
+ * computes the averages, the second one accumulates the squared
+ * deviations to them.
+ * \tparam keepdims Keep the reduced axes with a size of 1.
+ * \see variance(const Array&, dim_type, bool) for the Bessel correction.
+ */
+template <bool keepdims=false, typename Array, std::size_t M,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto variance(const Array& a, const std::array<std::size_t,M>& axes,
+	      bool bessel_correction)
+{
+  using T = typename Array::dtype;
+  static_assert(std::is_floating_point<T>::value,
+		"statistics on arrays require floating elements");
+
+  const auto avg = average<keepdims>(a, axes);
+  auto res = avg.copy();
+  res.fill(0);
+
+  const T* m = avg.data();
+  T* o = res.data();
+  for_each_reduced_row(a, reduction_strides(a.dims(), axes),
+		       [m,o](const auto* in, std::size_t is,
+			     std::size_t off, std::size_t os, std::size_t n) {
+      if (os == 0) {
+	const T mu = m[off];
+	T acc = 0;
+	for (std::size_t i = 0; i < n; i++)
+	  acc += power<2>(in[i*is] - mu);
+	o[off] += acc;
+      }
+      else {
+	for (std::size_t i = 0; i < n; i++)
+	  o[off+i*os] += power<2>(in[i*is] - m[off+i*os]);
+      }
+    });
+
+  const auto n = reduction_size(a.dims(), axes);
+  const T div = bessel_correction ? n - 1 : n;
+  for (std::size_t i = 0; i < size(res); i++)
+    o[i] /= div;
+  return res;
+}
+
+/**
+ * Compute a sample standard deviation along several axes.
+ * \see variance(const Array&, const std::array<std::size_t,M>&, bool)
+ */
+template <bool keepdims=false, typename Array, std::size_t M,
+	  std::enable_if_t<is_indexable<Array>::value>* = nullptr>
+auto deviation(const Array& a, const std::array<std::size_t,M>& axes,
+	       bool bessel_correction)
+{
+  auto res = variance<keepdims>(a, axes, bessel_correction);
+  auto p = res.data();
+  for (std::size_t i = 0; i < size(res); i++)
+    p[i] = std::sqrt(p[i]);
+  return res;
+}
+
+
+/**
+ * Statistics computed along a single axis of an array.
+ */
+enum class AxisStatistic
+{
+  SUM,
+  AVERAGE,
+  VARIANCE,
+  DEVIATION,
+};
+
+/**
+ * Delayed expression computing a statistic along an axis.
+ *
+ * Elements accessed one at a time scan the whole reduced axis, while
+ * a materialization of the complete result goes through the eager
+ * reductions, which traverse the input only once in memory order.
+ */
+template <typename Array, AxisStatistic S>
+class AxisStatisticExpr
+{
+public:
+  using T = typename Array::dtype;
+  using dims_type = std::array<std::size_t,Array::ndim()-1>;
+
+  AxisStatisticExpr(const Array& a, std::size_t dim,
+		    bool bessel_correction = false)
+    : m_a(a), m_dim(dim), m_bessel_correction(bessel_correction)
+  {}
+
+  T operator()(const dims_type& x) const
+  {
+    // Path in the original array
+    auto orig_path = add_coordinate(x, m_dim);
+    const auto n = m_a.dim(m_dim);
+    // Sum all the elements in the dimension
+    T val = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      orig_path[m_dim] = i;
+      val += m_a(orig_path);
+    }
+    if (S == AxisStatistic::SUM)
+      return val;
+    const T avg = val / static_cast<T>(n);
+    if (S == AxisStatistic::AVERAGE)
+      return avg;
+    // Sum the squared deviations to the mean
+    T dev = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      orig_path[m_dim] = i;
+      dev += power<2>(m_a(orig_path) - avg);
+    }
+    dev /= (m_bessel_correction ? n - 1 : n);
+    return S == AxisStatistic::VARIANCE ? dev : std::sqrt(dev);
+  }
+
+  /**
+   * Compute the complete result with the eager reductions, which only
+   * handle floating point variances: integral variances keep being
+   * computed element by element.
+   */
+  template <AxisStatistic U = S,
+	    std::enable_if_t<std::is_floating_point<T>::value
+			     || U == AxisStatistic::SUM
+			     || U == AxisStatistic::AVERAGE>* = nullptr>
+  StridedArray<T,Array::ndim()-1> materialize() const
+  {
+    return materialize(std::integral_constant<AxisStatistic,S>());
+  }
+
+protected:
+  using axes_type = std::array<std::size_t,1>;
+
+  auto materialize(std::integral_constant<AxisStatistic,AxisStatistic::SUM>) const
+  { return sum(m_a, axes_type{m_dim}); }
+
+  auto materialize(std::integral_constant<AxisStatistic,AxisStatistic::AVERAGE>) const
+  { return average(m_a, axes_type{m_dim}); }
+
+  auto materialize(std::integral_constant<AxisStatistic,AxisStatistic::VARIANCE>) const
+  { return variance(m_a, axes_type{m_dim}, m_bessel_correction); }
+
+  auto materialize(std::integral_constant<AxisStatistic,AxisStatistic::DEVIATION>) const
+  { return deviation(m_a, axes_type{m_dim}, m_bessel_correction); }
+
+  Array m_a;
+  std::size_t m_dim;
+  bool m_bessel_correction;
+};
+
+/**
+ * Create a delayed array computing a statistic along an axis.
+ */
+template <AxisStatistic S, typename Array>
+auto make_axis_statistic(const Array& a, std::size_t dim,
+			 bool bessel_correction = false)
+{
+#ifndef NECOMI_NO_BOUND_CHECKS
+  if (dim >= Array::ndim())
+    throw std::out_of_range("invalid reduction axis");
+#endif
+  return make_delayed(remove_coordinate(a.dims(), dim),
+		      AxisStatisticExpr<Array,S>(a, dim, bessel_correction));
+}
+
 /**
  * Sum an array across a given dimension.
  */
@@ -91,18 +306,7 @@ template <typename Array, typename dim_type = typename Array::dim_type,
 	  typename std::enable_if<Array::ndim() != 0>::type* = nullptr>
 auto sum(const Array&a, dim_type dim)
 {
-  return make_delayed(remove_coordinate(a.dims(), dim),
-		      [a,dim] (const auto& x) {
-			// Path in the original array
-			auto orig_path = add_coordinate(x, dim);
-			// Sum all the elements in the dimension
-			typename Array::dtype val = 0;
-			for (std::size_t i = 0; i < a.dims()[dim]; i++) {
-			  orig_path[dim] = i;
-			  val += a(orig_path);
-			}
-			return val;
-		      });
+  return make_axis_statistic<AxisStatistic::SUM>(a, dim);
 }
 
 /**
@@ -112,7 +316,7 @@ template <typename Array, typename dim_type = typename Array::dim_type,
 	  typename std::enable_if_t<Array::ndim() != 0>* = nullptr>
 auto average(const Array& a, dim_type dim)
 {
-  return sum(a,dim) / static_cast<typename Array::dtype>(a.dims()[dim]);
+  return make_axis_statistic<AxisStatistic::AVERAGE>(a, dim);
 }
 
 /**
@@ -130,9 +334,6 @@ auto average(const Array& a)
 /**
  * Compute a sample variance with a two-pass formula.
  *
- * When the function is called, the average along the given dimension
- * is computed and stored in an immediate array.
- *
  * When the Bessel correction is enabled, an N-1 divider is used
  * (default in Matlab), otherwise a N divider is used (default
  * in NumPy).
@@ -141,21 +342,8 @@ template <typename Array, typename dim_type = typename Array::dim_type,
 	  typename std::enable_if_t<Array::ndim() != 0>* = nullptr>
 auto variance(const Array& a, dim_type dim, bool bessel_correction)
 {
-  auto avg = strided_array(average(a, dim));
-  return make_delayed(remove_coordinate(a.dims(), dim),
-		      [a,dim,avg,bessel_correction]
-		      (const auto& x)
-		      {
-			// Path in the original array
-			auto orig_path = add_coordinate(x, dim);
-			// Sum the squared deviations to the mean
-			typename Array::dtype val = 0;
-			for (std::size_t i = 0; i < a.dims()[dim]; i++) {
-			  orig_path[dim] = i;
-			  val += power<2>(a(orig_path) - avg(x));
-			}
-			return val / (bessel_correction ? a.dim(dim) - 1 : a.dim(dim));
-		      });
+  return make_axis_statistic<AxisStatistic::VARIANCE>(a, dim,
+						      bessel_correction);
 }
 
 template <typename Array,
@@ -176,7 +364,8 @@ template <typename Array, typename dim_type = typename Array::dim_type,
 	  typename std::enable_if_t<Array::ndim() != 0>* = nullptr>
 auto deviation(const Array& a, dim_type dim, bool bessel_correction)
 {
-  return sqrt(variance(a, dim, bessel_correction));
+  return make_axis_statistic<AxisStatistic::DEVIATION>(a, dim,
+						       bessel_correction);
 }
 
 template <typename Array,
@@ -198,28 +387,339 @@ auto max(const Array& a, U value)
 		      });
   }
 
+/// Number of samples centered at once by the covariance kernel.
+constexpr std::size_t covariance_tile = 256;
+/// Number of channels in the blocks of the covariance kernel.
+constexpr std::size_t covariance_block = 64;
+
+/**
+ * Per-channel means of contiguous [samples × channels] data.
+ */
+template <typename T, typename U>
+std::vector<T> channel_means(const U* x, std::size_t n, std::size_t c)
+{
+  const auto nblocks = parallel_blocks(n, covariance_tile);
+  std::vector<T> sums(nblocks * c, 0);
+  parallel_for_blocks(n, [x,c,&sums]
+		      (std::size_t b, std::size_t begin, std::size_t end) {
+      T* s = sums.data() + b*c;
+      for (std::size_t r = begin; r < end; r++) {
+	const U* row = x + r*c;
+	for (std::size_t k = 0; k < c; k++)
+	  s[k] += static_cast<T>(row[k]);
+      }
+    }, covariance_tile);
 
+  std::vector<T> mean(c, 0);
+  for (std::size_t b = 0; b < nblocks; b++)
+    for (std::size_t k = 0; k < c; k++)
+      mean[k] += sums[b*c + k];
+  for (auto& m : mean)
+    m /= static_cast<T>(n);
+  return mean;
+}
 
 /**
- * Cumulative sum.
+ * Accumulate centered cross-products of contiguous [samples × channels]
+ * data in the upper triangle of a [channels × channels] matrix.
+ *
+ * Samples are centered a tile at a time into \c buf, and the tile is
+ * then traversed once per block of channel pairs, so that both the
+ * tile and the accumulated block remain in cache. The innermost loop
+ * runs over contiguous channels and is left to compiler vectorization.
  */
-template <typename Indexable, typename T=typename Indexable::dtype>
-StridedArray<T,Indexable::ndim()> cumsum(const Indexable& a, std::size_t dim = 0)
+template <typename T, typename U>
+void add_cross_products(const U* x, std::size_t n, std::size_t c,
+			const T* mean, T* acc, std::vector<T>& buf)
 {
-  StridedArray<T,Indexable::ndim()> res(a.dims());
-  res.map([&res,dim,&a](auto& path, auto& valx) {
-      if (path[dim] == 0) {
-	valx = a(path);
+  buf.resize(covariance_tile * c);
+  for (std::size_t r0 = 0; r0 < n; r0 += covariance_tile) {
+    const auto m = std::min(covariance_tile, n - r0);
+    for (std::size_t r = 0; r < m; r++) {
+      const U* row = x + (r0 + r)*c;
+      T* centered = buf.data() + r*c;
+      for (std::size_t k = 0; k < c; k++)
+	centered[k] = static_cast<T>(row[k]) - mean[k];
+    }
+
+    for (std::size_t ib = 0; ib < c; ib += covariance_block) {
+      const auto ie = std::min(ib + covariance_block, c);
+      for (std::size_t jb = ib; jb < c; jb += covariance_block) {
+	const auto je = std::min(jb + covariance_block, c);
+	for (std::size_t r = 0; r < m; r++) {
+	  const T* row = buf.data() + r*c;
+	  for (std::size_t i = ib; i < ie; i++) {
+	    const T xi = row[i];
+	    T* a = acc + i*c;
+	    for (std::size_t j = std::max(i, jb); j < je; j++)
+	      a[j] += xi * row[j];
+	  }
+	}
       }
-      else {
-	auto prev = path;
-	prev[dim]--;
-	valx = res(prev) + a(path);
+    }
+  }
+}
+
+/**
+ * Sums of centered cross-products of contiguous [samples × channels]
+ * data, computed by several threads.
+ */
+template <typename T, typename U>
+StridedArray<T,2> comoments(const U* x, std::size_t n, std::size_t c,
+			    const T* mean)
+{
+  // Each thread accumulates its samples into a private matrix
+  const auto nblocks = parallel_blocks(n, covariance_tile);
+  std::vector<T> partial(nblocks * c * c, 0);
+  parallel_for_blocks(n, [=,&partial]
+		      (std::size_t b, std::size_t begin, std::size_t end) {
+      std::vector<T> buf;
+      add_cross_products(x + begin*c, end - begin, c, mean,
+			 partial.data() + b*c*c, buf);
+    }, covariance_tile);
+
+  StridedArray<T,2> res(c, c);
+  T* out = res.data();
+  const T* in = partial.data();
+  parallel_for(c, [=](std::size_t begin, std::size_t end) {
+      for (std::size_t i = begin; i < end; i++) {
+	for (std::size_t j = i; j < c; j++) {
+	  T s = 0;
+	  for (std::size_t b = 0; b < nblocks; b++)
+	    s += in[b*c*c + i*c + j];
+	  out[i*c + j] = s;
+	}
       }
     });
+  // Symmetric lower triangle
+  for (std::size_t i = 0; i < c; i++)
+    for (std::size_t j = 0; j < i; j++)
+      out[i*c + j] = out[j*c + i];
+
   return res;
 }
 
+/**
+ * Streaming covariance of multi-channel samples.
+ *
+ * Frames of dimensions [samples × channels] are given to update(),
+ * which computes their means and centered cross-products in two
+ * passes over the frame and combines them with the statistics of the
+ * previous frames. Accumulators filled separately can be combined
+ * with merge().
+ */
+template <typename T>
+class Covariance
+{
+  static_assert(std::is_floating_point<T>::value,
+		"covariances require floating point values");
+
+public:
+  explicit Covariance(std::size_t channels)
+    : m_count(0), m_mean(channels), m_comoment(channels, channels)
+  {
+    reset();
+  }
+
+  /**
+   * Copy an accumulator, without sharing its statistics, so that
+   * copies can be updated independently and merged back.
+   */
+  Covariance(const Covariance& other)
+    : m_count(other.m_count)
+    , m_mean(other.m_mean.copy())
+    , m_comoment(other.m_comoment.copy())
+  {}
+
+  /**
+   * Replace the statistics by a copy of another accumulator,
+   * possibly over a different number of channels.
+   */
+  Covariance& operator=(const Covariance& other)
+  {
+    Covariance tmp(other);
+    swap(tmp);
+    return *this;
+  }
+
+  /// Exchange the statistics of two accumulators.
+  void swap(Covariance& other) noexcept
+  {
+    std::swap(m_count, other.m_count);
+    m_mean.swap(other.m_mean);
+    m_comoment.swap(other.m_comoment);
+  }
+
+  /**
+   * Forget all the samples seen so far.
+   */
+  void reset()
+  {
+    m_count = 0;
+    m_mean.fill(0);
+    m_comoment.fill(0);
+  }
+
+  /// Number of channels.
+  std::size_t channels() const
+  { return m_mean.dim(0); }
+
+  /// Number of samples accumulated.
+  std::size_t count() const
+  { return m_count; }
+
+  /**
+   * Add a frame of [samples × channels] to the statistics.
+   */
+  template <typename Array,
+	    std::enable_if_t<is_indexable<Array>::value
+			     && Array::ndim() == 2>* = nullptr>
+  Covariance& update(const Array& frame)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (frame.dim(1) != channels())
+      throw std::length_error("frame channels differ from the accumulated ones");
+#endif
+    const auto n = frame.dim(0);
+    if (n == 0)
+      return *this;
+
+    auto c = contiguous_array(frame);
+    Covariance<T> other(channels());
+    other.m_count = n;
+    const auto mean = channel_means<T>(c.data(), n, channels());
+    std::copy(mean.begin(), mean.end(), other.m_mean.data());
+    other.m_comoment = comoments(c.data(), n, channels(), mean.data());
+    return merge(other);
+  }
+
+  /**
+   * Combine the statistics of another accumulator into this one.
+   */
+  Covariance& merge(const Covariance& other)
+  {
+#ifndef NECOMI_NO_BOUND_CHECKS
+    if (other.channels() != channels())
+      throw std::length_error("cannot merge covariances of different channels");
+#endif
+    if (other.m_count == 0)
+      return *this;
+    if (m_count == 0) {
+      m_count = other.m_count;
+      m_mean = other.m_mean;
+      m_comoment = other.m_comoment;
+      return *this;
+    }
+
+    const auto c = channels();
+    const T na = static_cast<T>(m_count);
+    const T nb = static_cast<T>(other.m_count);
+    const T n = na + nb;
+    std::vector<T> delta(c);
+    T* mean = m_mean.data();
+    const T* omean = other.m_mean.data();
+    for (std::size_t k = 0; k < c; k++)
+      delta[k] = omean[k] - mean[k];
+
+    T* cm = m_comoment.data();
+    const T* ocm = other.m_comoment.data();
+    const T f = na * nb / n;
+    for (std::size_t i = 0; i < c; i++)
+      for (std::size_t j = 0; j < c; j++)
+	cm[i*c + j] += ocm[i*c + j] + f * delta[i] * delta[j];
+    for (std::size_t k = 0; k < c; k++)
+      mean[k] += delta[k] * nb / n;
+    m_count += other.m_count;
+
+    return *this;
+  }
+
+  /// Per-channel mean.
+  const StridedArray<T,1>& mean() const
+  { return m_mean; }
+
+  /// Sums of centered cross-products between channels.
+  const StridedArray<T,2>& comoment() const
+  { return m_comoment; }
+
+  /**
+   * Covariance matrix of the channels.
+   * \see variance(const Array&, dim_type, bool) for the Bessel correction.
+   */
+  StridedArray<T,2> covariance(bool bessel_correction) const
+  {
+    auto res = m_comoment.copy();
+    if (m_count <= (bessel_correction ? 1U : 0U)) {
+#ifndef NECOMI_NO_BOUND_CHECKS
+      throw std::domain_error("not enough samples to estimate the covariance");
+#endif
+      res.fill(std::numeric_limits<T>::quiet_NaN());
+      return res;
+    }
+    const T div = static_cast<T>(bessel_correction ? m_count - 1 : m_count);
+    T* p = res.data();
+    for (std::size_t k = 0; k < size(res); k++)
+      p[k] /= div;
+    return res;
+  }
+
+  /// Pearson correlation coefficients of the channels.
+  StridedArray<T,2> correlation() const
+  {
+    const auto c = channels();
+    auto res = m_comoment.copy();
+    T* p = res.data();
+    std::vector<T> norm(c);
+    for (std::size_t k = 0; k < c; k++)
+      norm[k] = 1 / std::sqrt(p[k*c + k]);
+    for (std::size_t i = 0; i < c; i++)
+      for (std::size_t j = 0; j < c; j++)
+	p[i*c + j] *= norm[i] * norm[j];
+    return res;
+  }
+
+protected:
+  /// Number of samples accumulated.
+  std::size_t m_count;
+  /// Running per-channel mean.
+  StridedArray<T,1> m_mean;
+  /// Running sums of centered cross-products.
+  StridedArray<T,2> m_comoment;
+};
+
+/// Element type of covariances computed on arrays of T.
+template <typename T>
+using covariance_type = std::conditional_t<std::is_floating_point<T>::value, T, double>;
+
+/**
+ * Covariance matrix of the channels of [samples × channels] data.
+ *
+ * The data is read twice, once for the means and once for the
+ * centered cross-products of all the channel pairs, both passes being
+ * split among threads.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value
+			   && Array::ndim() == 2>* = nullptr>
+auto cov(const Array& a, bool bessel_correction)
+{
+  Covariance<covariance_type<typename Array::dtype>> c(a.dim(1));
+  c.update(a);
+  return c.covariance(bessel_correction);
+}
+
+/**
+ * Pearson correlation coefficients of the channels of [samples × channels] data.
+ */
+template <typename Array,
+	  std::enable_if_t<is_indexable<Array>::value
+			   && Array::ndim() == 2>* = nullptr>
+auto corrcoef(const Array& a)
+{
+  Covariance<covariance_type<typename Array::dtype>> c(a.dim(1));
+  c.update(a);
+  return c.correlation();
+}
 
 } // namespace necomi
 
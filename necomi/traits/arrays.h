@@ -77,6 +77,17 @@ struct is_indexable<T, std::enable_if_t<is_array<T>::value,void>>
 			   is_callable<T,const typename T::dims_type&>::value>
 {};
 
+/**
+ * Test whether an array can be evaluated at once by a materialize()
+ * member function instead of element by element.
+ */
+template <typename T, typename = void>
+struct is_materializable : std::false_type {};
+
+template <typename T>
+struct is_materializable<T, decltype(std::declval<const T&>().materialize(), void())>
+  : std::true_type {};
+
 template <typename T, typename = void>
 struct is_modifiable : std::false_type {};
 
@@ -0,0 +1,145 @@
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+using namespace necomi;
+
+
+// Flood fill labeling in row-major order of the first elements
+template <typename T, std::size_t N>
+static StridedArray<std::size_t,N> flood_labels(const StridedArray<T,N>& a, Connectivity c,
+						std::size_t& count)
+{
+  StridedArray<std::size_t,N> labels(a.dims());
+  labels = 0;
+  count = 0;
+  auto neighbors = preceding_neighbors<N>(c);
+  auto nb = neighbors;
+  for (auto o : neighbors) {
+    for (auto& x : o)
+      x = -x;
+    nb.push_back(o);
+  }
+  a.map([&](const auto& coords, auto& val) {
+      if (val == T(0) || labels(coords) != 0)
+	return;
+      labels(coords) = ++count;
+      std::vector<std::array<std::size_t,N>> stack{coords};
+      while (! stack.empty()) {
+	auto p = stack.back();
+	stack.pop_back();
+	for (const auto& o : nb) {
+	  auto q = p;
+	  bool inside = true;
+	  for (std::size_t d = 0; d < N; d++) {
+	    auto x = static_cast<std::ptrdiff_t>(p[d]) + o[d];
+	    inside = inside && x >= 0 && x < static_cast<std::ptrdiff_t>(a.dim(d));
+	    q[d] = static_cast<std::size_t>(x);
+	  }
+	  if (inside && labels(q) == 0 && a(q) == val) {
+	    labels(q) = count;
+	    stack.push_back(q);
+	  }
+	}
+      }
+    });
+  return labels;
+}
+
+TEST_CASE( "connected component labeling", "[algorithms]" ) {
+  SECTION( "2D masks with both connectivities" ) {
+    StridedArray<double,2> a(67, 45);
+    a.map([](auto& coords, auto& val) {
+	val = std::sin(0.9*coords[0] + 0.1*coords[1]*coords[1]) * std::cos(0.7*coords[1]);
+      });
+    auto mask = strided_array(a > 0.3);
+
+    for (auto c : {Connectivity::FACE, Connectivity::FULL}) {
+      std::vector<Component<2>> comps;
+      auto labels = label_components(mask, comps, c);
+      std::size_t count;
+      auto expected = flood_labels(mask, c, count);
+      REQUIRE( count > 10 );
+      REQUIRE( comps.size() == count );
+      REQUIRE( sum(labels != expected) == 0 );
+
+      // Sizes and bounding boxes
+      bool ok = true;
+      for (auto k = 1UL; k <= count; k++) {
+	std::size_t size = 0;
+	std::array<std::size_t,2> lo{{67, 45}}, hi{{0, 0}};
+	labels.map([&](const auto& coords, auto& val) {
+	    if (val != k)
+	      return;
+	    size++;
+	    for (auto d = 0; d < 2; d++) {
+	      lo[d] = std::min(lo[d], coords[d]);
+	      hi[d] = std::max(hi[d], coords[d] + 1);
+	    }
+	  });
+	ok = ok && comps[k-1].size == size && comps[k-1].lower == lo && comps[k-1].upper == hi;
+      }
+      REQUIRE( ok );
+    }
+  }
+
+  SECTION( "labels do not depend on the number of threads" ) {
+    StridedArray<int,2> a(200, 30);
+    a.map([](auto& coords, auto& val) {
+	val = ((coords[0] * 13 + coords[1] * 7) % 11) < 6;
+      });
+    set_num_threads(1);
+    auto l1 = label_components(a, Connectivity::FULL);
+    set_num_threads(7);
+    std::vector<Component<2>> comps;
+    auto l7 = label_components(a, comps, Connectivity::FULL);
+    set_num_threads(0);
+    REQUIRE( sum(l1 != l7) == 0 );
+    std::size_t count;
+    auto expected = flood_labels(a, Connectivity::FULL, count);
+    REQUIRE( sum(l7 != expected) == 0 );
+  }
+
+  SECTION( "the number of threads may change while labeling" ) {
+    StridedArray<int,2> a(400, 60);
+    a.map([](auto& coords, auto& val) {
+	val = ((coords[0] * 13 + coords[1] * 7) % 11) < 6;
+      });
+    std::size_t count;
+    auto expected = flood_labels(a, Connectivity::FACE, count);
+    std::atomic<bool> done(false);
+    std::thread changer([&done]() {
+	for (std::size_t n = 1; ! done; n = n % 7 + 1)
+	  set_num_threads(n);
+      });
+    bool same = true;
+    for (int k = 0; k < 20; k++) {
+      std::vector<Component<2>> comps;
+      auto labels = label_components(a, comps, Connectivity::FACE);
+      same = same && sum(labels != expected) == 0 && comps.size() == count;
+    }
+    done = true;
+    changer.join();
+    set_num_threads(0);
+    REQUIRE( same );
+  }
+
+  SECTION( "3D label arrays" ) {
+    StridedArray<int,3> a(13, 11, 9);
+    a.map([](auto& coords, auto& val) {
+	val = static_cast<int>((coords[0]/3 + coords[1]/4 + coords[2]*coords[0] / 17) % 4);
+      });
+    for (auto c : {Connectivity::FACE, Connectivity::FULL}) {
+      set_num_threads(4);
+      auto labels = label_components(a, c);
+      set_num_threads(0);
+      std::size_t count;
+      auto expected = flood_labels(a, c, count);
+      REQUIRE( sum(labels != expected) == 0 );
+    }
+  }
+}
@@ -0,0 +1,121 @@
+#include <cmath>
+#include <cstdint>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/filters/box.h>
+using namespace necomi;
+
+
+// Brute-force box sum of a 2D array clipped to its bounds
+template <typename T>
+static double naive_box_sum(const StridedArray<T,2>& a, std::size_t i, std::size_t j,
+			    std::size_t ri, std::size_t rj, std::size_t& count)
+{
+  double sum = 0;
+  count = 0;
+  for (auto y = i > ri ? i - ri : 0; y < std::min(i + ri + 1, a.dim(0)); y++)
+    for (auto x = j > rj ? j - rj : 0; x < std::min(j + rj + 1, a.dim(1)); x++) {
+      sum += a(y, x);
+      count++;
+    }
+  return sum;
+}
+
+SCENARIO( "integral images sum the preceding elements", "[filters]" ) {
+  GIVEN( "an image of saturated bytes" ) {
+    StridedArray<std::uint8_t,2> a(300, 200);
+    a = 255;
+
+    WHEN( "its integral image is computed" ) {
+      auto table = integral_image(a);
+      THEN( "it uses a wide accumulator" ) {
+	REQUIRE( std::is_same<decltype(table)::dtype, std::uint64_t>::value );
+	REQUIRE( table.dims() == (std::array<std::size_t,2>{{301, 201}}) );
+      }
+      THEN( "its elements are sums of the preceding ones" ) {
+	REQUIRE( table(0, 0) == 0 );
+	REQUIRE( table(0, 200) == 0 );
+	REQUIRE( table(300, 0) == 0 );
+	REQUIRE( table(10, 20) == 10*20*255 );
+	REQUIRE( table(300, 200) == 300*200*255 );
+      }
+    }
+  }
+}
+
+SCENARIO( "box filters from integral images", "[filters]" ) {
+  GIVEN( "a 2D integer image" ) {
+    StridedArray<int,2> a(37, 53);
+    a.map([](auto& coords, auto& val) {
+	val = static_cast<int>((coords[0]*31 + coords[1]*17) % 23) - 11;
+      });
+
+    WHEN( "box sums, means and variances are computed at several scales" ) {
+      auto ii = make_integral_image(a, true);
+      double sum_err = 0, mean_err = 0, var_err = 0;
+      for (auto r : {std::array<std::size_t,2>{{0, 0}},
+		     std::array<std::size_t,2>{{1, 2}},
+		     std::array<std::size_t,2>{{5, 3}},
+		     std::array<std::size_t,2>{{40, 60}}}) {
+	auto sums = ii.sum(r);
+	auto means = ii.mean(r);
+	auto vars = ii.variance(r);
+	auto squares = a*a;
+	auto sq = strided_array(squares);
+	for (auto i = 0UL; i < 37; i++)
+	  for (auto j = 0UL; j < 53; j++) {
+	    std::size_t count;
+	    auto s = naive_box_sum(a, i, j, r[0], r[1], count);
+	    auto s2 = naive_box_sum(sq, i, j, r[0], r[1], count);
+	    sum_err += std::abs(sums(i, j) - s);
+	    mean_err += std::abs(means(i, j) - s/count);
+	    var_err += std::abs(vars(i, j) - (s2/count - s*s/count/count));
+	  }
+      }
+      THEN( "they match brute-force computations" ) {
+	REQUIRE( sum_err == 0 );
+	REQUIRE( mean_err < 1e-10 );
+	REQUIRE( var_err < 1e-8 );
+      }
+    }
+  }
+
+  GIVEN( "a 3D floating point array" ) {
+    StridedArray<float,3> a(9, 12, 15);
+    a.map([](auto& coords, auto& val) {
+	val = std::sin(0.3f*coords[0] + 0.7f*coords[1]*coords[2]);
+      });
+
+    WHEN( "a box mean is computed" ) {
+      auto m = box_mean(a, {2, 1, 3});
+      THEN( "it matches a brute-force computation" ) {
+	double err = 0;
+	for (auto i = 0UL; i < 9; i++)
+	  for (auto j = 0UL; j < 12; j++)
+	    for (auto k = 0UL; k < 15; k++) {
+	      double s = 0;
+	      std::size_t count = 0;
+	      for (auto x = i > 2 ? i - 2 : 0; x < std::min(i + 3, 9UL); x++)
+		for (auto y = j > 1 ? j - 1 : 0; y < std::min(j + 2, 12UL); y++)
+		  for (auto z = k > 3 ? k - 3 : 0; z < std::min(k + 4, 15UL); z++) {
+		    s += a(x, y, z);
+		    count++;
+		  }
+	      err += std::abs(m(i, j, k) - s/count);
+	    }
+	REQUIRE( std::is_same<decltype(m)::dtype, float>::value );
+	REQUIRE( err < 1e-4 );
+      }
+    }
+
+    WHEN( "the variance of a constant array is computed" ) {
+      a = 3.1f;
+      auto v = box_variance(a, 2);
+      THEN( "it is null" ) {
+	REQUIRE( sum(abs(v)) < 1e-6 );
+      }
+    }
+  }
+}
@@ -0,0 +1,81 @@
+#include <cmath>
+#include <limits>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/filters/distance.h>
+using namespace necomi;
+
+
+SCENARIO( "Euclidean distance transforms", "[filters]" ) {
+  GIVEN( "a 2D mask obtained by thresholding" ) {
+    StridedArray<double,2> a(31, 44);
+    a.map([](auto& coords, auto& val) {
+	val = std::sin(0.37*coords[0]) * std::cos(0.23*coords[1] + 0.05*coords[0]);
+      });
+    auto mask = a > 0.8;
+
+    WHEN( "its distance transform is computed with anisotropic spacing" ) {
+      std::array<double,2> spacing{{1.5, 0.7}};
+      StridedArray<std::size_t,2> nearest(31, 44);
+      auto dist = distance_transform(mask, spacing, nearest);
+
+      THEN( "it matches a brute-force computation" ) {
+	double err = 0;
+	bool nearest_ok = true;
+	for (auto i = 0UL; i < 31; i++)
+	  for (auto j = 0UL; j < 44; j++) {
+	    double best = std::numeric_limits<double>::infinity();
+	    for (auto y = 0UL; y < 31; y++)
+	      for (auto x = 0UL; x < 44; x++)
+		if (mask(y, x)) {
+		  double dy = spacing[0]*(double(y) - i), dx = spacing[1]*(double(x) - j);
+		  best = std::min(best, std::sqrt(dy*dy + dx*dx));
+		}
+	    err += std::abs(dist(i, j) - best);
+
+	    auto n = nearest(i, j);
+	    auto y = n / 44, x = n % 44;
+	    double dy = spacing[0]*(double(y) - i), dx = spacing[1]*(double(x) - j);
+	    nearest_ok = nearest_ok && mask(y, x)
+	      && std::abs(std::sqrt(dy*dy + dx*dx) - best) < 1e-9;
+	  }
+	REQUIRE( err < 1e-9 );
+	REQUIRE( nearest_ok );
+      }
+    }
+  }
+
+  GIVEN( "a 3D label array with a few features" ) {
+    StridedArray<int,3> labels(12, 17, 9);
+    labels = 0;
+    labels(2, 3, 4) = 5;
+    labels(10, 15, 1) = 2;
+    labels(6, 0, 8) = 7;
+
+    WHEN( "its distance transform is computed" ) {
+      auto dist = distance_transform(labels);
+      THEN( "distances are those to the nearest feature" ) {
+	double err = 0;
+	dist.map([&err](const auto& c, auto& val) {
+	    auto d = [&c](double y, double x, double z) {
+	      return std::sqrt((c[0]-y)*(c[0]-y) + (c[1]-x)*(c[1]-x) + (c[2]-z)*(c[2]-z));
+	    };
+	    err += std::abs(val - std::min({d(2, 3, 4), d(10, 15, 1), d(6, 0, 8)}));
+	  });
+	REQUIRE( err < 1e-9 );
+      }
+    }
+  }
+
+  GIVEN( "a mask without features" ) {
+    StridedArray<bool,2> mask(5, 6);
+    mask = false;
+    THEN( "all the distances are infinite" ) {
+      auto dist = distance_transform(mask);
+      REQUIRE( dist(0, 0) == std::numeric_limits<double>::infinity() );
+      REQUIRE( dist(4, 5) == std::numeric_limits<double>::infinity() );
+    }
+  }
+}
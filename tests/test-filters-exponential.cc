@@ -164,3 +164,96 @@ SCENARIO( "exponential filter response is predetermined", "[filters]" ) {
 }
 
 #endif // HAVE_BOOST
+
+
+SCENARIO( "recursive filters follow their difference equation", "[filters]" ) {
+  GIVEN( "a second order recursive filter on scalars" ) {
+    std::vector<double> a = {2.0, -1.2, 0.36};
+    std::vector<double> b = {0.5, 0.25, -0.1};
+    RecursiveFilter<double,0> filter(a, b, {});
+
+    WHEN( "it is fed a sequence of values" ) {
+      std::vector<double> x, y;
+      double err = 0;
+      for (auto n = 0; n < 40; n++) {
+	x.push_back(std::sin(0.3*n) + (n%7 == 0));
+	auto yn = b[0]*x[n];
+	for (auto i = 1; i < 3 && n >= i; i++)
+	  yn += b[i]*x[n-i] - a[i]*y[n-i];
+	y.push_back(yn / a[0]);
+	err += std::abs(filter.feed(x[n]) - y[n]);
+      }
+      THEN( "its outputs are those of the difference equation" ) {
+	REQUIRE( err < 1e-12 );
+      }
+    }
+  }
+}
+
+SCENARIO( "recursive filters can process blocks of inputs", "[filters]" ) {
+  GIVEN( "two identical filters on 2D arrays" ) {
+    std::vector<double> a = {1.0, -1.5, 0.7, -0.1};
+    std::vector<double> b = {0.2, 0.1};
+    std::array<std::size_t,2> dims{{40, 75}};
+    RecursiveFilter<double,2> f1(a, b, dims);
+    RecursiveFilter<double,2> f2(a, b, dims);
+
+    StridedArray<double,3> inputs(13, 40, 75);
+    inputs.map([](auto& coords, auto& val) {
+	val = std::cos(0.1*coords[0] + 0.01*coords[1]*coords[2]);
+      });
+
+    WHEN( "a block is filtered after a few steps" ) {
+      for (auto t = 0; t < 5; t++) {
+	f1.feed(inputs[t]);
+	f2.feed(inputs[t]);
+      }
+      auto block = inputs.slice(Slice<std::size_t,3>({5,0,0}, {8,40,75}, {1,1,1}));
+      auto outputs = f2.feed_block(block);
+
+      THEN( "the outputs match those of successive feeds" ) {
+	double err = 0;
+	for (auto t = 0; t < 8; t++)
+	  err += sum(abs(f1.feed(inputs[t+5]) - outputs[t]));
+	REQUIRE( err == 0 );
+      }
+      THEN( "the filter state is the same" ) {
+	for (auto t = 5; t < 13; t++)
+	  f1.feed(inputs[t]);
+	REQUIRE( sum(abs(f1.feed(inputs[0]) - f2.feed(inputs[0]))) == 0 );
+      }
+    }
+
+    WHEN( "a block is filtered from non-contiguous inputs" ) {
+      StridedArray<double,3> wide(13, 75, 40);
+      wide.map([&inputs](auto& coords, auto& val) {
+	  val = inputs(coords[0], coords[2], coords[1]);
+	});
+      auto transposed = StridedArray<double,3>(wide.shared_data(), wide.data(),
+					       {wide.strides()[0], wide.strides()[2], wide.strides()[1]},
+					       {13, 40, 75});
+      StridedArray<double,3> outputs(13, 40, 75);
+      f2.feed_block(transposed, outputs);
+
+      THEN( "the outputs match those of successive feeds" ) {
+	double err = 0;
+	for (auto t = 0; t < 13; t++)
+	  err += sum(abs(f1.feed(inputs[t]) - outputs[t]));
+	REQUIRE( err == 0 );
+      }
+    }
+
+    WHEN( "a block of mismatched dimensions is filtered" ) {
+      StridedArray<double,3> bad(4, 75, 40);
+      bool exception_thrown = false;
+      try {
+	(void) f2.feed_block(bad);
+      } catch (std::length_error&) {
+	exception_thrown = true;
+      }
+      THEN( "a std::length_error exception is thrown" ) {
+	REQUIRE( exception_thrown );
+      }
+    }
+  }
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/filters/median.h>
+using namespace necomi;
+
+
+// Brute-force median filter using the public boundary functions
+template <typename T>
+static StridedArray<T,2> naive_median(const StridedArray<T,2>& a, std::size_t radius,
+				      Boundary boundary, T value)
+{
+  StridedArray<T,2> res(a.dims());
+  const auto r = static_cast<std::ptrdiff_t>(radius);
+  std::vector<T> v;
+  for (std::ptrdiff_t i = 0; i < static_cast<std::ptrdiff_t>(a.dim(0)); i++)
+    for (std::ptrdiff_t j = 0; j < static_cast<std::ptrdiff_t>(a.dim(1)); j++) {
+      v.clear();
+      for (auto y = i - r; y <= i + r; y++)
+	for (auto x = j - r; x <= j + r; x++) {
+	  auto by = boundary_index(y, a.dim(0), boundary);
+	  auto bx = boundary_index(x, a.dim(1), boundary);
+	  v.push_back(by == a.dim(0) || bx == a.dim(1) ? value : a(by, bx));
+	}
+      std::sort(v.begin(), v.end());
+      res(i, j) = v[v.size() / 2];
+    }
+  return res;
+}
+
+template <typename T>
+static StridedArray<T,2> test_image(std::size_t h, std::size_t w, int scale, int offset)
+{
+  StridedArray<T,2> a(h, w);
+  a.map([scale,offset](auto& coords, auto& val) {
+      val = static_cast<T>(static_cast<int>((coords[0]*7919 + coords[1]*104729
+					     + coords[0]*coords[1]*31) % scale) + offset);
+    });
+  return a;
+}
+
+SCENARIO( "median filters of integer images", "[filters]" ) {
+  GIVEN( "8 bits and 16 bits images" ) {
+    auto a8 = test_image<std::uint8_t>(29, 41, 256, 0);
+    auto s8 = test_image<std::int8_t>(17, 23, 256, -128);
+    auto a16 = test_image<std::uint16_t>(21, 47, 65536, 0);
+
+    for (auto boundary : {Boundary::CONSTANT, Boundary::CLAMP,
+			  Boundary::REFLECT, Boundary::WRAP})
+      for (auto radius : {0UL, 1UL, 3UL, 12UL}) {
+	WHEN( "they are median filtered" ) {
+	  THEN( "the result matches a brute-force filter" ) {
+	    REQUIRE( sum(median_filter(a8, radius, boundary, std::uint8_t(7))
+			 != naive_median(a8, radius, boundary, std::uint8_t(7))) == 0 );
+	    REQUIRE( sum(median_filter(s8, radius, boundary, std::int8_t(-3))
+			 != naive_median(s8, radius, boundary, std::int8_t(-3))) == 0 );
+	    REQUIRE( sum(median_filter(a16, radius, boundary, std::uint16_t(900))
+			 != naive_median(a16, radius, boundary, std::uint16_t(900))) == 0 );
+	  }
+	}
+      }
+  }
+
+  GIVEN( "a wide 16 bits image split in several tiles" ) {
+    auto a = test_image<std::uint16_t>(9, 150, 4000, 0);
+    WHEN( "it is median filtered" ) {
+      THEN( "the result matches a brute-force filter" ) {
+	for (auto radius : {2UL, 3UL, 20UL})
+	  REQUIRE( sum(median_filter(a, radius) != naive_median(a, radius, Boundary::REFLECT,
+								 std::uint16_t(0))) == 0 );
+      }
+    }
+  }
+
+  GIVEN( "an image with salt and pepper noise" ) {
+    StridedArray<std::uint8_t,2> clean(30, 30);
+    clean = 120;
+    auto a = clean.copy();
+    a(4, 5) = 255;
+    a(20, 17) = 0;
+    a(21, 17) = 255;
+    WHEN( "it is median filtered" ) {
+      auto res = median_filter(a, 1);
+      THEN( "the noise is removed" ) {
+	REQUIRE( sum(res != clean) == 0 );
+      }
+    }
+  }
+}
+
+SCENARIO( "median filters of floating point images", "[filters]" ) {
+  GIVEN( "a floating point image" ) {
+    StridedArray<double,2> a(19, 37);
+    a.map([](auto& coords, auto& val) {
+	val = std::sin(0.7*coords[0]*coords[1] + 0.3*coords[1]);
+      });
+
+    for (auto radius : {1UL, 2UL, 3UL})
+      WHEN( "it is median filtered" ) {
+	auto res = median_filter(a, radius, Boundary::CONSTANT, 0.25);
+	THEN( "the result matches a brute-force filter" ) {
+	  REQUIRE( sum(res != naive_median(a, radius, Boundary::CONSTANT, 0.25)) == 0 );
+	}
+      }
+  }
+
+  GIVEN( "pruned sorting networks" ) {
+    for (auto n : {3UL, 9UL, 25UL}) {
+      std::size_t padded;
+      auto net = median_network(n, (n-1)/2, padded);
+      WHEN( "they are applied to permutations" ) {
+	bool ok = true;
+	std::vector<int> v(padded);
+	for (auto trial = 0; trial < 200; trial++) {
+	  for (auto k = 0UL; k < padded; k++)
+	    v[k] = k < n ? static_cast<int>((k*7 + trial*13) % n) : 1000;
+	  std::swap(v[trial % n], v[(trial / 3) % n]);
+	  for (const auto& c : net)
+	    if (v[c.first] > v[c.second])
+	      std::swap(v[c.first], v[c.second]);
+	  ok = ok && v[(n-1)/2] == static_cast<int>((n-1)/2);
+	}
+	THEN( "they select the median" ) {
+	  REQUIRE( ok );
+	}
+      }
+    }
+  }
+}
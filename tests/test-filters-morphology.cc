@@ -0,0 +1,101 @@
+#include <cmath>
+#include <cstdint>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/filters/morphology.h>
+using namespace necomi;
+
+
+SCENARIO( "sliding window extrema", "[filters]" ) {
+  GIVEN( "a 3D array" ) {
+    StridedArray<int,3> a(7, 45, 23);
+    a.map([](auto& coords, auto& val) {
+	val = static_cast<int>((coords[0]*37 + coords[1]*11 + coords[2]*coords[1]*5) % 101) - 50;
+      });
+
+    for (auto dim : {0UL, 1UL, 2UL})
+      for (auto size : {1UL, 2UL, 5UL, 8UL, 60UL})
+	for (auto origin : {0UL, size/2, size-1}) {
+	  WHEN( "minima and maxima are computed along a dimension" ) {
+	    auto mins = sliding_min(a, dim, size, origin);
+	    auto maxs = sliding_max(a, dim, size, origin);
+	    THEN( "they match a brute-force computation" ) {
+	      bool same = true;
+	      a.map([&](const auto& coords, auto&) {
+		  auto c = coords;
+		  int lo = std::numeric_limits<int>::max();
+		  int hi = std::numeric_limits<int>::lowest();
+		  for (std::ptrdiff_t k = 0; k < static_cast<std::ptrdiff_t>(size); k++) {
+		    auto i = static_cast<std::ptrdiff_t>(coords[dim]) - static_cast<std::ptrdiff_t>(origin) + k;
+		    if (i < 0 || i >= static_cast<std::ptrdiff_t>(a.dim(dim)))
+		      continue;
+		    c[dim] = i;
+		    lo = std::min(lo, a(c));
+		    hi = std::max(hi, a(c));
+		  }
+		  same = same && mins(coords) == lo && maxs(coords) == hi;
+		});
+	      REQUIRE( same );
+	    }
+	  }
+	}
+  }
+
+  GIVEN( "a time series" ) {
+    auto x = litarray(3.0, 1.0, 4.0, 1.0, 5.0, 9.0, 2.0, 6.0);
+    WHEN( "a trailing rolling maximum is computed" ) {
+      auto m = sliding_max(x, 0, 3, 2);
+      THEN( "each element is the maximum of the last three ones" ) {
+	auto expected = litarray(3.0, 3.0, 4.0, 4.0, 5.0, 9.0, 9.0, 9.0);
+	REQUIRE( sum(abs(m - expected)) == 0 );
+      }
+    }
+  }
+}
+
+SCENARIO( "grayscale morphology with flat boxes", "[filters]" ) {
+  GIVEN( "an image with a bright square and a dark pixel" ) {
+    StridedArray<std::uint8_t,2> a(20, 30);
+    a = 100;
+    for (auto i = 5UL; i < 10; i++)
+      for (auto j = 8UL; j < 14; j++)
+	a(i, j) = 200;
+    a(15, 20) = 10;
+
+    WHEN( "it is eroded and dilated" ) {
+      auto e = erosion(a, {1, 2});
+      auto d = dilation(a, {1, 2});
+      THEN( "the square shrinks or grows by the box radius" ) {
+	REQUIRE( e(6, 10) == 200 );
+	REQUIRE( e(5, 10) == 100 );
+	REQUIRE( e(6, 9) == 100 );
+	REQUIRE( d(4, 6) == 200 );
+	REQUIRE( d(3, 6) == 100 );
+	REQUIRE( d(4, 5) == 100 );
+      }
+      THEN( "the dark pixel grows in the erosion only" ) {
+	REQUIRE( e(14, 18) == 10 );
+	REQUIRE( e(16, 22) == 10 );
+	REQUIRE( d(15, 20) == 100 );
+      }
+    }
+
+    WHEN( "it is opened and closed" ) {
+      auto o = opening(a, {1, 1});
+      auto c = closing(a, {1, 1});
+      THEN( "opening removes small bright features and closing dark ones" ) {
+	REQUIRE( sum(o != a) == 0 );
+	REQUIRE( c(15, 20) == 100 );
+	std::size_t changed = 0;
+	c.map([&](const auto& coords, auto val) { changed += val != a(coords); });
+	REQUIRE( changed == 1 );
+      }
+      THEN( "a larger opening removes the square" ) {
+	auto o3 = opening(a, {3, 3});
+	REQUIRE( o3(7, 10) == 100 );
+      }
+    }
+  }
+}
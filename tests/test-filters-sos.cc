@@ -0,0 +1,139 @@
+#include <cmath>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/filters.h>
+using namespace necomi;
+
+
+SCENARIO( "second-order sections follow their difference equation", "[filters]" ) {
+  GIVEN( "a cascade of two sections and the expanded recursive filter" ) {
+    std::vector<Biquad<double>> sos = {{0.3, 0.2, -0.1, -0.9, 0.2},
+				       {0.5, -0.4, 0.1, 0.3, 0.1}};
+    // Product of the section polynomials
+    std::vector<double> b = {0.15, -0.02, -0.1, 0.06, -0.01};
+    std::vector<double> a = {1.0, -0.6, 0.03, -0.03, 0.02};
+    RecursiveFilter<double,1> ref(a, b, {3});
+    SOSFilter<double,1> filter(sos, {3});
+
+    WHEN( "both are fed the same sequence" ) {
+      double err = 0;
+      for (auto t = 0; t < 50; t++) {
+	auto input = litarray(std::sin(0.2*t), std::cos(0.7*t), t == 0 ? 1.0 : 0.0);
+	err += sum(abs(filter.feed(input) - ref.feed(input)));
+      }
+      THEN( "their outputs are the same" ) {
+	REQUIRE( err < 1e-12 );
+      }
+    }
+  }
+}
+
+SCENARIO( "second-order sections process blocks of channels", "[filters]" ) {
+  GIVEN( "a cascade of sections and a long sequence of 2D inputs" ) {
+    std::vector<Biquad<double>> sos = {{0.3, 0.2, -0.1, -0.9, 0.2},
+				       {0.5, -0.4, 0.1, 0.3, 0.1},
+				       {0.2, 0.0, 0.0, -0.8, 0.0}};
+    StridedArray<double,3> inputs(100, 30, 25);
+    inputs.map([](auto& coords, auto& val) {
+	val = std::sin(0.05*coords[0]*(1 + coords[1]) + 0.3*coords[2]);
+      });
+
+    WHEN( "the sequence is filtered in blocks or step by step" ) {
+      SOSFilter<double,2> f1(sos, {30, 25});
+      SOSFilter<double,2> f2(sos, {30, 25});
+      auto outputs = f2.feed_block(inputs);
+      double err = 0;
+      for (auto t = 0; t < 100; t++)
+	err += sum(abs(f1.feed(inputs[t]) - outputs[t]));
+      THEN( "the outputs are the same" ) {
+	REQUIRE( err < 1e-12 );
+      }
+    }
+
+    WHEN( "the sequence is filtered along another dimension" ) {
+      auto res = sosfilt(sos, inputs, 1);
+      double err = 0;
+      for (auto i = 0UL; i < 100; i++)
+	for (auto k = 0UL; k < 25; k++) {
+	  auto line = inputs.slice(Slice<std::size_t,3>({i,0,k}, {1,30,1}, {1,1,1}));
+	  StridedArray<double,1> x(30);
+	  x.map([&line](auto& coords, auto& val) { val = line(0, coords[0], 0); });
+	  auto y = sosfilt(sos, x);
+	  for (auto j = 0UL; j < 30; j++)
+	    err += std::abs(y(j) - res(i, j, k));
+	}
+      THEN( "each line is filtered independently" ) {
+	REQUIRE( err < 1e-12 );
+      }
+    }
+  }
+}
+
+SCENARIO( "forward-backward filtering has no phase shift", "[filters]" ) {
+  GIVEN( "an exponential cascade low-pass filter and a smooth signal" ) {
+    auto sos = exp_cascade_sos(3UL, 4.0);
+    StridedArray<double,1> x(400);
+    x.map([](auto& coords, auto& val) {
+	val = std::exp(-std::pow((coords[0] - 199.5) / 40.0, 2));
+      });
+
+    WHEN( "it is filtered forward only" ) {
+      auto y = sosfilt(sos, x);
+      THEN( "its peak is delayed" ) {
+	auto peak = 0UL;
+	for (auto i = 0UL; i < 400; i++)
+	  if (y(i) > y(peak))
+	    peak = i;
+	REQUIRE( peak > 201 );
+      }
+    }
+
+    WHEN( "it is filtered forward and backward" ) {
+      auto y = sosfiltfilt(sos, x);
+      THEN( "its output remains symmetric" ) {
+	double err = 0;
+	for (auto i = 0; i < 200; i++)
+	  err += std::abs(y(i) - y(399-i));
+	REQUIRE( err < 1e-3 );
+      }
+      THEN( "a constant signal is kept unchanged" ) {
+	StridedArray<double,1> c(50);
+	c = 2.5;
+	REQUIRE( sum(abs(sosfiltfilt(sos, c) - c)) < 1e-9 );
+      }
+    }
+  }
+}
+
+#ifdef HAVE_BOOST
+
+SCENARIO( "exponential cascades can be made of second-order sections", "[filters]" ) {
+  GIVEN( "an exponential cascade filter and its second-order sections" ) {
+    auto n = 8UL;
+    auto tau = 85.0;
+    auto filter = exp_cascade(n, tau);
+    auto sos = exp_cascade_sos(n, tau);
+    SOSFilter<double,0> cascade(sos, {});
+
+    THEN( "there are enough sections for all the poles" ) {
+      REQUIRE( sos.size() == 5 );
+    }
+
+    WHEN( "an impulse response is computed" ) {
+      double err = 0;
+      StridedArray<double,0> input;
+      for (auto t = 0; t < 300; t++) {
+	input = t == 0 ? 1.0 : 0.0;
+	err += std::abs(cascade.feed(input)() - filter.feed(input)());
+      }
+      THEN( "it is the one of the direct form filter" ) {
+	// Up to the precision lost in the direct form coefficients
+	REQUIRE( err < 1e-4 );
+      }
+    }
+  }
+}
+
+#endif // HAVE_BOOST
@@ -0,0 +1,128 @@
+#include <cmath>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/filters/stencil.h>
+using namespace necomi;
+
+
+// Element of an extended array, computed with the public boundary functions
+static double extended(const StridedArray<double,2>& a, std::ptrdiff_t i, std::ptrdiff_t j,
+		       Boundary boundary, double value)
+{
+  auto y = boundary_index(i, a.dim(0), boundary);
+  auto x = boundary_index(j, a.dim(1), boundary);
+  return y == a.dim(0) || x == a.dim(1) ? value : a(y, x);
+}
+
+SCENARIO( "stencils are applied to arrays", "[filters]" ) {
+  GIVEN( "a 2D array and an asymmetric stencil" ) {
+    StridedArray<double,2> a(23, 31);
+    a.map([](auto& coords, auto& val) {
+	val = std::sin(0.3*coords[0]) + std::cos(0.17*coords[1]*coords[0]);
+      });
+    Stencil<double,2> s({{{0, 0}}, {{-2, 1}}, {{1, -3}}, {{0, 2}}},
+			{0.5, -1.0, 2.0, 0.25});
+
+    for (auto boundary : {Boundary::CONSTANT, Boundary::CLAMP,
+			  Boundary::REFLECT, Boundary::WRAP}) {
+      WHEN( "the stencil is applied" ) {
+	auto res = apply_stencil(a, s, boundary, 1.5);
+	THEN( "the results include the extended array elements" ) {
+	  double err = 0;
+	  for (std::ptrdiff_t i = 0; i < 23; i++)
+	    for (std::ptrdiff_t j = 0; j < 31; j++) {
+	      double expected = 0;
+	      for (auto k = 0UL; k < s.size(); k++)
+		expected += s.weights()[k] * extended(a, i + s.offsets()[k][0],
+						      j + s.offsets()[k][1],
+						      boundary, 1.5);
+	      err += std::abs(res(i, j) - expected);
+	    }
+	  REQUIRE( err < 1e-10 );
+	}
+      }
+    }
+
+    WHEN( "the stencil is applied to a non-contiguous view" ) {
+      auto v = a.slice(Slice<std::size_t,2>({1,2}, {11,14}, {2,2}));
+      auto res = apply_stencil(v, s, Boundary::REFLECT);
+      auto ref = apply_stencil(v.copy(), s, Boundary::REFLECT);
+      THEN( "the results are the same as on a copy" ) {
+	REQUIRE( sum(abs(res - ref)) < 1e-12 );
+      }
+    }
+
+    WHEN( "the stencil is larger than the array" ) {
+      StridedArray<double,2> small(2, 2);
+      small = 1.0;
+      auto res = apply_stencil(small, s, Boundary::CLAMP);
+      THEN( "all the elements are border ones" ) {
+	REQUIRE( sum(abs(res - 1.75)) < 1e-12 );
+      }
+    }
+  }
+
+  GIVEN( "a quadratic 3D array" ) {
+    StridedArray<double,3> a(8, 9, 10);
+    a.map([](auto& coords, auto& val) {
+	val = coords[0]*coords[0] + 2.0*coords[1]*coords[1] + 3.0*coords[2]*coords[2];
+      });
+    WHEN( "its Laplacian is computed" ) {
+      auto lap = apply_stencil(a, laplacian_stencil<double,3>());
+      THEN( "it is constant inside the array" ) {
+	double err = 0;
+	for (auto i = 1UL; i < 7; i++)
+	  for (auto j = 1UL; j < 8; j++)
+	    for (auto k = 1UL; k < 9; k++)
+	      err += std::abs(lap(i, j, k) - 12.0);
+	REQUIRE( err < 1e-10 );
+      }
+    }
+  }
+}
+
+SCENARIO( "functions are applied to neighborhoods", "[filters]" ) {
+  GIVEN( "a 2D integer array" ) {
+    StridedArray<int,2> a(17, 40);
+    a.map([](auto& coords, auto& val) {
+	val = static_cast<int>((coords[0]*7 + coords[1]*13) % 19);
+      });
+
+    WHEN( "the maximum of 3×5 neighborhoods is computed" ) {
+      auto res = map_neighborhoods(a, {1, 2}, [](const auto& nb) {
+	  int m = nb(0, 0);
+	  for (auto i = -1; i <= 1; i++)
+	    for (auto j = -2; j <= 2; j++)
+	      m = std::max(m, nb(i, j));
+	  return m;
+	}, Boundary::CONSTANT, -1);
+
+      THEN( "it matches a brute-force computation" ) {
+	bool same = true;
+	for (std::ptrdiff_t i = 0; i < 17; i++)
+	  for (std::ptrdiff_t j = 0; j < 40; j++) {
+	    int m = -1;
+	    for (auto y = std::max<std::ptrdiff_t>(i-1, 0); y < std::min<std::ptrdiff_t>(i+2, 17); y++)
+	      for (auto x = std::max<std::ptrdiff_t>(j-2, 0); x < std::min<std::ptrdiff_t>(j+3, 40); x++)
+		m = std::max(m, a(y, x));
+	    same = same && res(i, j) == m;
+	  }
+	REQUIRE( same );
+      }
+    }
+
+    WHEN( "a function of a different type is applied with periodic boundaries" ) {
+      auto res = map_neighborhoods(a, {0, 1}, [](const auto& nb) {
+	  return 0.5 * (nb(0, 1) - nb(0, -1));
+	}, Boundary::WRAP);
+      THEN( "the results are centered differences" ) {
+	REQUIRE( std::is_same<decltype(res)::dtype, double>::value );
+	REQUIRE( res(3, 0) == 0.5 * (a(3, 1) - a(3, 39)) );
+	REQUIRE( res(3, 39) == 0.5 * (a(3, 0) - a(3, 38)) );
+	REQUIRE( res(5, 20) == 0.5 * (a(5, 21) - a(5, 19)) );
+      }
+    }
+  }
+}
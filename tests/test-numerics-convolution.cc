@@ -0,0 +1,249 @@
+#include <cmath>
+#include <vector>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+#include <necomi/numerics/convolution.h>
+using namespace necomi;
+
+#ifdef HAVE_FFTW
+
+// Reference convolution of the lines of a 2D array along its last dimension
+static StridedArray<double,2> direct_convolve(const StridedArray<double,2>& a,
+					      const StridedArray<double,1>& h,
+					      long delay)
+{
+  StridedArray<double,2> res(a.dims());
+  const long n = a.dim(1), k = h.dim(0);
+  res.map([&](const auto& c, auto& val) {
+      val = 0;
+      for (long j = 0; j < k; j++) {
+	auto i = static_cast<long>(c[1]) + delay - j;
+	if (i >= 0 && i < n)
+	  val += h(j) * a(c[0], i);
+      }
+    });
+  return res;
+}
+
+TEST_CASE( "overlap convolution", "[numerics]" ) {
+  StridedArray<double,2> a(3, 2000);
+  a.map([](const auto& c, auto& val) { val = std::sin(0.05*c[1]*(c[0]+1) + std::cos(0.3*c[1])); });
+  StridedArray<double,1> h(31);
+  h.map([](const auto& c, auto& val) { val = std::exp(-0.1*c[0]) * std::cos(0.4*c[0]); });
+
+  SECTION( "centered kernels" ) {
+    auto ref = direct_convolve(a, h, 15);
+    for (auto method : {OverlapMethod::ADD, OverlapMethod::SAVE}) {
+      auto res = oaconvolve(a, h, 1, method);
+      REQUIRE( res.dims() == a.dims() );
+      REQUIRE( sum(power<2>(res - ref)) < 1e-18 );
+    }
+  }
+
+  SECTION( "non-contiguous axes" ) {
+    // Convolve along the first dimension of a strided view
+    StridedArray<double,2> t(2000, 6);
+    t.map([&a](const auto& c, auto& val) { val = a(c[1]/2, c[0]); });
+    auto v = t.slice(Slice<std::size_t,2>({0,0}, {2000,3}, {1,2}));
+    auto res = oaconvolve(v, h, 0);
+    auto ref = direct_convolve(a, h, 15);
+    res.map([&ref](const auto& c, auto val) {
+	REQUIRE( std::abs(val - ref(c[1], c[0])) < 1e-10 );
+      });
+  }
+
+  SECTION( "streaming frames" ) {
+    auto ref = direct_convolve(a, h, 0);
+    for (auto method : {OverlapMethod::ADD, OverlapMethod::SAVE}) {
+      OverlapConvolver<double,2> conv(h, a.dims(), 1, method, 128);
+      REQUIRE( conv.block_size() == 98 );
+      std::size_t pos = 0, len = 1;
+      while (pos < a.dim(1)) {
+	len = std::min<std::size_t>(3*len + 1, a.dim(1) - pos);
+	auto frame = a.slice(Slice<std::size_t,2>({0,pos}, {3,len}, {1,1}));
+	auto out = conv.feed(frame);
+	auto expected = ref.slice(Slice<std::size_t,2>({0,pos}, {3,len}, {1,1}));
+	REQUIRE( sum(power<2>(out - expected)) < 1e-18 );
+	pos += len;
+      }
+    }
+  }
+
+  SECTION( "invalid arguments" ) {
+    REQUIRE_THROWS( oaconvolve(a, h, 2) );
+    REQUIRE_THROWS( (OverlapConvolver<double,2>(h, a.dims(), 1, OverlapMethod::SAVE, 16)) );
+    OverlapConvolver<double,2> conv(h, a.dims(), 1);
+    StridedArray<double,2> wrong(4, 10);
+    REQUIRE_THROWS( conv.feed(wrong) );
+  }
+}
+
+TEST_CASE( "convolver", "[numerics]" ) {
+  StridedArray<double,2> a(23, 30);
+  a.map([](const auto& c, auto& val) { val = std::sin(0.3*c[0]*c[1]) + 0.01*c[0]; });
+  StridedArray<double,2> k(5, 4);
+  k.map([](const auto& c, auto& val) { val = 1.0 / (1 + c[0] + 2*c[1]); });
+  auto ref = fftconvolve(a, k);
+
+  SECTION( "single arrays" ) {
+    Convolver<double,2> conv(k, a.dims());
+    StridedArray<double,2> out(a.dims());
+    conv.apply(a, out);
+    REQUIRE( sum(power<2>(out - ref)) < 1e-20 );
+    // Repeated calls reuse the same buffers
+    conv.apply(a, out);
+    REQUIRE( sum(power<2>(out - ref)) < 1e-20 );
+    // In place
+    auto b = a.copy();
+    conv.apply(b, b);
+    REQUIRE( sum(power<2>(b - ref)) < 1e-20 );
+    StridedArray<double,2> wrong(23, 31);
+    REQUIRE_THROWS( conv.apply(wrong, wrong) );
+  }
+
+  SECTION( "non-contiguous arrays" ) {
+    StridedArray<double,2> big(46, 30);
+    big.map([&a](const auto& c, auto& val) { val = a(c[0]/2, c[1]); });
+    auto v = big.slice(Slice<std::size_t,2>({0,0}, {23,30}, {2,1}));
+    Convolver<double,2> conv(k, v.dims());
+    StridedArray<double,2> out(46, 30);
+    auto ov = out.slice(Slice<std::size_t,2>({1,0}, {23,30}, {2,1}));
+    conv.apply(v, ov);
+    REQUIRE( sum(power<2>(ov - ref)) < 1e-20 );
+  }
+
+  SECTION( "batches" ) {
+    StridedArray<double,3> frames(7, 23, 30), out(7, 23, 30);
+    frames.map([&a](const auto& c, auto& val) { val = (c[0] + 1) * a(c[1], c[2]); });
+    Convolver<double,2> conv(k, a.dims(), 3);
+    conv.apply_batch(frames, out);
+    out.map([&ref](const auto& c, auto val) {
+	REQUIRE( std::abs(val - (c[0] + 1) * ref(c[1], c[2])) < 1e-10 );
+      });
+  }
+}
+
+#endif // HAVE_FFTW
+
+// Reference convolution of 2D arrays
+static StridedArray<double,2> reference_convolve(const StridedArray<double,2>& a,
+						 const StridedArray<double,2>& h,
+						 ConvolutionMode mode,
+						 Boundary boundary, double value)
+{
+  std::array<std::size_t,2> dims;
+  std::array<long,2> off;
+  for (std::size_t d = 0; d < 2; d++) {
+    dims[d] = convolution_size(a.dim(d), h.dim(d), mode);
+    off[d] = convolution_offset(h.dim(d), mode);
+  }
+  StridedArray<double,2> res(dims);
+  res.map([&](const auto& c, auto& val) {
+      val = 0;
+      h.map([&](const auto& j, auto w) {
+	  auto i0 = boundary_index(c[0] + off[0] - j[0], a.dim(0), boundary);
+	  auto i1 = boundary_index(c[1] + off[1] - j[1], a.dim(1), boundary);
+	  val += w * (i0 < a.dim(0) && i1 < a.dim(1) ? a(i0, i1) : value);
+	});
+    });
+  return res;
+}
+
+TEST_CASE( "boundaries", "[core]" ) {
+  REQUIRE( boundary_index(2, 4, Boundary::CONSTANT) == 2 );
+  REQUIRE( boundary_index(-1, 4, Boundary::CONSTANT) == 4 );
+  REQUIRE( boundary_index(-2, 4, Boundary::CLAMP) == 0 );
+  REQUIRE( boundary_index(6, 4, Boundary::CLAMP) == 3 );
+  REQUIRE( boundary_index(-1, 4, Boundary::REFLECT) == 0 );
+  REQUIRE( boundary_index(-3, 4, Boundary::REFLECT) == 2 );
+  REQUIRE( boundary_index(5, 4, Boundary::REFLECT) == 2 );
+  REQUIRE( boundary_index(-1, 4, Boundary::WRAP) == 3 );
+  REQUIRE( boundary_index(9, 4, Boundary::WRAP) == 1 );
+}
+
+TEST_CASE( "direct convolution", "[numerics]" ) {
+  StridedArray<double,2> a(17, 21);
+  a.map([](const auto& c, auto& val) { val = std::cos(0.4*c[0] - 0.2*c[1]*c[0]); });
+  // Non-separable kernel
+  StridedArray<double,2> h(3, 4);
+  h.map([](const auto& c, auto& val) { val = 1.0 / (1 + c[0] + c[1]*c[1]); });
+  // Separable gaussian kernel
+  StridedArray<double,2> g(5, 3);
+  g.map([](const auto& c, auto& val) {
+      val = std::exp(-0.3*(c[0]-2.0)*(c[0]-2.0)) * std::exp(-0.5*(c[1]-1.0)*(c[1]-1.0));
+    });
+
+  SECTION( "separable kernels are detected" ) {
+    std::array<std::vector<double>,2> factors;
+    REQUIRE( separable_factors(g, factors) );
+    REQUIRE( factors[0].size() == 5 );
+    REQUIRE( factors[1].size() == 3 );
+    REQUIRE( std::abs(factors[0][1]*factors[1][2] - g(1,2)) < 1e-12 );
+    REQUIRE_FALSE( separable_factors(h, factors) );
+  }
+
+  SECTION( "all modes and boundaries" ) {
+    std::vector<ConvolutionMethod> methods{ConvolutionMethod::DIRECT};
+#ifdef HAVE_FFTW
+    methods.push_back(ConvolutionMethod::FFT);
+#endif
+    for (auto mode : {ConvolutionMode::FULL, ConvolutionMode::SAME, ConvolutionMode::VALID})
+      for (auto boundary : {Boundary::CONSTANT, Boundary::CLAMP,
+	    Boundary::REFLECT, Boundary::WRAP})
+	for (auto method : methods)
+	  for (auto k : {h, g}) {
+	    auto ref = reference_convolve(a, k, mode, boundary, 0.5);
+	    auto res = convolve(a, k, mode, boundary, 0.5, method);
+	    REQUIRE( res.dims() == ref.dims() );
+	    REQUIRE( sum(power<2>(res - ref)) < 1e-18 );
+	  }
+
+    // Singleton kernel dimensions on even inputs
+    StridedArray<double,2> e(16, 20);
+    e.map([](const auto& c, auto& val) { val = std::sin(0.3*c[0] + 0.1*c[1]*c[1]); });
+    StridedArray<double,2> row(1, 6), col(5, 1);
+    row.map([](const auto& c, auto& val) { val = 1.0 / (1 + c[1]); });
+    col.map([](const auto& c, auto& val) { val = 0.5 + c[0]; });
+    methods.push_back(ConvolutionMethod::AUTO);
+    for (auto mode : {ConvolutionMode::FULL, ConvolutionMode::SAME, ConvolutionMode::VALID})
+      for (auto boundary : {Boundary::CONSTANT, Boundary::REFLECT})
+	for (auto method : methods)
+	  for (auto k : {row, col}) {
+	    auto ref = reference_convolve(e, k, mode, boundary, 0.5);
+	    auto res = convolve(e, k, mode, boundary, 0.5, method);
+	    REQUIRE( res.dims() == ref.dims() );
+	    REQUIRE( sum(power<2>(res - ref)) < 1e-18 );
+	  }
+  }
+
+  SECTION( "one-dimensional signals" ) {
+    auto x = litarray(1.0, 2.0, 3.0, 4.0);
+    auto k = litarray(1.0, 0.5);
+    auto full = convolve(x, k, ConvolutionMode::FULL);
+    REQUIRE( full.dims()[0] == 5 );
+    REQUIRE( full(0) == 1.0 );
+    REQUIRE( full(1) == 2.5 );
+    REQUIRE( full(4) == 2.0 );
+    auto valid = convolve(x, k, ConvolutionMode::VALID);
+    REQUIRE( valid.dims()[0] == 3 );
+    REQUIRE( valid(0) == 2.5 );
+    REQUIRE_THROWS( convolve(k, x, ConvolutionMode::VALID) );
+  }
+
+#ifdef HAVE_FFTW
+  SECTION( "automatic method selection" ) {
+    auto old = convolution_fft_cost();
+    auto cost = calibrate_convolution(64, 5);
+    REQUIRE( cost > 0 );
+    REQUIRE( convolution_fft_cost() == cost );
+    StridedArray<double,2> big(40, 40);
+    big.map([](const auto& c, auto& val) { val = std::sin(0.01*c[0]*c[1]); });
+    auto ref = reference_convolve(a, big, ConvolutionMode::SAME, Boundary::WRAP, 0);
+    auto res = convolve(a, big, ConvolutionMode::SAME, Boundary::WRAP);
+    REQUIRE( sum(power<2>(res - ref)) < 1e-16 );
+    set_convolution_fft_cost(old);
+  }
+#endif
+}
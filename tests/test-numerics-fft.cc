@@ -92,11 +92,265 @@ SCENARIO( "convolutions can be implemented in Fourier domain" ) {
       auto res = fftconvolve(a, gauss);
       
       REQUIRE( res.dims() == a.dims() );
+      REQUIRE( std::fabs(res(20,20) - gauss(12,12)) < 1e-12 );
+      REQUIRE( std::fabs(res(23,18) - gauss(15,10)) < 1e-12 );
       
       //std::cout << res << std::endl;
     }
   }
 }
 
+SCENARIO( "FFT plans are cached and reused", "[numerics]" ) {
+  GIVEN( "several real arrays of the same shape" ) {
+    StridedArray<double,2> a(12,10), b(12,10);
+    a.map([](const auto& c, auto& val) { val = std::sin(0.3*c[0] + 0.7*c[1]); });
+    b.map([](const auto& c, auto& val) { val = std::cos(0.2*c[0]*c[1]); });
+    fft_plan_cache().clear();
+    WHEN( "they are transformed" ) {
+      auto fa = rfft(a);
+      auto n = fft_plan_cache().size();
+      auto fb = rfft(b);
+      THEN( "a single plan is created" ) {
+	REQUIRE( n == 1 );
+	REQUIRE( fft_plan_cache().size() == 1 );
+      }
+    }
+    WHEN( "measured plans are used" ) {
+      auto fa = rfft(a);
+      set_fft_planning(FFTPlanning::MEASURE);
+      auto fm = rfft(a);
+      set_fft_planning(FFTPlanning::ESTIMATE);
+      THEN( "the input is preserved and the results match" ) {
+	REQUIRE( a(3,4) == std::sin(0.3*3 + 0.7*4) );
+	REQUIRE( std::abs(sum(power<2>(fa-fm))) < 1e-20 );
+	REQUIRE( fft_plan_cache().size() == 2 );
+      }
+    }
+    WHEN( "non-contiguous arrays are transformed" ) {
+      auto s = a.slice(Slice<std::size_t,2>({0,1}, {6,4}, {2,2}));
+      auto fs = rfft(s);
+      THEN( "the result matches the one of a contiguous copy" ) {
+	REQUIRE( ! s.contiguous() );
+	REQUIRE( std::abs(sum(power<2>(fs-rfft(s.copy())))) < 1e-20 );
+      }
+    }
+  }
+  GIVEN( "some FFTW wisdom" ) {
+    set_fft_planning(FFTPlanning::MEASURE);
+    auto a = strided_array(zeros(16,16));
+    rfft(a);
+    set_fft_planning(FFTPlanning::ESTIMATE);
+    THEN( "it can be saved and restored" ) {
+      export_fft_wisdom("fft-wisdom.txt");
+      import_fft_wisdom("fft-wisdom.txt");
+      REQUIRE_THROWS( import_fft_wisdom("missing-fft-wisdom.txt") );
+    }
+  }
+}
+
+SCENARIO( "Fourier transforms can be computed in place", "[numerics]" ) {
+  GIVEN( "a 3D array of complex numbers" ) {
+    StridedArray<std::complex<double>,3> a(6,5,8);
+    a.map([](const auto& c, auto& val) {
+	val = std::complex<double>(std::sin(0.3*c[0] + c[1]), std::cos(0.5*c[2]*c[0]));
+      });
+    auto ref = fft(a);
+    WHEN( "it is transformed in place" ) {
+      auto b = a.copy();
+      fft_inplace(b);
+      THEN( "the result matches the out-of-place transform" ) {
+	REQUIRE( std::abs(sum(power<2>(b-ref))) < 1e-20 );
+      }
+      ifft_inplace(b);
+      THEN( "its inverse gives back the original array" ) {
+	REQUIRE( std::abs(sum(power<2>(b-a))) < 1e-20 );
+      }
+    }
+    WHEN( "it is transformed into an existing array" ) {
+      StridedArray<std::complex<double>,3> out(6,5,8);
+      fft(a, out);
+      THEN( "the result matches the allocating transform" ) {
+	REQUIRE( std::abs(sum(power<2>(out-ref))) < 1e-20 );
+      }
+      StridedArray<std::complex<double>,3> wrong(6,5,7);
+      REQUIRE_THROWS( fft(a, wrong) );
+    }
+    WHEN( "several threads are used" ) {
+      set_fft_threads(4);
+      auto b = fft(a);
+      set_fft_threads(1);
+      THEN( "the result is the same" ) {
+	REQUIRE( std::abs(sum(power<2>(b-ref))) < 1e-20 );
+      }
+    }
+  }
+  GIVEN( "a padded 2D array of real numbers" ) {
+    auto a = rfft_array<2>({7,10});
+    a.map([](const auto& c, auto& val) { val = std::sin(0.4*c[0]*c[1] + c[1]); });
+    auto orig = a.copy();
+    auto ref = rfft(orig);
+    WHEN( "it is transformed in place" ) {
+      auto f = rfft_inplace(a);
+      THEN( "the result matches the out-of-place transform" ) {
+	REQUIRE( f.dims() == ref.dims() );
+	REQUIRE( f.data() == reinterpret_cast<std::complex<double>*>(a.data()) );
+	REQUIRE( std::abs(sum(power<2>(f-ref))) < 1e-20 );
+      }
+      auto b = irfft_inplace(f, 10);
+      THEN( "its inverse gives back the original array" ) {
+	REQUIRE( b.dims() == orig.dims() );
+	REQUIRE( std::abs(sum(power<2>(b-orig))) < 1e-20 );
+      }
+    }
+    WHEN( "an array has no padding" ) {
+      REQUIRE_THROWS( rfft_inplace(orig) );
+    }
+  }
+}
+
+SCENARIO( "Fourier transforms can be computed along chosen axes", "[numerics]" ) {
+  GIVEN( "a 2D array of complex numbers" ) {
+    StridedArray<std::complex<double>,2> a(8,6);
+    a.map([](const auto& c, auto& val) {
+	val = std::complex<double>(std::sin(0.3*c[0] + c[1]), std::cos(0.7*c[1]*c[0]));
+      });
+    WHEN( "it is transformed along its last axis" ) {
+      auto f = fft(a, 1);
+      THEN( "each row is transformed independently" ) {
+	for (std::size_t i = 0; i < 8; i++) {
+	  auto row = a.slice(Slice<std::size_t,2>({i,0}, {1,6}, {1,1}));
+	  auto ref = fft(row);
+	  auto res = f.slice(Slice<std::size_t,2>({i,0}, {1,6}, {1,1}));
+	  REQUIRE( std::abs(sum(power<2>(res-ref))) < 1e-20 );
+	}
+      }
+      THEN( "its inverse gives back the original array" ) {
+	REQUIRE( std::abs(sum(power<2>(ifft(f, 1)-a))) < 1e-20 );
+      }
+    }
+    WHEN( "a non-contiguous view is transformed along its first axis" ) {
+      auto s = a.slice(Slice<std::size_t,2>({1,0}, {3,3}, {2,2}));
+      auto f = fft(s, 0);
+      THEN( "each column is transformed independently" ) {
+	for (std::size_t j = 0; j < 3; j++) {
+	  auto ref = fft(s.slice(Slice<std::size_t,2>({0,j}, {3,1}, {1,1})));
+	  auto res = f.slice(Slice<std::size_t,2>({0,j}, {3,1}, {1,1}));
+	  REQUIRE( std::abs(sum(power<2>(res-ref))) < 1e-20 );
+	}
+      }
+    }
+    WHEN( "it is transformed along all its axes" ) {
+      auto f = fft(a, std::array<std::size_t,2>{{1,0}});
+      THEN( "the result is its full transform" ) {
+	REQUIRE( std::abs(sum(power<2>(f-fft(a)))) < 1e-20 );
+      }
+    }
+    THEN( "invalid axes are rejected" ) {
+      REQUIRE_THROWS( fft(a, 2) );
+      REQUIRE_THROWS( fft(a, std::array<std::size_t,2>{{0,0}}) );
+    }
+  }
+  GIVEN( "a stack of 2D real images" ) {
+    StridedArray<double,3> a(5,7,4);
+    a.map([](const auto& c, auto& val) { val = std::sin(0.4*c[1]*c[2] + c[0]); });
+    WHEN( "the images are transformed in a single batch" ) {
+      auto f = rfft(a, std::array<std::size_t,2>{{1,2}});
+      THEN( "each image is transformed independently" ) {
+	REQUIRE( f.dims() == (std::array<std::size_t,3>{{5,7,3}}) );
+	for (std::size_t i = 0; i < 5; i++) {
+	  auto ref = rfft(a.slice(Slice<std::size_t,3>({i,0,0}, {1,7,4}, {1,1,1})));
+	  auto res = f.slice(Slice<std::size_t,3>({i,0,0}, {1,7,3}, {1,1,1}));
+	  REQUIRE( std::abs(sum(power<2>(res-ref))) < 1e-20 );
+	}
+      }
+      auto b = irfft(f, std::array<std::size_t,2>{{1,2}}, 4);
+      THEN( "the inverse gives back the original images" ) {
+	REQUIRE( std::abs(sum(power<2>(b-a))) < 1e-20 );
+      }
+    }
+    WHEN( "they are transformed along their first axis" ) {
+      auto f = rfft(a, 0);
+      THEN( "only non-negative frequencies of that axis are kept" ) {
+	REQUIRE( f.dims() == (std::array<std::size_t,3>{{3,7,4}}) );
+	REQUIRE( std::abs(sum(power<2>(irfft(f, 0, 5)-a))) < 1e-20 );
+      }
+    }
+  }
+}
+
+#ifdef HAVE_FFTW_FLOAT
+SCENARIO( "Fourier transforms of single precision arrays", "[numerics]" ) {
+  GIVEN( "a 2D array of floats and its double precision copy" ) {
+    StridedArray<float,2> a(12,9);
+    a.map([](const auto& c, auto& val) { val = std::sin(0.3f*c[0] + 0.7f*c[1]); });
+    StridedArray<double,2> ad(12,9);
+    ad.map([&a](const auto& c, auto& val) { val = a(c); });
+    WHEN( "their real transforms are computed" ) {
+      auto f = rfft(a);
+      auto fd = rfft(ad);
+      THEN( "they agree to single precision" ) {
+	REQUIRE( f.dims() == fd.dims() );
+	f.map([&fd](const auto& c, auto val) {
+	    REQUIRE( std::abs(std::complex<double>(val) - fd(c)) < 1e-4 );
+	  });
+      }
+      auto b = irfft(f, 9);
+      THEN( "the inverse gives back the original array" ) {
+	b.map([&a](const auto& c, auto val) {
+	    REQUIRE( std::abs(val - a(c)) < 1e-5f );
+	  });
+      }
+    }
+    WHEN( "they are convolved with a gaussian kernel" ) {
+      StridedArray<float,2> k(5,5);
+      k.map([](const auto& c, auto& val) {
+	  val = std::exp(-0.5f*((c[0]-2.f)*(c[0]-2.f) + (c[1]-2.f)*(c[1]-2.f)));
+	});
+      StridedArray<double,2> kd(5,5);
+      kd.map([&k](const auto& c, auto& val) { val = k(c); });
+      auto res = fftconvolve(a, k);
+      auto resd = fftconvolve(ad, kd);
+      THEN( "the results agree to single precision" ) {
+	REQUIRE( res.dims() == resd.dims() );
+	res.map([&resd](const auto& c, auto val) {
+	    REQUIRE( std::abs(val - resd(c)) < 1e-4 );
+	  });
+      }
+    }
+  }
+  GIVEN( "a 1D array of complex floats" ) {
+    StridedArray<std::complex<float>,1> a(16);
+    a.map([](const auto& c, auto& val) {
+	val = std::complex<float>(std::cos(0.2f*c[0]), std::sin(0.5f*c[0]));
+      });
+    auto b = a.copy();
+    fft_inplace(b);
+    ifft_inplace(b);
+    THEN( "an in-place round trip gives back the original array" ) {
+      b.map([&a](const auto& c, auto val) {
+	  REQUIRE( std::abs(val - a(c)) < 1e-5f );
+	});
+    }
+  }
+}
+#endif // HAVE_FFTW_FLOAT
+
+#ifdef HAVE_FFTW_LONG_DOUBLE
+SCENARIO( "Fourier transforms of extended precision arrays", "[numerics]" ) {
+  GIVEN( "a padded 2D array of long doubles" ) {
+    auto a = rfft_array<2,long double>({6,11});
+    a.map([](const auto& c, auto& val) { val = std::sin(0.4L*c[0]*c[1] + c[1]); });
+    auto orig = a.copy();
+    WHEN( "it is transformed in place and back" ) {
+      auto f = rfft_inplace(a);
+      auto b = irfft_inplace(f, 11);
+      THEN( "the original array is recovered" ) {
+	REQUIRE( std::abs(sum(power<2>(b-orig))) < 1e-24L );
+      }
+    }
+  }
+}
+#endif // HAVE_FFTW_LONG_DOUBLE
+
 #endif // HAVE_FFTW
 
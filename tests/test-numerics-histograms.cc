@@ -0,0 +1,120 @@
+#include <cstdint>
+#include <vector>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+using namespace necomi;
+
+TEST_CASE( "histograms", "[numerics]" ) {
+
+  SECTION( "uniform bins" ) {
+    auto a = litarray(0.0, 0.5, 1.0, 2.5, 3.9, 4.0, -1.0, 7.0);
+    auto h = histogram(a, 4, 0, 4);
+    REQUIRE( h.dims() == (std::array<std::size_t,1>{4}) );
+    REQUIRE( h(0) == 2 );
+    REQUIRE( h(1) == 1 );
+    REQUIRE( h(2) == 1 );
+    REQUIRE( h(3) == 2 );
+    REQUIRE_THROWS( histogram(a, 0, 0, 1) );
+    REQUIRE_THROWS( histogram(a, 4, 1, 1) );
+  }
+
+  SECTION( "explicit bin edges" ) {
+    auto a = litarray(1, 2, 3, 5, 8, 13, 21);
+    auto h = histogram(a, std::vector<double>{0, 2, 10, 21});
+    REQUIRE( h(0) == 1 );
+    REQUIRE( h(1) == 4 );
+    REQUIRE( h(2) == 2 );
+    REQUIRE_THROWS( histogram(a, std::vector<double>{0, 2, 2}) );
+  }
+
+  SECTION( "large arrays split among threads" ) {
+    set_num_threads(4);
+    StridedArray<float,2> a(300,1000);
+    a.map([](auto& path, auto& val) {
+	val = static_cast<float>((path[0]*1000 + path[1]) % 100) / 10;
+      });
+    auto h = histogram(a, 10, 0, 10);
+    for (std::size_t k = 0; k < 10; k++)
+      REQUIRE( h(k) == 30000 );
+    // Non-contiguous view
+    auto b = a.slice(Slice<std::size_t,2>({0,0}, {300,500}, {1,2}));
+    auto hb = histogram(b, 10, 0, 10);
+    for (std::size_t k = 0; k < 10; k++)
+      REQUIRE( hb(k) == 15000 );
+    set_num_threads(0);
+  }
+
+  SECTION( "direct indexing of small unsigned integers" ) {
+    StridedArray<std::uint8_t,2> img(480,640);
+    img.map([](auto& path, auto& val) {
+	val = static_cast<std::uint8_t>(path[0] + path[1]);
+      });
+    auto h = histogram(img);
+    REQUIRE( h.dims() == (std::array<std::size_t,1>{256}) );
+    std::vector<std::size_t> ref(256, 0);
+    img.map([&](const auto&, auto val) { ref[val]++; });
+    for (std::size_t k = 0; k < 256; k++)
+      REQUIRE( h(k) == ref[k] );
+
+    auto h16 = histogram(img, 16, 0, 256);
+    auto href = histogram(strided_array<double>(img), 16, 0, 256);
+    for (std::size_t k = 0; k < 16; k++)
+      REQUIRE( h16(k) == href(k) );
+
+    auto w = litarray<std::uint16_t>({3, 60000, 3, 65535});
+    auto hw = histogram(w);
+    REQUIRE( hw(3) == 2 );
+    REQUIRE( hw(65535) == 1 );
+  }
+
+  SECTION( "joint histograms" ) {
+    StridedArray<double,2> samples(6,2);
+    double xs[] = {0.1, 0.2, 0.9, 0.6, 0.4, 1.5};
+    double ys[] = {0.1, 0.7, 0.8, 0.2, 0.9, 0.5};
+    for (std::size_t i = 0; i < 6; i++) {
+      samples(i,0) = xs[i];
+      samples(i,1) = ys[i];
+    }
+    auto h = histogram(samples, std::array<std::size_t,2>{2,2},
+		       std::array<double,2>{0,0}, std::array<double,2>{1,1});
+    REQUIRE( h(0,0) == 1 );
+    REQUIRE( h(0,1) == 2 );
+    REQUIRE( h(1,0) == 1 );
+    REQUIRE( h(1,1) == 1 );
+  }
+}
+
+TEST_CASE( "bincount", "[numerics]" ) {
+  auto a = litarray(1, 3, 3, 0, 7, 3);
+  auto c = bincount(a);
+  REQUIRE( c.dims() == (std::array<std::size_t,1>{8}) );
+  REQUIRE( c(0) == 1 );
+  REQUIRE( c(3) == 3 );
+  REQUIRE( c(6) == 0 );
+  REQUIRE( c(7) == 1 );
+  REQUIRE( bincount(a, 12).dim(0) == 12 );
+  REQUIRE_THROWS( bincount(litarray(1, -2)) );
+
+  auto u = litarray<std::uint8_t>({2, 2, 5});
+  auto cu = bincount(u);
+  REQUIRE( cu.dim(0) == 6 );
+  REQUIRE( cu(2) == 2 );
+
+  auto l = bincount(litarray<std::uint32_t>({4, 1, 4}));
+  REQUIRE( l.dim(0) == 5 );
+  REQUIRE( l(4) == 2 );
+
+  // Boolean masks split among threads
+  const std::size_t n = 1UL << 20;
+  StridedArray<bool,1> mask(n);
+  mask.map([n](const auto& coords, auto& val) { val = coords[0] >= n - 1000; });
+  set_num_threads(8);
+  auto cb = bincount(mask);
+  set_num_threads(0);
+  REQUIRE( n > 2*histogram_grain );
+  REQUIRE( cb.dim(0) == 2 );
+  REQUIRE( cb(0) == n - 1000 );
+  REQUIRE( cb(1) == 1000 );
+}
@@ -0,0 +1,69 @@
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+using namespace necomi;
+
+TEST_CASE( "prefix scans", "[numerics]" ) {
+
+  SECTION( "exclusive scans" ) {
+    auto a = cumsum(range(1,7), 0, ScanType::EXCLUSIVE);
+    REQUIRE( a(0) == 0 );
+    REQUIRE( a(1) == 1 );
+    REQUIRE( a(5) == 15 );
+
+    auto c = reshape(range(56), 7, 8);
+    auto c0 = cumsum(c, 0, ScanType::EXCLUSIVE);
+    REQUIRE( c0(0,3) == 0 );
+    REQUIRE( c0(3,5) == 68 - 29 );
+    auto c1 = cumsum(c, 1, ScanType::EXCLUSIVE);
+    REQUIRE( c1(2,0) == 0 );
+    REQUIRE( c1(3,2) == 75 - 26 );
+  }
+
+  SECTION( "cumulative products" ) {
+    auto a = cumprod(range(1,7));
+    REQUIRE( a(0) == 1 );
+    REQUIRE( a(3) == 24 );
+    REQUIRE( a(5) == 720 );
+  }
+
+  SECTION( "generic operations" ) {
+    auto a = litarray(3, 1, 4, 1, 5, 9, 2, 6);
+    auto m = scan(a, 0, 0, [](int x, int y) { return std::max(x, y); });
+    REQUIRE( m(1) == 3 );
+    REQUIRE( m(4) == 5 );
+    REQUIRE( m(7) == 9 );
+  }
+
+  SECTION( "scans along any axis" ) {
+    StridedArray<long,3> a(3,5,2000);
+    a.map([](auto& path, auto& val) {
+	val = (path[0]*7 + path[1]*3 + path[2]) % 11;
+      });
+    for (std::size_t dim = 0; dim < 3; dim++) {
+      auto s = cumsum(a, dim);
+      s.map([&](auto path, auto val) {
+	  long ref = 0;
+	  auto n = path[dim];
+	  for (std::size_t k = 0; k <= n; k++) {
+	    path[dim] = k;
+	    ref += a(path);
+	  }
+	  REQUIRE( val == ref );
+	});
+    }
+  }
+
+  SECTION( "multi-threaded scans of long lines" ) {
+    set_num_threads(4);
+    auto n = 200000UL;
+    auto a = strided_array(range<long>(n));
+    auto s = cumsum(a);
+    auto e = cumsum(a, 0, ScanType::EXCLUSIVE);
+    set_num_threads(0);
+    bool ok = true;
+    for (auto i = 0UL; i < n; i++)
+      ok = ok && s(i) == static_cast<long>(i*(i+1)/2) && e(i) == static_cast<long>(i*(i-1)/2);
+    REQUIRE( ok );
+  }
+}
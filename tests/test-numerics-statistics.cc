@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "Catch/include/catch.hpp"
+
+#include <necomi/necomi.h>
+using namespace necomi;
+
+static constexpr double float_tol = 1e-9;
+
+TEST_CASE( "axis reductions", "[numerics]" ) {
+
+  StridedArray<double,3> a(2,3,4);
+  a.map([](auto& path, auto& val) {
+      val = path[0]*12 + path[1]*4 + path[2];
+    });
+
+  SECTION( "eager sum along a single axis" ) {
+    auto a0 = sum(a, std::array<std::size_t,1>{0});
+    REQUIRE( a0.dims() == (std::array<std::size_t,2>{3,4}) );
+    REQUIRE( a0(0,0) == 12 );
+    REQUIRE( a0(1,1) == 22 );
+    REQUIRE( a0(2,3) == 34 );
+
+    auto a2 = sum(a, std::array<std::size_t,1>{2});
+    REQUIRE( a2.dims() == (std::array<std::size_t,2>{2,3}) );
+    REQUIRE( a2(0,0) == 6 );
+    REQUIRE( a2(1,1) == 70 );
+    REQUIRE( a2(1,2) == 86 );
+  }
+
+  SECTION( "eager sum along several axes" ) {
+    auto s = sum(a, std::array<std::size_t,2>{0,2});
+    REQUIRE( s.dims() == (std::array<std::size_t,1>{3}) );
+    REQUIRE( s(0) == 60 );
+    REQUIRE( s(1) == 92 );
+    REQUIRE( s(2) == 124 );
+
+    auto t = sum(a, std::array<std::size_t,3>{2,0,1});
+    REQUIRE( t() == 276 );
+  }
+
+  SECTION( "keeping reduced dimensions" ) {
+    auto s = sum<true>(a, std::array<std::size_t,2>{0,2});
+    REQUIRE( s.dims() == (std::array<std::size_t,3>{1,3,1}) );
+    REQUIRE( s(0,1,0) == 92 );
+  }
+
+  SECTION( "reducing non-contiguous and delayed arrays" ) {
+    auto b = a.slice(Slice<std::size_t,3>({0,0,1}, {2,3,2}, {1,1,2}));
+    REQUIRE( ! b.contiguous() );
+    auto s = sum(b, std::array<std::size_t,1>{1});
+    REQUIRE( s(0,0) == 1+5+9 );
+    REQUIRE( s(1,1) == 15+19+23 );
+
+    auto d = sum(2*a, std::array<std::size_t,1>{0});
+    REQUIRE( d(1,1) == 44 );
+  }
+
+  SECTION( "reducing comparisons" ) {
+    // Only a(1,0,0) is not above 12 in the second half
+    auto s = sum(a > 12, std::array<std::size_t,1>{0});
+    REQUIRE( s.dims() == (std::array<std::size_t,2>{3,4}) );
+    REQUIRE( ! s(0,0) );
+    REQUIRE( s(0,1) );
+    REQUIRE( s(2,3) );
+
+    StridedArray<bool,2> m = sum(a > 12, 0);
+    m.map([&s](const auto& coords, auto val) {
+	REQUIRE( val == s(coords) );
+      });
+  }
+
+  SECTION( "invalid reduction axes" ) {
+    REQUIRE_THROWS( sum(a, std::array<std::size_t,1>{3}) );
+    REQUIRE_THROWS( sum(a, std::array<std::size_t,2>{1,1}) );
+  }
+
+  SECTION( "materialized statistics match delayed ones" ) {
+    for (std::size_t dim = 0; dim < 3; dim++) {
+      auto ls = sum(a, dim);
+      StridedArray<double,2> es = ls;
+      auto la = average(a, dim);
+      auto ea = strided_array(la);
+      auto lv = variance(a, dim, true);
+      auto ev = strided(lv);
+      auto ld = deviation(a, dim, false);
+      StridedArray<double,2> ed(ld.dims());
+      ed = ld;
+      ed.map([&](const auto& coords, auto val) {
+	  REQUIRE( std::fabs(es(coords) - ls(coords)) < float_tol );
+	  REQUIRE( std::fabs(ea(coords) - la(coords)) < float_tol );
+	  REQUIRE( std::fabs(ev(coords) - lv(coords)) < float_tol );
+	  REQUIRE( std::fabs(val - ld(coords)) < float_tol );
+	});
+    }
+  }
+
+  SECTION( "variance along several axes" ) {
+    auto v = variance(a, std::array<std::size_t,2>{0,1}, false);
+    // Each column holds {0,4,8,12,16,20} shifted by the column index
+    REQUIRE( std::fabs(v(0) - 280.0/6) < float_tol );
+    REQUIRE( std::fabs(v(3) - 280.0/6) < float_tol );
+    auto d = deviation<true>(a, std::array<std::size_t,2>{0,1}, true);
+    REQUIRE( d.dims() == (std::array<std::size_t,3>{1,1,4}) );
+    REQUIRE( std::fabs(d(0,0,2) - std::sqrt(56.0)) < float_tol );
+  }
+
+  SECTION( "integral variances along an axis" ) {
+    StridedArray<int,2> i(2, 3);
+    const int vals[] = {1, 2, 10, 3, 6, 14};
+    i.map([&vals](const auto& c, auto& val) { val = vals[c[0]*3 + c[1]]; });
+    REQUIRE( ! is_materializable<decltype(variance(i, 0, false))>::value );
+    REQUIRE( ! is_materializable<decltype(deviation(i, 0, false))>::value );
+    REQUIRE( is_materializable<decltype(sum(i, 0))>::value );
+    REQUIRE( is_materializable<decltype(variance(a, 0, false))>::value );
+
+    StridedArray<int,1> v = variance(i, 0, false);
+    REQUIRE( v(0) == 1 );
+    REQUIRE( v(1) == 4 );
+    REQUIRE( v(2) == 4 );
+    auto d = strided_array(deviation(i, 0, false));
+    REQUIRE( d(0) == 1 );
+    REQUIRE( d(2) == 2 );
+  }
+}
+
+TEST_CASE( "streaming moments", "[numerics]" ) {
+
+  // 50 frames of 3×4 elements with varying distributions
+  StridedArray<double,3> frames(50,3,4);
+  frames.map([](auto& path, auto& val) {
+      auto t = static_cast<double>(path[0]);
+      val = (path[1] + 1) * std::sin(0.7*t*(path[2]+1)) + 0.01*t*t;
+    });
+
+  SECTION( "single pass statistics match the two-pass ones" ) {
+    Moments<double,2,true> m({3,4});
+    for (std::size_t t = 0; t < frames.dim(0); t++)
+      m.update(frames[t]);
+    REQUIRE( m.count() == 50 );
+
+    auto avg = average(frames, std::array<std::size_t,1>{0});
+    auto var = variance(frames, std::array<std::size_t,1>{0}, true);
+    auto mv = m.variance(true);
+    auto md = m.deviation(false);
+    auto sk = m.skewness();
+    avg.map([&](const auto& c, auto val) {
+	REQUIRE( std::fabs(m.mean()(c) - val) < float_tol );
+	REQUIRE( std::fabs(mv(c) - var(c)) < 1e-9 );
+	REQUIRE( std::fabs(md(c)*md(c)*50 - var(c)*49) < 1e-9 );
+
+	// Reference third moment and extrema
+	double m3 = 0, mn = frames(0,c[0],c[1]), mx = mn;
+	for (std::size_t t = 0; t < 50; t++) {
+	  auto x = frames(t,c[0],c[1]);
+	  m3 += std::pow(x - val, 3);
+	  mn = std::min(mn, x);
+	  mx = std::max(mx, x);
+	}
+	auto m2 = var(c) * 49;
+	REQUIRE( std::fabs(sk(c) - std::sqrt(50.0)*m3/std::pow(m2, 1.5)) < 1e-9 );
+	REQUIRE( m.min()(c) == mn );
+	REQUIRE( m.max()(c) == mx );
+      });
+  }
+
+  SECTION( "partial accumulators can be merged" ) {
+    auto whole = moments<true>(frames);
+    Moments<double,2,true> a({3,4}), b({3,4}), c({3,4});
+    for (std::size_t t = 0; t < 50; t++)
+      (t < 17 ? a : (t < 31 ? b : c)).update(frames[t]);
+    a.merge(b).merge(c);
+    REQUIRE( a.count() == whole.count() );
+    auto ka = a.kurtosis();
+    auto kw = whole.kurtosis();
+    whole.mean().map([&](const auto& x, auto val) {
+	REQUIRE( std::fabs(a.mean()(x) - val) < 1e-12 );
+	REQUIRE( std::fabs(a.m2()(x) - whole.m2()(x)) < 1e-9 );
+	REQUIRE( std::fabs(ka(x) - kw(x)) < 1e-9 );
+	REQUIRE( a.min()(x) == whole.min()(x) );
+      });
+
+    Moments<double,2,true> empty({3,4});
+    empty.merge(a);
+    REQUIRE( empty.count() == 50 );
+    REQUIRE_THROWS( empty.merge(Moments<double,2,true>({4,3})) );
+  }
+
+  SECTION( "copied accumulators are independent" ) {
+    Moments<double,1> proto({5});
+    std::vector<Moments<double,1>> parts(2, proto);
+    StridedArray<double,1> tens(5), twos(5);
+    tens.fill(10);
+    twos.fill(2);
+    parts[0].update(tens);
+    REQUIRE( parts[1].count() == 0 );
+    REQUIRE( parts[1].max()(0) < 0 );
+    parts[1].update(twos);
+    auto copy = parts[0];
+    copy.update(tens);
+    REQUIRE( parts[0].count() == 1 );
+    parts[0].merge(parts[1]);
+    REQUIRE( parts[0].count() == 2 );
+    REQUIRE( parts[0].mean()(3) == 6 );
+    REQUIRE( proto.count() == 0 );
+    REQUIRE( proto.mean()(3) == 0 );
+
+    Moments<double,1> other({3});
+    other = parts[0];
+    REQUIRE( other.dims() == parts[0].dims() );
+    REQUIRE( other.count() == 2 );
+    other.update(twos);
+    REQUIRE( parts[0].count() == 2 );
+    REQUIRE( parts[0].mean()(3) == 6 );
+  }
+
+  SECTION( "variances need enough frames" ) {
+    Moments<double,1> m({3});
+    REQUIRE_THROWS( m.variance(false) );
+    StridedArray<double,1> frame(3);
+    frame.fill(4);
+    m.update(frame);
+    REQUIRE_THROWS( m.variance(true) );
+    REQUIRE( m.variance(false)(0) == 0 );
+  }
+}
+
+TEST_CASE( "quantiles", "[numerics]" ) {
+
+  SECTION( "whole array quantiles" ) {
+    auto a = litarray(7.0, 1.0, 3.0, 9.0, 5.0);
+    REQUIRE( median(a) == 5 );
+    REQUIRE( quantile(a, 0) == 1 );
+    REQUIRE( quantile(a, 1) == 9 );
+    REQUIRE( std::fabs(quantile(a, 0.1) - 1.8) < float_tol );
+    REQUIRE( std::fabs(percentile(a, 60) - 5.8) < float_tol );
+    REQUIRE( median(range<int>(10)) == 4.5 );
+    REQUIRE_THROWS( quantile(a, 1.5) );
+  }
+
+  SECTION( "quantiles along an axis" ) {
+    StridedArray<double,3> a(4,9,5);
+    a.map([](auto& path, auto& val) {
+	val = static_cast<double>((path[0]*31 + path[1]*17 + path[2]*7) % 23);
+      });
+    for (std::size_t dim = 0; dim < 3; dim++) {
+      for (double q : {0.0, 0.25, 0.5, 0.9, 1.0}) {
+	auto r = quantile(a, q, dim);
+	r.map([&](const auto& coords, auto val) {
+	    std::vector<double> line;
+	    auto path = add_coordinate(coords, dim);
+	    for (std::size_t k = 0; k < a.dim(dim); k++) {
+	      path[dim] = k;
+	      line.push_back(a(path));
+	    }
+	    std::sort(line.begin(), line.end());
+	    double pos = q * (line.size() - 1);
+	    auto lo = static_cast<std::size_t>(pos);
+	    double ref = line[lo];
+	    if (lo + 1 < line.size())
+	      ref += (pos - lo) * (line[lo+1] - line[lo]);
+	    REQUIRE( std::fabs(val - ref) < float_tol );
+	  });
+      }
+    }
+    auto m = median(2*a, 1);
+    REQUIRE( m.dims() == (std::array<std::size_t,2>{4,5}) );
+  }
+
+  SECTION( "histogram selection on integral data" ) {
+    StridedArray<std::uint8_t,2> img(64,100);
+    img.map([](auto& path, auto& val) {
+	val = static_cast<std::uint8_t>((path[0]*53 + path[1]*97) % 256);
+      });
+    auto exact = median(img, 1);
+    auto hist = median(img, 1, QuantileMethod::HISTOGRAM);
+    exact.map([&](const auto& coords, auto val) {
+	REQUIRE( hist(coords) == val );
+      });
+    REQUIRE( percentile(img, 37, QuantileMethod::HISTOGRAM)
+	     == percentile(img, 37) );
+
+    // Wide ranges are binned, hence approximated
+    auto w = litarray(-1000000, 0, 5, 2000000, 7);
+    REQUIRE( std::fabs(median(w, QuantileMethod::HISTOGRAM) - 5) < 100 );
+  }
+}
+
+TEST_CASE( "covariance", "[numerics]" ) {
+
+  // 1000 samples of 70 correlated channels, larger than a kernel block
+  const std::size_t n = 1000, c = 70;
+  StridedArray<double,2> a(n, c);
+  a.map([](auto& path, auto& val) {
+      auto t = static_cast<double>(path[0]);
+      val = std::sin(0.01*t*(path[1] % 7 + 1)) + 0.1*path[1] + std::cos(0.37*t*path[1]);
+    });
+
+  // Reference two-pass computation
+  std::vector<double> mean(c, 0);
+  for (std::size_t i = 0; i < n; i++)
+    for (std::size_t k = 0; k < c; k++)
+      mean[k] += a(i,k) / n;
+  auto ref = [&](std::size_t p, std::size_t q) {
+    double s = 0;
+    for (std::size_t i = 0; i < n; i++)
+      s += (a(i,p) - mean[p]) * (a(i,q) - mean[q]);
+    return s;
+  };
+
+  SECTION( "covariance and correlation matrices" ) {
+    set_num_threads(3);
+    auto cv = cov(a, true);
+    auto cr = corrcoef(a);
+    REQUIRE( cv.dims() == (std::array<std::size_t,2>{c,c}) );
+    for (std::size_t p = 0; p < c; p += 3) {
+      for (std::size_t q = 0; q < c; q += 5) {
+	REQUIRE( std::fabs(cv(p,q) - ref(p,q) / (n-1)) < float_tol );
+	REQUIRE( cv(p,q) == cv(q,p) );
+	auto r = ref(p,q) / std::sqrt(ref(p,p) * ref(q,q));
+	REQUIRE( std::fabs(cr(p,q) - r) < float_tol );
+      }
+      REQUIRE( std::fabs(cr(p,p) - 1) < float_tol );
+    }
+    set_num_threads(0);
+  }
+
+  SECTION( "streaming covariance" ) {
+    Covariance<double> whole(c), part(c);
+    for (std::size_t i = 0; i < n; i += 300)
+      whole.update(a.slice(Slice<std::size_t,2>({i,0}, {std::min<std::size_t>(300, n-i),c}, {1,1})));
+    part.update(a.slice(Slice<std::size_t,2>({0,0}, {10,c}, {1,1})));
+    Covariance<double> rest(c);
+    rest.update(a.slice(Slice<std::size_t,2>({10,0}, {n-10,c}, {1,1})));
+    part.merge(rest);
+    REQUIRE( whole.count() == n );
+    REQUIRE( part.count() == n );
+    for (std::size_t p = 0; p < c; p += 7) {
+      REQUIRE( std::fabs(whole.mean()(p) - mean[p]) < float_tol );
+      for (std::size_t q = 0; q < c; q += 4) {
+	REQUIRE( std::fabs(whole.comoment()(p,q) - ref(p,q)) < 1e-7 );
+	REQUIRE( std::fabs(part.comoment()(p,q) - ref(p,q)) < 1e-7 );
+      }
+    }
+    REQUIRE_THROWS( whole.merge(Covariance<double>(3)) );
+  }
+
+  SECTION( "copied accumulators are independent" ) {
+    Covariance<double> proto(c);
+    std::vector<Covariance<double>> parts(2, proto);
+    parts[0].update(a.slice(Slice<std::size_t,2>({0,0}, {10,c}, {1,1})));
+    REQUIRE( parts[1].count() == 0 );
+    REQUIRE( parts[1].mean()(0) == 0 );
+    parts[1].update(a.slice(Slice<std::size_t,2>({10,0}, {n-10,c}, {1,1})));
+    auto copy = parts[0];
+    copy.merge(parts[1]);
+    REQUIRE( parts[0].count() == 10 );
+    parts[0].merge(parts[1]);
+    REQUIRE( parts[0].count() == n );
+    REQUIRE( proto.count() == 0 );
+    for (std::size_t p = 0; p < c; p += 7) {
+      REQUIRE( std::fabs(parts[0].mean()(p) - mean[p]) < float_tol );
+      for (std::size_t q = 0; q < c; q += 4)
+	REQUIRE( std::fabs(parts[0].comoment()(p,q) - ref(p,q)) < 1e-7 );
+    }
+
+    REQUIRE_THROWS( proto.covariance(false) );
+    REQUIRE_THROWS( Covariance<double>(c).update(a.slice(Slice<std::size_t,2>({0,0}, {1,c}, {1,1}))).covariance(true) );
+
+    Covariance<double> other(c + 3);
+    other = parts[0];
+    REQUIRE( other.channels() == c );
+    REQUIRE( other.count() == n );
+    other.reset();
+    REQUIRE( parts[0].count() == n );
+    REQUIRE( std::fabs(parts[0].mean()(0) - mean[0]) < float_tol );
+  }
+
+  SECTION( "integral samples" ) {
+    StridedArray<int,2> b(4,2);
+    int xs[] = {1, 2, 3, 4};
+    for (std::size_t i = 0; i < 4; i++) {
+      b(i,0) = xs[i];
+      b(i,1) = -2*xs[i];
+    }
+    auto cv = cov(b, false);
+    REQUIRE( std::fabs(cv(0,0) - 1.25) < float_tol );
+    REQUIRE( std::fabs(cv(0,1) + 2.5) < float_tol );
+    REQUIRE( std::fabs(corrcoef(b)(1,0) + 1) < float_tol );
+  }
+}
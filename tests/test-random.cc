@@ -64,4 +64,131 @@ TEST_CASE( "random number generation", "[random]" ) {
     }
     fp << std::endl;
   }
+
+  SECTION( "counter-based generation" ) {
+    // Known answers of Philox-4×32-10
+    auto b = Philox::bijection({{0, 0, 0, 0}}, {{0, 0}});
+    REQUIRE( b == (Philox::block_type{{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}}) );
+    b = Philox::bijection({{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}},
+			  {{0xffffffff, 0xffffffff}});
+    REQUIRE( b == (Philox::block_type{{0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd}}) );
+    b = Philox::bijection({{0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}},
+			  {{0xa4093822, 0x299f31d0}});
+    REQUIRE( b == (Philox::block_type{{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}}) );
+
+    // Independent of the number of threads
+    Philox rng(1234, 5);
+    set_num_threads(1);
+    auto a1 = normal<double,3>({20, 31, 17}, rng);
+    auto u1 = uniform<int,1>(-5, 5, {10000}, rng);
+    set_num_threads(7);
+    auto a7 = normal<double,3>({20, 31, 17}, rng);
+    auto u7 = uniform<int,1>(-5, 5, {10000}, rng);
+    set_num_threads(0);
+    REQUIRE( sum(a1 != a7) == 0 );
+    REQUIRE( sum(u1 != u7) == 0 );
+
+    // Elements only depend on their flat index
+    auto c = normal<double>(20*31*17, rng);
+    bool same = true;
+    a1.map([&](const auto& coords, auto& val) {
+	same = same && val == c((coords[0]*31 + coords[1])*17 + coords[2]);
+      });
+    REQUIRE( same );
+
+    // Streams are different
+    Philox other(1234, 6);
+    auto d = normal<double>(20*31*17, other);
+    REQUIRE( sum(c == d) == 0 );
+
+    // Statistics
+    std::size_t size = 1e6;
+    double avg = 95, dev = 4.3;
+    auto e = normal<double>(avg, dev, size, rng);
+    REQUIRE( fabs(sum(e)/size - avg) < 1e-1 );
+    double std = 0;
+    e.map([&std,avg](auto&, auto& val) {
+	std += (val-avg)*(val-avg);
+      });
+    REQUIRE( fabs(sqrt(std/size) - dev) < 2e-2 );
+
+    auto f = betarnd<double,1>(2, 5, {100000}, rng);
+    REQUIRE( fabs(sum(f)/100000 - 2./7) < 1e-2 );
+  }
+
+  SECTION( "bulk sampling kernels" ) {
+    REQUIRE( unit_uniform<float>(std::uint32_t(0xFFFFFFFF)) < 1 );
+    REQUIRE( unit_uniform<double>(std::uint64_t(0)) == 0 );
+    REQUIRE( open_unit_uniform<double>(std::uint64_t(0)) > 0 );
+    REQUIRE( open_unit_uniform<float>(std::uint32_t(0xFFFFFFFF)) == 1 );
+
+    std::mt19937_64 prng(42);
+    Philox rng(42);
+    const std::size_t n = 200000;
+
+    auto mean = [](const auto& a) { return sum(a) / size(a); };
+    auto variance = [&mean](const auto& a) {
+      auto m = mean(a);
+      double v = 0;
+      a.map([&v,m](const auto&, auto& val) { v += (val-m)*(val-m); });
+      return v / size(a);
+    };
+
+    // Both generators, in single and double precision
+    StridedArray<float,1> f(n);
+    StridedArray<double,1> d(n);
+    fill_normal(f, prng, 3, 2);
+    fill_normal(d, rng, 3, 2);
+    REQUIRE( fabs(mean(f) - 3) < 2e-2 );
+    REQUIRE( fabs(variance(f) - 4) < 5e-2 );
+    REQUIRE( fabs(mean(d) - 3) < 2e-2 );
+    REQUIRE( fabs(variance(d) - 4) < 5e-2 );
+
+    // Body and tail of the ziggurat
+    std::size_t body = 0, tail = 0;
+    d.map([&](const auto&, auto& val) {
+	body += fabs(val - 3) < 2;
+	tail += fabs(val - 3) > 7;
+      });
+    REQUIRE( fabs(body/double(n) - 0.6827) < 5e-3 );
+    REQUIRE( tail > 50 );
+    REQUIRE( tail < 140 );
+
+    fill_uniform(f, rng, -1, 3);
+    fill_uniform(d, prng);
+    REQUIRE( min(f) >= -1 );
+    REQUIRE( max(f) < 3 );
+    REQUIRE( fabs(mean(f) - 1) < 1e-2 );
+    REQUIRE( fabs(variance(d) - 1./12) < 1e-3 );
+
+    for (double alpha : {0.3, 1.0, 4.5}) {
+      fill_gamma(f, prng, alpha, 2);
+      fill_gamma(d, rng, alpha, 2);
+      REQUIRE( min(f) > 0 );
+      REQUIRE( fabs(mean(f) - 2*alpha) < 3e-2*alpha );
+      REQUIRE( fabs(mean(d) - 2*alpha) < 3e-2*alpha );
+      REQUIRE( fabs(variance(d) - 4*alpha) < 0.15*alpha );
+    }
+
+    auto b = gammarnd<double,1>(3, 1, {n}, prng);
+    REQUIRE( fabs(mean(b) - 3) < 3e-2 );
+    fill_beta(f, rng, 2, 5);
+    REQUIRE( fabs(mean(f) - 2./7) < 1e-2 );
+
+    // In place in a non-contiguous view, independent of the threads
+    StridedArray<double,2> a(301, 10);
+    a.fill(-100);
+    auto v = a.slice(Slice<std::size_t,2>({0, 1}, {301, 3}, {1, 3}));
+    set_num_threads(1);
+    fill_gamma(v, rng, 0.7);
+    auto g1 = v.copy();
+    set_num_threads(5);
+    fill_gamma(v, rng, 0.7);
+    set_num_threads(0);
+    REQUIRE( sum(v != g1) == 0 );
+    std::size_t untouched = 0;
+    a.map([&untouched](const auto&, auto& val) { untouched += val == -100; });
+    REQUIRE( untouched == 301*7 );
+    REQUIRE( min(v) > 0 );
+  }
 }